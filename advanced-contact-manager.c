@@ -16,16 +16,26 @@
  *     - Input sanitization:
  *       · Trims whitespace.
  *       · Replaces commas (to maintain CSV compatibility).
- *     - Adds contact if valid and space is available.
+ *     - Adds contact if valid and the name is not already taken.
  *
  *   • View Contacts:
  *     - Displays all contacts in a formatted table:
  *       · Columns: Index | Name | Phone | Email
  *       - Empty fields shown as blank.
+ *     - Lists contacts in the order of the last sort.
+ *     - On a terminal, shows one page at a time (CMS_PAGE_SIZE rows, default 50) with
+ *       next / previous / jump / page-size commands; each page is one buffered write.
+ *       Piped or redirected output gets every row at once through a large buffer.
  *
  *   • Search Contacts:
  *     - Allows search by full or partial name (case-insensitive).
- *     - Matches displayed in table format.
+ *     - Partial search verifies only the candidates from a trigram index over lowercased
+ *       names (built on first use; -DTRIGRAM_ALL_FIELDS extends it to phone and email).
+ *     - Reverse lookup by phone (E.164 canonical form) or email (case-insensitive) through
+ *       secondary hash indexes built the first time they are queried.
+ *     - Fuzzy name search: candidates share a per-word Soundex key (phonetic index built
+ *       on first use), then are ranked by bounded edit distance; top 10 shown.
+ *     - Matches displayed in table format, paged like View Contacts.
  *
  *   • Update Contact:
  *     - Prompts for existing contact by name.
@@ -36,27 +46,60 @@
  *   • Delete Contact:
  *     - Prompts for contact name.
  *     - If found, asks for confirmation (Y/N).
- *     - On confirmation, removes contact and shifts array.
+ *     - On confirmation, removes the contact in O(1): its slot is left as a tombstone that
+ *       lookups skip, and tombstones are purged in one pass once they pass a quarter of the
+ *       store, or before a save, export, listing or sort.
+ *     - "delete-domain DOMAIN" (command line) deletes every contact with an email in the
+ *       domain in a single pass.
  *
  *   • Sort Contacts:
  *     - Sorts contacts in ascending order by chosen field:
  *       · Name
  *       · Phone
  *       · Email
- *     - Uses Merge Sort (efficient O(n log n)).
+ *       · Email domain, then name
+ *       · Phone country code, then name
+ *       · Custom list of up to 3 keys (name, phone, email, domain, country)
+ *     - Uses Merge Sort (efficient O(n log n)) over compact (key prefix, position) pairs
+ *       with a single scratch buffer; records are permuted into place afterwards.
+ *     - Large sorts run on worker threads (CMS_THREADS): halves are sorted in parallel and
+ *       the top-level merges are split between threads, with the same stable result.
+ *     - The chosen order is kept as a sorted view of positions: updates and deletes move
+ *       single entries, and new contacts are sorted and merged in when the list is viewed.
+ *     - The view is saved with the contacts (its positions in contacts.snap, its keys in a
+ *       "#sort" line of contacts.txt) and is in effect again after a restart.
  *
  * - File Persistence:
  *   • Save Contacts:
- *     - Saves all contacts to "contacts.txt" (CSV format).
- *     - Each line: name,phone,email
+ *     - Saves all contacts to "contacts.txt" (CSV format), skipped when no contact was
+ *       added, changed, deleted or reordered (a store-wide dirty flag).
+ *     - Each line: name,phone,email,id (files without the ID column still load), after
+ *       a "#last-id 42" line (the highest ID handed out) and a "#sort domain,name" line
+ *       when a sort order is kept
+ *     - Lines are assembled from the stored field lengths in a 1 MiB output buffer
+ *       and written in large pieces (shared with the vCard export).
+ *     - With -DHAVE_ZLIB and CMS_COMPRESS=1, contacts.txt and contacts.snap are written
+ *       gzip-compressed, 1 MiB blocks deflated in parallel as separate gzip members.
+ *       Loading detects the gzip magic bytes and inflates either file.
+ *     - Also writes "contacts.snap", a binary snapshot (header with magic, version, count
+ *       and checksum; record table; string blob; name index; sorted view).
+ *     - Every change is also appended to "contacts.journal" (fsync'd once per menu action)
+ *       and replayed at startup; a large journal triggers a background save.
  *
  *   • Load Contacts:
  *     - Loads existing contacts from "contacts.txt" at startup.
- *     - Ensures max contact limit not exceeded.
+ *     - Memory-maps the file and parses records in one forward scan straight into the
+ *       store (buffered reads where mmap is unavailable).
+ *     - Reserves store capacity up front based on the file size.
+ *     - Large files are parsed and validated in chunks on worker threads (CMS_THREADS),
+ *       then merged in file order.
+ *     - Uses contacts.snap instead when it matches contacts.txt: the snapshot is mapped
+ *       copy-on-write and used in place, with no parsing, validation or index building.
  *
  * - vCard (VCF) Integration:
  *   • Export to vCard:
- *     - Writes contacts to "contacts.vcf" in vCard 3.0 format.
+ *     - Writes contacts to a file given at the prompt ("contacts.vcf" by default, "-"
+ *       for standard output) in vCard 3.0 format; "*.gz" is gzipped (zlib builds).
  *     - Example:
  *       BEGIN:VCARD
  *       VERSION:3.0
@@ -68,24 +111,42 @@
  *     - Phone = CELL, Email = WORK (fixed types).
  *
  *   • Import from vCard:
- *     - Reads one or more VCARDs from file.
- *     - Extracts FN, TEL, EMAIL lines.
- *     - Only last TEL and EMAIL are stored (if multiple).
- *     - On END:VCARD → adds new contact to memory.
- *     - No duplicate prevention or extra validation.
- *     - Stops if MAX_CONTACTS is reached.
+ *     - Reads one or more VCARDs from a file given at the prompt ("Contacts1.vcf" by
+ *       default, "-" for standard input), streamed in 8 MiB blocks; gzip input is
+ *       detected by its magic bytes and inflated on the fly (zlib builds).
+ *     - Tokenizes content lines: folded lines are joined, groups ("item1.") and
+ *       parameters are skipped, and "\," "\;" "\\" "\n" escapes are decoded.
+ *     - Extracts FN (or N when there is no FN), TEL, EMAIL lines.
+ *     - Of several TEL or EMAIL lines, a valid PREF one wins, then the first valid one.
+ *     - On END:VCARD → adds new contact to memory, unless it duplicates one.
+ *     - Cards are sanitized and validated; invalid ones are skipped.
+ *     - A card duplicates the contact with the same name (case-insensitive), or
+ *       failing that the one with the same phone and email; found through the hash
+ *       indexes, so a re-import stays linear. Policy chosen at the prompt:
+ *         1. Skip (default)  — the existing contact is kept as is.
+ *         2. Overwrite       — the card's name, phone and email replace it.
+ *         3. Keep newest     — overwrite only if the card's REV is newer.
+ *         4. Merge           — take the card's phone and email, keep the name.
+ *     - Prints the inserted / updated / skipped counts.
+ *     - Stops only if memory runs out.
  *
  * - Input Validation:
  *   • Regex is used to validate formats:
  *     - NAME_REGEX
  *     - PHONE_REGEX
  *     - EMAIL_REGEX
+ *   • Patterns are compiled once at startup into a registry and reused.
+ *   • Bulk loads (file, vCard) use equivalent hand-written validators instead of regexec();
+ *     build with -DUSE_REGEX_VALIDATORS to use the regexes, or -DVALIDATOR_CROSSCHECK to
+ *     check both agree on every value loaded. contact-validator-test.c compares them on
+ *     boundary cases and seeded random strings.
  *   • Invalid inputs trigger re-prompt until corrected.
  *
  * - Sanitization Helpers:
- *   • trim_whitespace → removes leading/trailing spaces.
- *   • replace_commas  → replaces commas (CSV safe).
- *   • sanitize_contact → applies both to all fields.
+ *   • trim_whitespace      → removes leading/trailing spaces from input buffers.
+ *   • trim_slice           → trims a stored field in place by narrowing its arena slice.
+ *   • replace_commas_slice → replaces commas in a stored field (CSV safe).
+ *   • sanitize_contact     → applies both slice helpers to all fields.
  *
  * - User Interface:
  *   • Menu-driven system:
@@ -98,28 +159,104 @@
  *       7. Export Contacts (VCF)
  *       8. Import Contacts (VCF)
  *       9. Exit
+ *      10. Show Statistics (-DCMS_STATS builds)
  *   • Emoji-based feedback for user actions (✅, ❌, ℹ️).
+ *   • Command line: "add", "get", "update", "delete", "search", "import", "export", "sort"
+ *     and "stats" verbs run one operation without the menu; "batch FILE" applies a file of them
+ *     as one transaction with a single save. Results are tab-separated lines on stdout,
+ *     messages go to stderr.
+ *   • Server: "serve unix:PATH" or "serve HOST:PORT" keeps the store loaded and answers
+ *     batch-syntax request lines from many clients on one epoll (poll elsewhere) event
+ *     loop. Pipelined requests are answered in order; each round syncs the journal once,
+ *     then sends every client its responses in one write. If the sync fails, the round's
+ *     changes are answered with errors and later writes are refused. Saves on SIGINT /
+ *     SIGTERM.
+ *     With more than one worker thread, clients that only read are answered by reader
+ *     threads from a published copy of the store while the loop writes to a second copy;
+ *     each round publishes its changes and replays them onto the other copy.
  *
  * - Technical Notes:
- *   • Stores contacts in memory (array of structs).
- *   • Max capacity: 100 contacts.
+ *   • Stores contacts in memory in a growable store (amortized doubling).
+ *   • Records are compact offset/length slices into one string arena (bump allocated,
+ *     compacted on save and laid out in record order again after a sort); load and save
+ *     report the resulting bytes per contact.
+ *   • Field columns (built by the first partial search) hold each field's values back to
+ *     back, names and emails lowercased, with offset and length columns by position. Sorts,
+ *     partial search and domain deletes read one column instead of whole records.
+ *   • Capacity limited only by available memory; allocation failures are reported.
  *   • Field length limits prevent buffer overflow.
- *   • Case-insensitive name comparison via strcasecmp().
+ *   • Case-insensitive comparison, lowercasing and substring search run in ASCII kernels
+ *     that work 8 bytes at a time, 16 with SSE2 (or NEON with -DCMS_NEON) and 32 with AVX2
+ *     when the CPU has it; -DCMS_NO_SIMD keeps them plain C. They fold 'A'-'Z' only, as the
+ *     C locale does.
+ *   • Open-addressing hash index on the case-folded name, maintained on every add, update,
+ *     delete and import, gives O(1) exact search/update/delete and duplicate checks.
+ *   • Every contact has a stable 64-bit ID, not reused, kept in contacts.txt and the
+ *     snapshot and journaled with each add. An ID index maps it to the contact's slot, and
+ *     "#ID" names a contact wherever the command line and server accept a name.
  *   • Error handling ensures stability during file I/O.
+ *   • -DCMS_STATS keeps calls, total and longest time of load, save, import, export, sort,
+ *     search, file I/O, parsing and the validators, with byte and rejection counters; shown
+ *     by menu option 10 and the "stats" verb, and at exit when CMS_STATS_DUMP=1. Without
+ *     it the hooks compile away.
+ *   • contact-bench.c includes this file with CMS_NO_MAIN and benchmarks load, save, vCard
+ *     import/export, sorting, search and validation on synthetic directories (JSON output).
+ *   • contact-validator-test.c includes it the same way and checks that validate_field()
+ *     and validate_with_regex() agree on every generated value (exit status 1 if not).
  */
 
+#define _POSIX_C_SOURCE 200809L // Exposes POSIX extensions (strnlen) under -std=c11
+
 #include <ctype.h>   // Provides isspace() for whitespace trimming
 #include <regex.h>   // Provides regex functions for input validation
+#include <stdint.h>  // Provides SIZE_MAX for allocation overflow checks
 #include <stdio.h>   // Standard I/O functions like printf, scanf, fopen
 #include <stdlib.h>  // Provides memory management (malloc, free) and exit
 #include <string.h>  // String manipulation functions (strlen, strcpy, etc.)
-#include <strings.h> // Provides strcasecmp for case-insensitive string comparison
-
-#ifdef _WIN32
-#define strcasecmp _stricmp // On Windows, strcasecmp() is not available; use _stricmp instead
-#endif                      // On Linux/Unix/macOS, strcasecmp() exists, so no change
+#include <stdarg.h>  // Provides va_list for formatted log buffers
+#include <stdatomic.h> // Provides atomic flags shared with the compaction thread
+#include <sys/stat.h> // Provides stat()/fstat() to size and timestamp files
+#include <time.h>     // Provides clock_gettime() for the statistics timers
+#ifdef HAVE_ZLIB
+#include <zlib.h> // Provides deflate()/inflate() for gzip files (build with -DHAVE_ZLIB -lz)
+#endif
+
+// Vector units for the ASCII kernels: SSE2 on every x86-64 CPU plus AVX2 where the CPU has
+// it (picked at run time; needs GCC or Clang). NEON on AArch64 is opt-in with -DCMS_NEON
+// until its kernels have been checked on the hardware; AArch64 builds use the plain C ones
+// otherwise. Build with -DCMS_NO_SIMD to use the plain C kernels everywhere.
+#if !defined(CMS_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+#include <emmintrin.h> // Provides SSE2 intrinsics
+#define ASCII_SSE2 1
+#ifdef __GNUC__
+#include <immintrin.h> // Provides AVX2 intrinsics for functions built with target("avx2")
+#define ASCII_AVX2 1
+#endif
+#elif !defined(CMS_NO_SIMD) && defined(CMS_NEON) && defined(__aarch64__)
+#include <arm_neon.h> // Provides NEON intrinsics
+#define ASCII_NEON 1
+#endif
+
+#ifndef _WIN32
+#include <errno.h>        // Provides errno to tell retryable socket errors apart
+#include <fcntl.h>        // Provides open() for mapping files
+#include <netdb.h>        // Provides getaddrinfo() for server addresses
+#include <netinet/in.h>   // Provides TCP socket addresses
+#include <netinet/tcp.h>  // Provides TCP_NODELAY
+#include <poll.h>         // Provides poll() for the server where epoll is unavailable
+#include <pthread.h>      // Provides threads for parallel loading
+#include <signal.h>       // Provides sigaction() to stop the server cleanly
+#include <sys/mman.h>     // Provides mmap() for zero-copy file loading
+#include <sys/socket.h>   // Provides sockets for the server
+#include <sys/un.h>       // Provides Unix domain socket addresses
+#include <unistd.h>       // Provides close() and isatty()
+#ifdef __linux__
+#include <sys/epoll.h> // Provides epoll for the server event loop
+#endif
+#else
+#include <io.h> // Provides _isatty() and _fileno()
+#endif
 
-#define MAX_CONTACTS 100     // Maximum number of contacts allowed
 #define MAX_NAME_LENGTH 50   // Maximum length for contact name
 #define MAX_PHONE_LENGTH 17  // Maximum length for phone number (16 + '\0')
 #define MAX_EMAIL_LENGTH 254 // Maximum length for email address (RFC-ish max)
@@ -131,8 +268,51 @@
 #define PHONE_REGEX                                                                                \
     "^((\\+91[6-9][0-9]{9})|([6-9][0-9]{9})|(\\+[1-9][0-9]{6,14}))$" // Regex for valid phone
                                                                      // numbers
-#define CONFIRM_REGEX "^[yYnN]$"    // Regex for y/n confirmation input
-#define SORT_CHOICE_REGEX "^[1-3]$" // Regex for sort choice (1-3)
+#define CONFIRM_REGEX "^[yYnN]$"      // Regex for y/n confirmation input
+#define SORT_CHOICE_REGEX "^[1-6]$"   // Regex for sort choice (1-6)
+#define SORT_SPEC_REGEX "^[a-z]+(,[a-z]+){0,2}$" // Regex for a list of up to 3 sort keys
+#define SEARCH_CHOICE_REGEX "^[1-5]$" // Regex for search type choice (1-5)
+#define IMPORT_POLICY_REGEX "^[1-4]$" // Regex for the import duplicate policy (1-4)
+#define PHONE_QUERY_REGEX "^\\+?[0-9 ().-]{7,22}$" // Regex for a phone lookup (separators allowed)
+#define DIGITS_REGEX "^[0-9]+$"       // Regex for a plain number
+#define VIEW_PAGE_SIZE 50             // Default rows per page (CMS_PAGE_SIZE overrides it)
+#define FUZZY_TOP_K 10                // Closest matches listed by a fuzzy name search
+
+#define REGEX_REGISTRY_SIZE 16 // Maximum number of distinct compiled patterns kept
+
+#define STORE_INITIAL_CAPACITY 16 // Slots allocated on first growth of the contact store
+#define STORE_PURGE_FRACTION 4    // Deleted slots are purged once they pass 1/4 of the store
+#define ARENA_INITIAL_CAPACITY 4096 // Bytes allocated on first growth of the string arena
+#define AVG_LINE_ESTIMATE 40        // Assumed bytes per CSV line when sizing contacts.txt
+#define INDEX_INITIAL_CAPACITY 64   // Buckets allocated on first insert into a hash index
+#define INDEX_KEY_SIZE (MAX_EMAIL_LENGTH + 4) // Room for the longest normalized key + '\0'
+
+// Fields covered by the trigram index. Build with -DTRIGRAM_ALL_FIELDS to let partial search
+// match phone numbers and emails as well as names.
+#ifdef TRIGRAM_ALL_FIELDS
+#define TRIGRAM_FIELDS ((1u << FIELD_NAME) | (1u << FIELD_PHONE) | (1u << FIELD_EMAIL))
+#else
+#define TRIGRAM_FIELDS (1u << FIELD_NAME)
+#endif
+#define LOAD_MIN_CHUNK (1u << 20) // Smallest input chunk worth handing to its own thread
+#define MAX_WORKER_THREADS 256     // Upper bound on worker threads
+#define CONTACTS_PATH "contacts.txt"  // CSV file contacts are saved to and loaded from
+#define SNAPSHOT_PATH "contacts.snap" // Binary snapshot written next to the CSV file
+#define SNAPSHOT_MAGIC "CMSSNAP"      // First bytes of a snapshot file (with its '\0')
+#define SNAPSHOT_VERSION 5u           // Bumped whenever the layout or the name key changes
+#define JOURNAL_PATH "contacts.journal" // Append-only log of changes since the last save
+#define JOURNAL_MAGIC "CMSJRNL"         // First bytes of a journal file (with its '\0')
+#define JOURNAL_VERSION 1u              // Bumped whenever the entry format changes
+#define JOURNAL_COMPACT_BYTES (4u << 20) // Journal size that triggers a background save
+#define CSV_TMP_PATH "contacts.tmp"     // Temporary file a CSV save is written to
+#define VCF_IMPORT_PATH "Contacts1.vcf"   // File imported when no other path is given
+#define VCF_EXPORT_PATH "contacts.vcf"    // File exported when no other path is given
+#define OUTBUF_SIZE (1u << 20)            // Bytes formatted before each write to a file
+#define GZIP_LEVEL 6                      // zlib level for compressed files (1 = fastest)
+#define VCF_BLOCK_SIZE (8u << 20)         // Bytes of a VCF stream parsed at a time
+#define MAX_PATH_LENGTH 1024              // Longest file path accepted at a prompt
+#define FIXED_RECORD_SIZE                                                                          \
+    (MAX_NAME_LENGTH + MAX_PHONE_LENGTH + MAX_EMAIL_LENGTH) // Size of an inline fixed-width record
 
 // Function prototypes for contact management operations
 void add_contacts(void);    // Adds a new contact
@@ -142,29 +322,607 @@ void show_menu(void);       // Displays the main menu
 void delete_contacts(void); // Deletes a contact by name
 void update_contact(void);  // Updates an existing contact
 void load_contacts(void);   // Loads contacts from file
-void save_contacts(void);   // Saves contacts to file
+int save_contacts(void);    // Saves contacts to file (0 = saved or nothing to save)
 int get_menu_choice(void);  // Gets and validates menu choice
 void sort_contacts(void);   // Sorts contacts based on user choice
 
+typedef enum {
+    FIELD_NAME,  // Contact name
+    FIELD_PHONE, // Contact phone number
+    FIELD_EMAIL, // Contact email address
+    FIELD_COUNT  // Number of fields per contact
+} ContactField;
+
+#define INDEX_PHONETIC FIELD_COUNT      // Slot of the phonetic name index in store.index
+#define INDEX_ID (FIELD_COUNT + 1)      // Slot of the ID index (keyed on Contact.id, no field)
+#define INDEX_COUNT (FIELD_COUNT + 2)   // Per-field indexes plus the phonetic and ID ones
+
+// Compact contact record: each field is a slice of the store's string arena.
+// Every slice is '\0'-terminated in the arena so it can be used as a C string.
 typedef struct
 {
-    char name[MAX_NAME_LENGTH];   // Contact name
-    char phone[MAX_PHONE_LENGTH]; // Contact phone number
-    char email[MAX_EMAIL_LENGTH]; // Contact email address
+    uint32_t off[FIELD_COUNT]; // Offset of each field in the string arena
+    uint8_t len[FIELD_COUNT];  // Length of each field in bytes (excluding '\0')
+    uint8_t flags;             // CONTACT_* bits (occupies what would be padding)
+    uint64_t id;               // Stable ID: unique, handed out in increasing order, never 0
 } Contact;
 
-Contact contacts[MAX_CONTACTS]; // Global array to store contacts
-int contact_count = 0;          // Tracks number of contacts
+#define CONTACT_DELETED 0x01u // Deleted; the slot stays until store_purge()
+
+typedef struct
+{
+    char *data;      // Field strings, packed back to back
+    size_t used;     // Bump pointer: bytes handed out so far
+    size_t capacity; // Bytes allocated
+} StringArena;
+
+typedef enum {
+    SORT_BY_NAME,    // Sort by contact name
+    SORT_BY_PHONE,   // Sort by phone number
+    SORT_BY_EMAIL,   // Sort by email address
+    SORT_BY_DOMAIN,  // Sort by the part of the email after '@'
+    SORT_BY_COUNTRY, // Sort by the phone number's E.164 country code
+    SORT_FIELD_COUNT // Number of sort keys
+} SortField;
+
+#define SORT_SPEC_MAX_KEYS 3 // Keys in one sort specification
+
+// Ordered list of sort keys: later keys break ties left by earlier ones
+typedef struct
+{
+    uint8_t keys[SORT_SPEC_MAX_KEYS]; // SortField per key
+    uint8_t count;                    // Keys in use (0 = no order)
+} SortSpec;
+
+// Contact positions kept in sort order between sorts. Positions [0, count) are in 'order';
+// contacts appended since (positions [count, store count)) are merged in on the next sync.
+typedef struct
+{
+    uint32_t *order;  // Contact positions by (spec, position)
+    size_t count;     // Positions in 'order'
+    size_t capacity;  // Positions allocated
+    SortSpec spec;    // Order being maintained
+    int active;       // 1 after a sort; inactive views are skipped by store updates
+} SortedView;
+
+// Writes the normalized form of a field value into 'out' and returns its length
+typedef size_t (*IndexKeyFn)(const char *value, size_t len, char *out);
+
+// Open-addressing (linear probing) multi-map from a normalized field to contact positions
+typedef struct
+{
+    ContactField field; // Field the index is keyed on
+    IndexKeyFn key;     // Normalization applied to the field before hashing
+    uint32_t *slots;    // Contact position + 1 per bucket (0 = empty bucket)
+    uint32_t *hashes;   // Cached key hash per bucket
+    size_t capacity;    // Number of buckets (power of two, 0 = not allocated)
+    size_t used;        // Occupied buckets
+    int active;         // 1 once built; inactive indexes are skipped by store updates
+} HashIndex;
+
+// Iteration state for walking every contact that shares a key
+typedef struct
+{
+    uint32_t hash;            // Hash of the normalized key
+    size_t bucket;            // Next bucket to probe
+    size_t key_len;           // Length of the normalized key
+    char key[INDEX_KEY_SIZE]; // Normalized key being looked up
+} IndexCursor;
+
+// Sorted list of contact positions containing one trigram
+typedef struct
+{
+    uint32_t *items;   // Contact positions, ascending
+    uint32_t count;    // Positions in use
+    uint32_t capacity; // Positions allocated
+} PostingList;
+
+// Inverted index from lowercase trigrams to the contacts containing them
+typedef struct
+{
+    uint32_t *codes;     // Packed trigram per bucket (0 = empty bucket)
+    PostingList *lists;  // Posting list per bucket
+    size_t capacity;     // Number of buckets (power of two, 0 = not allocated)
+    size_t used;         // Occupied buckets
+    int active;          // 1 once built; built on the first partial search
+} TrigramIndex;
+
+// Field-major copy of the contacts for scans that read one field: each field's values sit
+// back to back in a block of their own, names and emails already lowercased, next to an
+// offset column and a length column indexed by position. A scan over one field reads only
+// those bytes instead of every record and the other fields' strings.
+typedef struct
+{
+    StringArena text[FIELD_COUNT]; // Values per field, '\0'-terminated (see COLUMN_FOLDED)
+    uint32_t *off[FIELD_COUNT];    // Offset of each position's value in text[field]
+    uint8_t *len[FIELD_COUNT];     // Length of each position's value
+    size_t count;                  // Positions filled (store.count while active)
+    size_t capacity;               // Positions allocated per column
+    int active;                    // 1 once built; built on the first partial search
+} FieldColumns;
+
+#define COLUMN_FOLDED ((1u << FIELD_NAME) | (1u << FIELD_EMAIL)) // Columns held lowercased
+
+typedef struct
+{
+    Contact *items;       // Contiguous contact records
+    size_t count;         // Number of contacts in use
+    size_t capacity;      // Number of allocated slots
+    StringArena arena;    // Backing storage for all field strings
+    HashIndex index[INDEX_COUNT]; // Per-field lookups plus phonetic names and IDs; all
+                                  // but the name index are built lazily
+    TrigramIndex trigrams;        // Substring lookups for partial search, built lazily
+    FieldColumns columns;         // Per-field copies for sorts and scans, built lazily
+    SortedView view;              // Order chosen by the last sort, kept up to date
+    size_t deleted;               // Slots of deleted contacts not purged yet
+    uint64_t last_id;             // Highest ID handed out so far (IDs start at 1)
+    int dirty;                    // 1 if the store differs from the saved files
+} ContactStore;
+
+static size_t fold_key(const char *value, size_t len, char *out);  // Lowercases a key
+static size_t phone_key(const char *value, size_t len, char *out); // E.164 canonical phone
+static size_t phonetic_key(const char *value, size_t len, char *out); // Soundex code per word
+
+ContactStore store_primary = {.index = {
+                                  {FIELD_NAME, fold_key, .active = 1}, // Case-folded name
+                                  {FIELD_PHONE, phone_key},            // E.164 phone
+                                  {FIELD_EMAIL, fold_key},             // Lowercased email
+                                  {FIELD_NAME, phonetic_key},          // Name sound
+                                  {FIELD_COUNT, NULL},                 // Contact.id
+                              }}; // Global growable contact store
+
+#ifndef _WIN32
+#define THREAD_LOCAL _Thread_local // One value per thread
+#else
+#define THREAD_LOCAL // No threads share the store on Windows
+#endif
+
+// Store the calling thread works on: the primary store, except on server reader threads,
+// which read the published copy (see StoreVersions). Code reaches it through cur_store().
+static THREAD_LOCAL ContactStore *store_current = &store_primary;
+static inline ContactStore *cur_store(void) { return store_current; }
+
+// Contact store operations
+int store_reserve(size_t capacity);      // Ensures room for at least 'capacity' contacts (0 = ok)
+int arena_reserve(StringArena *a, size_t bytes); // Ensures room for 'bytes' more bytes (0 = ok)
+int store_reserve_arena(size_t bytes);   // Ensures room for 'bytes' more string bytes (0 = ok)
+Contact *store_append(void);             // Appends an empty contact slot (NULL on out-of-memory)
+Contact *store_add(const char *name, const char *phone,
+                   const char *email);   // Appends a filled contact (NULL on out-of-memory)
+Contact *store_add_slices(const char *name, size_t name_len, const char *phone, size_t phone_len,
+                          const char *email,
+                          size_t email_len); // store_add() for unterminated field slices
+int store_set_field(Contact *c, ContactField field,
+                    const char *value);  // Replaces one field of a contact (0 = ok)
+void store_rollback(size_t arena_mark);  // Drops the last contact and its strings
+void store_remove(size_t index);         // Deletes a contact in O(1), leaving a tombstone
+size_t store_remove_matching(int (*match)(uint32_t pos, const void *arg),
+                             const void *arg); // Deletes every match in one pass
+void store_purge(void);                  // Drops the slots of deleted contacts
+void store_compact(void);                // Repacks the arena so it holds only live strings
+int store_clone(ContactStore *copy);     // Copies records, live strings and name index
+void store_clone_free(ContactStore *copy); // Releases a store_clone() copy
+long store_find_name(const char *name);  // Lowest position with this name (case-insensitive)
+long store_find_id(uint64_t id);         // Position of the contact with this ID, or -1
+int store_name_taken(const char *name,
+                     long except);       // 1 if another contact already has this name
+HashIndex *store_index(ContactField field); // Field index, built on first use (NULL on OOM)
+HashIndex *store_phonetic(void);         // Phonetic name index, built on first use (NULL on OOM)
+HashIndex *store_ids(void);              // ID index, built on first use (NULL on OOM)
+double store_bytes_per_contact(void);    // Current memory cost per contact
+void store_report_memory(void);          // Prints the bytes-per-contact figure
+void store_free(void);                   // Releases all store memory
+int store_duplicate(const ContactStore *from, ContactStore *to); // Full copy (0 = ok)
+static void store_release(ContactStore *s); // Frees one copy's blocks and empties it
+
+// Field accessors; returned pointers are invalidated when the arena grows or is compacted
+static inline const char *contact_field(const Contact *c, ContactField field)
+{
+    return cur_store()->arena.data + c->off[field];
+}
+static inline const char *contact_name(const Contact *c) { return contact_field(c, FIELD_NAME); }
+static inline const char *contact_phone(const Contact *c) { return contact_field(c, FIELD_PHONE); }
+static inline const char *contact_email(const Contact *c) { return contact_field(c, FIELD_EMAIL); }
+
+// Hash index operations
+int index_reserve(HashIndex *ix, size_t entries);    // Pre-sizes buckets for 'entries' keys
+int index_insert(HashIndex *ix, uint32_t pos);       // Indexes the contact at 'pos' (0 = ok)
+void index_erase(HashIndex *ix, uint32_t pos);       // Unindexes the contact at 'pos'
+void index_renumber(HashIndex *ix, const uint32_t *map); // Moves positions to map[position]
+int index_rebuild(HashIndex *ix);                    // Reindexes every contact (0 = ok)
+long index_lookup(const HashIndex *ix, const char *value,
+                  IndexCursor *cur);                 // First position matching value, or -1
+long index_next(const HashIndex *ix, IndexCursor *cur); // Next match for the cursor, or -1
+static long index_find_id(const HashIndex *ix, uint64_t id); // ID index lookup, or -1
+void index_free(HashIndex *ix);                      // Releases index memory
+
+// Trigram index operations (positions refer to store.items)
+int trigram_insert(TrigramIndex *tx, uint32_t pos);      // Indexes a contact's trigrams (0 = ok)
+void trigram_erase(TrigramIndex *tx, uint32_t pos);      // Removes a contact's trigrams
+void trigram_renumber(TrigramIndex *tx, const uint32_t *map); // Moves to map[position]
+int trigram_rebuild(TrigramIndex *tx);                   // Reindexes every contact (0 = ok)
+const PostingList *trigram_candidates(const TrigramIndex *tx,
+                                      const char *lower); // Shortest list for a query, or NULL
+void trigram_free(TrigramIndex *tx);                     // Releases index memory
+TrigramIndex *store_trigrams(void); // Trigram index, built on first use (NULL on OOM)
+
+// Field column operations (positions refer to store.items)
+int columns_insert(FieldColumns *fc, uint32_t pos);  // Copies in an appended contact (0 = ok)
+int columns_set(FieldColumns *fc, uint32_t pos,
+                ContactField field);                 // Copies in one changed field (0 = ok)
+void columns_erase(FieldColumns *fc, uint32_t pos);  // Drops the last position
+void columns_renumber(FieldColumns *fc, const uint32_t *map); // Moves to map[position]
+int columns_rebuild(FieldColumns *fc);               // Copies every contact again (0 = ok)
+void columns_free(FieldColumns *fc);                 // Releases column memory
+FieldColumns *store_columns(void); // Field columns, built on first use (NULL on OOM)
+
+// Value of 'field' at 'pos' in the columns (lowercased for COLUMN_FOLDED fields)
+static inline const char *column_value(const FieldColumns *fc, ContactField field,
+                                       uint32_t pos, size_t *len)
+{
+    *len = fc->len[field][pos];
+    return fc->text[field].data + fc->off[field][pos];
+}
+
+// Value of 'field' at 'pos' for a scan over one field: from the columns when they are
+// built (then lowercased for COLUMN_FOLDED fields), otherwise from the record
+static inline const char *scan_value(uint32_t pos, ContactField field, size_t *len)
+{
+    if (cur_store()->columns.active)
+        return column_value(&cur_store()->columns, field, pos, len);
+    *len = cur_store()->items[pos].len[field];
+    return contact_field(&cur_store()->items[pos], field);
+}
 
 static void
 trim_whitespace(char *s); // Removes leading and trailing whitespace characters from a string
-static void
-replace_commas(char *s); // Replaces commas in a string (to avoid format issues in CSV/VCF)
-static void sanitize_contact(Contact *c); // Cleans up a contact's fields (name, phone, email) by
-                                          // applying trimming/replacement
-void export_to_vcf(const char *filename); // Exports all saved contacts to a VCF (vCard) file
-void import_from_vcf(
-    const char *filename); // Imports contacts from a VCF (vCard) file into the contact list
+static void trim_slice(char *arena, Contact *c,
+                       ContactField field); // Trims one arena slice in place
+static void replace_commas_slice(char *arena, Contact *c,
+                                 ContactField field); // Replaces commas in an arena slice
+static void sanitize_contact(char *arena, Contact *c); // Cleans up a contact's fields (name, phone,
+                                                       // email) by applying trimming/replacement
+
+// ASCII kernels, vectorized where the CPU allows (case folds 'A'-'Z' only, as in the C locale)
+static void ascii_lower(const char *src, size_t len, char *dst); // Lowercases len bytes
+static inline size_t ascii_common(const char *a, const char *b,
+                                  size_t n); // Length of the common prefix, ignoring case
+static int ascii_casecmp(const char *a, size_t la, const char *b,
+                         size_t lb); // strcasecmp() for byte strings with known lengths
+static int ascii_caseeq(const char *a, const char *b, size_t n); // 1 if equal ignoring case
+static const char *ascii_find_lower(const char *hay, size_t len, const char *needle,
+                                    size_t n); // Case-insensitive search for a lowercase needle
+static void ascii_replace(char *s, size_t len, char from, char to); // Replaces every 'from'
+// Read-only view of a whole file: memory-mapped where possible, otherwise read into a buffer
+typedef struct
+{
+    const char *data; // File contents (not '\0'-terminated)
+    size_t size;      // Number of bytes
+    int mapped;       // 1 if 'data' is an mmap() region, 0 if heap-allocated
+} MappedFile;
+
+int map_file(const char *path, MappedFile *mf); // Maps or reads (and inflates) a file (0 = ok)
+int map_file_private(const char *path, MappedFile *mf); // Same, but writable copy-on-write
+void unmap_file(MappedFile *mf);                // Releases a file from map_file()
+static int is_gzip(const char *data, size_t size); // 1 if data starts with the gzip magic
+
+// Binary snapshot of the store: this header, then the records, the string blob (padded to
+// 8 bytes), the name index's slot and hash arrays and the sorted view's order (padded to 8
+// bytes). Loading maps the file and points the store straight at it; nothing is parsed,
+// validated, rehashed or re-sorted.
+typedef struct
+{
+    char magic[8];          // SNAPSHOT_MAGIC
+    uint32_t version;       // SNAPSHOT_VERSION
+    uint32_t record_size;   // sizeof(Contact) of the writer
+    uint64_t count;         // Contact records
+    uint64_t arena_bytes;   // String blob bytes, excluding padding
+    uint64_t index_buckets; // Name index buckets (power of two)
+    uint64_t index_used;    // Occupied name index buckets
+    uint64_t source_size;   // Size of the contacts.txt saved alongside
+    uint64_t source_mtime;  // Its modification time in nanoseconds
+    uint64_t journal_seq;   // Last journal entry included in this snapshot
+    uint64_t last_id;       // Highest contact ID handed out, deleted ones included
+    uint64_t view_count;    // Positions in the sorted view's order
+    SortSpec view_spec;     // Order the view keeps (no keys = no view)
+    uint8_t reserved[4];    // Zero
+    uint64_t checksum;      // Checksum of everything after the header
+} SnapshotHeader;
+
+MappedFile store_snapshot; // Snapshot the store's records, arena and name index may point into
+int save_snapshot(const ContactStore *s, uint64_t seq, uint64_t source_size,
+                  uint64_t source_mtime); // Writes SNAPSHOT_PATH for a store (0 = ok)
+int load_snapshot(uint64_t *seq);         // Loads SNAPSHOT_PATH if it matches contacts.txt
+
+// Journal: header, then entries of [u32 payload size][u32 checksum][payload]. A payload is
+// [u64 seq][u8 op][u8 arg][u32 position] and, for adds and updates, length-prefixed values
+// (for adds, followed by the contact's u64 ID).
+typedef struct
+{
+    char magic[8];       // JOURNAL_MAGIC
+    uint32_t version;    // JOURNAL_VERSION
+    uint32_t reserved;   // Zero
+    uint64_t base_seq;   // Last sequence number already contained in the base files
+    uint64_t base_size;  // Size of the contacts.txt the journal applies to
+    uint64_t base_mtime; // Its modification time in nanoseconds
+} JournalHeader;
+
+typedef enum {
+    JOURNAL_ADD = 1, // Append a contact (3 values) with the next ID (older journals)
+    JOURNAL_UPDATE,  // Replace field 'arg' of the contact at 'position' (1 value)
+    JOURNAL_DELETE,  // Remove the contact at 'position' and close the gap (older journals)
+    JOURNAL_SORT,    // Sort the store by SortField 'arg', then the keys packed in 'position'
+    JOURNAL_ERASE,   // Mark the contact at 'position' deleted, keeping its slot
+    JOURNAL_PURGE,   // Drop the slots of deleted contacts
+    JOURNAL_ADD_ID   // Append a contact (3 values, then its ID)
+} JournalOp;
+
+// Store state handed to a checkpoint writer: a private copy for background compaction
+typedef struct
+{
+    ContactStore copy;     // Records, compacted strings and name index to write
+    uint64_t seq;          // Journal sequence number the copy reflects
+    uint64_t size, mtime;  // Stamp of the CSV that was written
+    int result;            // Result of checkpoint_write()
+} Checkpoint;
+
+typedef struct
+{
+    FILE *file;            // Open for appending (NULL = not journaling, e.g. while loading)
+    uint64_t seq;          // Sequence number of the last entry written
+    size_t bytes;          // Current size of the journal file
+    size_t pending;        // Entries written since the last fsync
+    int failed;            // 1 if an entry since the last commit was not made durable
+    int unavailable;       // 1 once writing the journal failed: changes wait for a save
+    int compacting;        // 1 while a background checkpoint is running
+    atomic_int done;       // Set by the checkpoint thread when it finishes
+    Checkpoint checkpoint; // State for the running checkpoint
+#ifndef _WIN32
+    pthread_t thread;      // Background checkpoint thread
+    int threaded;          // 1 if 'thread' must be joined
+#endif
+} Journal;
+
+Journal journal; // Write-ahead journal of changes since the last save
+void journal_open(int from_snapshot, uint64_t seq); // Replays the journal and starts logging
+int journal_commit(void);  // Makes logged changes durable (0 = ok); may start a background save
+void journal_finish(void); // Waits for a background save to finish
+void journal_rebase(uint64_t base_seq, uint64_t size, uint64_t mtime,
+                    uint64_t keep_until); // Restarts the journal on top of newly written files
+void journal_close(void);  // Stops logging
+static void journal_add(const Contact *c);                   // Logs an appended contact
+static void journal_update(uint32_t pos, ContactField field); // Logs a field change
+static void journal_erase(uint32_t pos);                     // Logs a deletion
+static void journal_purge(void);                             // Logs a purge of deleted slots
+static void journal_sort(const SortSpec *spec);               // Logs a sort by a spec
+
+// Growable text buffer, used to hold per-chunk warnings until they can be printed in order
+typedef struct
+{
+    char *data;      // Text (always '\0'-terminated once allocated)
+    size_t len;      // Bytes of text
+    size_t capacity; // Bytes allocated
+} TextBuffer;
+
+// One newline- or card-aligned chunk of an input file, parsed independently by a worker.
+// Contacts land in a private arena and are merged into the store in file order.
+typedef struct LoadBatch
+{
+    const char *begin;                   // First byte of the chunk
+    const char *end;                     // One past the last byte of the chunk
+    void (*parse)(struct LoadBatch *b);  // Parser run over [begin, end)
+    Contact *items;                      // Parsed contacts (offsets into 'arena')
+    size_t count;                        // Contacts in 'items'
+    size_t capacity;                     // Slots allocated in 'items'
+    StringArena arena;                   // Strings for 'items'
+    TextBuffer log;                      // Warnings, printed when the batch is merged
+    uint64_t *revs;                      // REV of each contact as YYYYMMDDhhmmss (0 = none)
+    size_t revs_len;                     // Entries of 'revs' allocated; later contacts have none
+    size_t rejected;                     // Records that failed validation
+    int out_of_memory;                   // 1 if the chunk stopped early
+} LoadBatch;
+
+// What a vCard import does with a card that duplicates an existing contact
+typedef enum
+{
+    IMPORT_SKIP,        // Keep the existing contact as is
+    IMPORT_OVERWRITE,   // Replace its name, phone and email with the card's
+    IMPORT_KEEP_NEWEST, // Overwrite only when the card's REV is newer
+    IMPORT_MERGE,       // Take the card's phone and email, keep the existing name
+} ImportPolicy;
+
+// Duplicate handling state for one import
+typedef struct
+{
+    ImportPolicy policy; // What to do with duplicates
+    size_t inserted;     // Cards added as new contacts
+    size_t updated;      // Duplicates that changed an existing contact
+    size_t skipped;      // Duplicates left as they were
+    uint64_t *revs;      // REV applied to each store position during this import (0 = none)
+    size_t revs_len;     // Entries of 'revs' allocated
+} ImportDedup;
+
+int worker_threads = 0; // Threads for bulk loading (0 = one per core, or CMS_THREADS)
+int worker_count(void); // Resolves the number of worker threads to use
+long load_parallel(const char *data, size_t size, size_t min_chunk,
+                   const char *(*next_boundary)(const char *p, const char *end),
+                   void (*parse)(LoadBatch *b), size_t *rejected,
+                   ImportDedup *dedup); // Parses and merges a file (dedup = NULL: append all)
+static const char *next_card(const char *p, const char *end); // Start of the next vCard
+static void parse_vcard_chunk(LoadBatch *b);                   // Parses one chunk of vCards
+
+// Buffered output: records are formatted into one large buffer with length-aware appends,
+// then written in OUTBUF_SIZE pieces, instead of one stdio call per field. Compressed output
+// holds one OUTBUF_SIZE block per worker thread and deflates the blocks in parallel, each
+// into its own gzip member; concatenated members are one valid gzip file.
+// Without a file the bytes stay in memory ('data', 'len') and the buffer grows instead.
+typedef struct
+{
+    FILE *file;              // Destination (NULL = keep the bytes in memory)
+    char *data;              // Buffer (points at 'fallback' if allocation failed)
+    size_t len;              // Bytes waiting to be written
+    size_t capacity;         // Bytes in 'data'
+    int failed;              // 1 once a write failed
+    int blocks;              // Blocks in 'data' compressed at a time (0 = plain output)
+    struct GzipBlock *gzip;  // Compression state per block (zlib builds)
+    char fallback[4096];     // Used when the large buffer cannot be allocated
+} OutBuf;
+
+void outbuf_init(OutBuf *o, FILE *file,
+                 int compress); // Starts buffering output for 'file' (compress: gzip it)
+void outbuf_consume(OutBuf *o, size_t n); // Drops the first n bytes of a memory buffer
+void outbuf_put(OutBuf *o, const char *data, size_t n); // Appends n bytes
+void outbuf_u64(OutBuf *o, uint64_t value); // Appends a number in decimal
+int outbuf_finish(OutBuf *o); // Writes what is left and frees the buffer (0 = ok)
+static inline void outbuf_puts(OutBuf *o, const char *text) // Appends a string literal
+{
+    outbuf_put(o, text, strlen(text));
+}
+
+int save_compressed(void); // 1 if saves write gzip files (CMS_COMPRESS set, zlib built in)
+
+// Journal entries of a batch file, held in memory until the whole batch has succeeded
+typedef struct
+{
+    OutBuf entries; // Entries logged since journal_hold()
+    uint64_t seq;   // Journal sequence number before them
+    int active;     // 1 between journal_hold() and journal_release()
+} JournalHold;
+
+JournalHold journal_held;       // Entries of the batch being applied
+void journal_hold(void);        // Keeps entries logged from now on in memory
+int journal_release(int keep);  // Writes and syncs held entries, or drops them (0 = durable)
+
+// Second version of the store for server reader threads. Readers answer from the published
+// copy while the writer changes the other; publishing swaps the two and replays the changes
+// made since the last publication onto the copy readers just left, from their journal
+// entries, so both copies stay identical without copying the store again.
+typedef struct
+{
+    ContactStore spare;      // The copy that is not store_primary
+    ContactStore *published; // Copy readers use (NULL = no reader threads)
+    OutBuf log;              // Journal entries of the changes since the last publication
+    int replaying;           // 1 while the log is applied to the other copy
+} StoreVersions;
+
+StoreVersions versions; // Reader and writer copies of the store (server mode)
+
+// Rows of a contact table shown by page_rows(): row 'rank' shows the contact at
+// positions[rank], or at rank 'rank' of the sorted view or the store when positions is NULL
+typedef struct
+{
+    const uint32_t *positions; // Contact position per row (NULL = view or store order)
+    int ordered;               // Without 'positions': 1 = sorted view order, 0 = store order
+    size_t count;              // Rows
+    void (*render)(OutBuf *o, size_t rank, const Contact *c); // Formats one row
+} RowSource;
+
+void page_rows(const RowSource *rows); // Prints rows a page at a time (at once if not a TTY)
+
+FILE *result_stream = NULL; // Where "-" exports go (NULL = stdout; see cli_main())
+int export_to_vcf(const char *filename); // Exports all contacts to a VCF file ("-" = stdout)
+long import_from_vcf(const char *filename,
+                     ImportPolicy policy); // Imports contacts from a VCF file ("-" = stdin)
+static size_t vcard_complete_prefix(const char *data, size_t len); // Bytes holding whole cards
+
+// Validator registry: each pattern is compiled once and reused by validate_with_regex()
+int validate_with_regex(const char *pattern, const char *input); // 1 if input matches pattern
+int validator_registry_init(void);  // Precompiles the known patterns (0 = all compiled)
+void validator_registry_free(void); // Frees every compiled pattern
+
+// Single-pass validators equivalent to NAME_REGEX, PHONE_REGEX and EMAIL_REGEX
+int is_valid_name(const char *s, size_t len);  // 1 if s matches NAME_REGEX
+int is_valid_phone(const char *s, size_t len); // 1 if s matches PHONE_REGEX
+int is_valid_email(const char *s, size_t len); // 1 if s matches EMAIL_REGEX
+int validate_field(ContactField field, const char *s,
+                   size_t len); // Bulk-path validator (hand-written unless USE_REGEX_VALIDATORS)
+
+// Hot-path statistics, compiled in with -DCMS_STATS: calls, total and longest time of each
+// timed operation, and byte and rejection counters. Loader workers and server reader threads
+// record too, so every update is a relaxed atomic. Without CMS_STATS the hooks below are
+// empty inline functions and compile away.
+typedef enum {
+    STAT_LOAD,           // load_contacts(): snapshot or CSV, journal replay included
+    STAT_SAVE,           // save_contacts() that wrote files
+    STAT_IMPORT,         // import_from_vcf()
+    STAT_EXPORT,         // export_to_vcf()
+    STAT_SORT,           // store_sort()
+    STAT_SEARCH_INDEX,   // Exact name, phone or email lookup
+    STAT_SEARCH_PARTIAL, // Substring search
+    STAT_SEARCH_FUZZY,   // Phonetic search
+    STAT_READ,           // Mapping or reading (and inflating) a whole file
+    STAT_PARSE,          // Parsing one chunk of a CSV or VCF file, validation included
+    STAT_VALIDATE_NAME,  // validate_field() per field, in ContactField order
+    STAT_VALIDATE_PHONE, // ...
+    STAT_VALIDATE_EMAIL, // ...
+    STAT_REGEX,          // validate_with_regex() (prompts and command-line arguments)
+    STAT_WRITE,          // Writing (and compressing) one output buffer
+    STAT_SYNC,           // fsync() of a saved file or the journal
+    STAT_TIMER_COUNT     // Number of timers
+} StatTimer;
+
+typedef enum {
+    STAT_BYTES_READ,     // File bytes read by loads, imports and journal replay
+    STAT_BYTES_WRITTEN,  // Bytes written to files, the journal and result output
+    STAT_REJECTED_NAME,  // Values rejected by validate_field() per field, in ContactField order
+    STAT_REJECTED_PHONE, // ...
+    STAT_REJECTED_EMAIL, // ...
+    STAT_COUNTER_COUNT   // Number of counters
+} StatCounter;
+
+// One statistic for display: a timer (calls, total ns, max ns), a counter (value) or an
+// interactive regex pattern (calls, rejected)
+typedef struct
+{
+    const char *kind;  // "time", "count" or "regex"
+    const char *name;  // Timer or counter name, or the pattern text
+    uint64_t value[3]; // As described above; unused values are 0
+} StatRow;
+
+#define STAT_ROWS_MAX (STAT_TIMER_COUNT + STAT_COUNTER_COUNT + REGEX_REGISTRY_SIZE)
+
+#ifdef CMS_STATS
+typedef struct
+{
+    atomic_uint_fast64_t calls;    // Completed operations
+    atomic_uint_fast64_t total_ns; // Time spent in them
+    atomic_uint_fast64_t max_ns;   // Longest single one
+} StatTimerEntry;
+
+StatTimerEntry stat_timers[STAT_TIMER_COUNT];         // Per-operation timings
+atomic_uint_fast64_t stat_counters[STAT_COUNTER_COUNT]; // Byte and rejection counters
+uint64_t stats_clock(void);                      // Monotonic time in nanoseconds
+void stats_record(StatTimer timer, uint64_t ns); // Adds one timed call
+
+static inline uint64_t stats_start(void) // Starts timing an operation
+{
+    return stats_clock();
+}
+static inline void stats_stop(StatTimer timer, uint64_t started) // Records it under 'timer'
+{
+    stats_record(timer, stats_clock() - started);
+}
+static inline void stats_count(StatCounter counter, uint64_t n) // Adds n to a counter
+{
+    atomic_fetch_add_explicit(&stat_counters[counter], n, memory_order_relaxed);
+}
+#else
+static inline uint64_t stats_start(void) { return 0; }
+static inline void stats_stop(StatTimer timer, uint64_t started)
+{
+    (void) timer;
+    (void) started;
+}
+static inline void stats_count(StatCounter counter, uint64_t n)
+{
+    (void) counter;
+    (void) n;
+}
+#endif
+
+size_t stats_rows(StatRow rows[STAT_ROWS_MAX]); // Current statistics (0 without CMS_STATS)
+void stats_print(FILE *out);  // Prints the statistics as a table (menu, CMS_STATS_DUMP)
+void stats_dump_at_exit(void); // Prints them to standard error if CMS_STATS_DUMP is set
 
 // Helper function prototypes for input handling and sorting
 void get_input(const char *prompt, char *buffer, size_t size); // Reads input safely
@@ -175,21 +933,44 @@ void get_valid_input(const char *prompt, char *buffer, size_t size,
 void get_optional_valid_input(const char *prompt, char *buffer, size_t size,
                               const char *pattern); // Optional input validation (allows empty)
 
-typedef enum {
-    SORT_BY_NAME,  // Sort by contact name
-    SORT_BY_PHONE, // Sort by phone number
-    SORT_BY_EMAIL  // Sort by email address
-} SortField;
-
-void merge(Contact arr[], int left, int mid, int right,
-           SortField field); // Merges two sorted subarrays
-void merge_sort(Contact arr[], int left, int right,
-                SortField field); // Implements merge sort for contacts
-
-// Main function: program entry point
-int main(void)
+// Sort entry: a contact position with a precomputed, case-folded prefix of its first key
+typedef struct
 {
-    load_contacts(); // Load contacts from file at startup
+    uint64_t prefix; // First 8 key bytes, big-endian, so integer order is string order
+    uint32_t pos;    // Contact position (after sorting: source position for this slot)
+    uint8_t len;     // First key length; keys of up to 8 bytes are fully held in 'prefix'
+} SortKey;
+
+void merge(SortKey *keys, SortKey *scratch, size_t mid, size_t n,
+           const SortSpec *spec); // Merges two sorted runs of sort keys
+void merge_sort(SortKey *keys, SortKey *scratch, size_t n,
+                const SortSpec *spec); // Stable merge sort of sort keys
+void merge_sort_parallel(SortKey *keys, SortKey *scratch, size_t n, const SortSpec *spec,
+                         int threads); // merge_sort() split across threads
+int store_sort(const SortSpec *spec); // Sorts the store, reindexes it and keeps the order
+int sort_spec_parse(const char *text, SortSpec *spec); // Parses "domain,name" (0 = ok)
+const char *sort_key_name(SortField key); // Name of a sort key in a spec ("domain")
+static int sort_spec_valid(const SortSpec *spec); // 1 if every key of a spec is known
+int sorted_view_sync(void); // Merges contacts added since the last sync into the view (0 = ok)
+int sorted_view_restore(const SortSpec *spec); // Keeps 'spec' without moving records (0 = ok)
+static void sorted_view_erase(uint32_t pos);      // Drops a settled position from the view
+static void sorted_view_insert(uint32_t pos);     // Re-inserts a settled position after a change
+static void sorted_view_renumber(const uint32_t *map); // Renumbers the view after a purge
+static void sorted_view_free(SortedView *v);      // Releases the view and deactivates it
+static int sort_spec_uses(const SortSpec *spec, ContactField field); // 1 if a key reads field
+
+int cli_main(int argc, char *argv[]); // Runs one command-line verb or batch; returns exit code
+
+// Main function: program entry point. Build with -DCMS_NO_MAIN to include this file in
+// another program, e.g. contact-bench.c.
+#ifndef CMS_NO_MAIN
+int main(int argc, char *argv[])
+{
+    validator_registry_init(); // Compile validation regexes once
+    if (argc > 1)
+        return cli_main(argc - 1, argv + 1); // Non-interactive: no menu, no prompts
+
+    load_contacts();           // Load contacts from file at startup (starts the journal)
     int choice;
 
     printf("📱 Contact Management System Started 📱\n"); // Welcome message
@@ -220,869 +1001,7295 @@ int main(void)
                 sort_contacts(); // Sort contacts
                 break;
             case 7:
-                export_to_vcf("contacts.vcf"); // Export Contacts
+            {
+                char path[MAX_PATH_LENGTH]; // Buffer for the file to export to
+                get_input("Enter VCF file to export to (Enter for " VCF_EXPORT_PATH
+                          ", - for standard output): ",
+                          path, sizeof(path));
+                export_to_vcf(path[0] ? path : VCF_EXPORT_PATH); // Export Contacts
                 break;
+            }
             case 8:
-                import_from_vcf("Contacts1.vcf"); // Import contacts
+            {
+                char path[MAX_PATH_LENGTH]; // Buffer for the file to import
+                get_input("Enter VCF file to import (Enter for " VCF_IMPORT_PATH
+                          ", - for standard input): ",
+                          path, sizeof(path));
+                char policy[4]; // Duplicate policy choice
+                get_optional_valid_input("Duplicates: 1. Skip  2. Overwrite  3. Keep newest (REV)"
+                                         "  4. Merge (keep name) [Enter = 1]: ",
+                                         policy, sizeof(policy), IMPORT_POLICY_REGEX);
+                import_from_vcf(path[0] ? path : VCF_IMPORT_PATH,
+                                policy[0] ? (ImportPolicy) (policy[0] - '1')
+                                          : IMPORT_SKIP); // Import contacts
                 break;
+            }
             case 9:
                 printf("Exiting the program. Goodbye!\n"); // Exit message
                 break;
+            case 10:
+                stats_print(stdout); // Show timings and counters
+                break;
             default:
                 printf("Invalid choice. Please try again.\n"); // Handle invalid choice
         }
+        journal_commit(); // Make this action's changes durable
     }
     while (choice != 9); // Continue until user chooses to exit
-    save_contacts(); // Save contacts to file before exiting
+    save_contacts();           // Save contacts to file before exiting
+    journal_close();           // Stop journaling
+    store_free();              // Release contact storage
+    stats_dump_at_exit();      // Print statistics if CMS_STATS_DUMP asks for them
+    validator_registry_free(); // Release compiled regexes
 }
+#endif
 
-// Function to import contacts from VCF file
-void import_from_vcf(const char *filename)
+// Byte source for an import: a plain or gzip-compressed VCF stream, told apart by the
+// gzip magic bytes. Reads go through the FILE, so standard input keeps the bytes stdio has
+// already buffered after the prompt.
+typedef struct
 {
-    FILE *file = fopen(filename, "r"); // Open VCF file in read mode
-    if (!file)
+    FILE *fp;              // Underlying stream
+    int gzip;              // 1 if the stream is gzip-compressed
+    int eof;               // 1 once every byte has been returned
+    int error;             // 1 if reading or decompression failed
+    unsigned char head[2]; // Bytes read to detect the format
+    size_t head_len;       // Of 'head', not yet returned (plain streams)
+#ifdef HAVE_ZLIB
+    z_stream zs;               // Inflate state (gzip streams)
+    int input_eof;             // 1 once the compressed input is exhausted
+    unsigned char in[1 << 16]; // Compressed input
+#endif
+} VcfInput;
+
+// Starts reading 'fp'. Returns 0, or -1 if it is compressed and cannot be read.
+static int vcf_input_open(VcfInput *in, FILE *fp)
+{
+    memset(in, 0, sizeof(*in));
+    in->fp = fp;
+    in->head_len = fread(in->head, 1, sizeof(in->head), fp);
+    stats_count(STAT_BYTES_READ, in->head_len);
+    in->gzip = is_gzip((const char *) in->head, in->head_len);
+    if (!in->gzip)
+        return 0;
+#ifdef HAVE_ZLIB
+    if (inflateInit2(&in->zs, 15 + 16) != Z_OK) // 15 + 16: largest window, gzip wrapper
+        return -1;
+    memcpy(in->in, in->head, in->head_len);
+    in->zs.next_in = in->in;
+    in->zs.avail_in = (uInt) in->head_len;
+    in->head_len = 0;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+// Reads up to n bytes of (decompressed) input; returns 0 only at the end or on error
+static size_t vcf_input_read(VcfInput *in, char *out, size_t n)
+{
+    size_t done = 0;
+    if (!in->gzip)
     {
-        printf("❌ Could not open %s for reading.\n", filename);
-        return;
+        while (in->head_len && done < n)
+        {
+            out[done++] = (char) in->head[0];
+            in->head[0] = in->head[1];
+            in->head_len--;
+        }
+        size_t got = fread(out + done, 1, n - done, in->fp);
+        stats_count(STAT_BYTES_READ, got);
+        done += got;
+        in->error = ferror(in->fp) != 0;
+        in->eof = done == 0 || feof(in->fp) || in->error;
+        return done;
     }
 
-    char line[512]; // Buffer to store each line from file
-    char name[MAX_NAME_LENGTH] = "";
-    char phone[MAX_PHONE_LENGTH] = "";
-    char email[MAX_EMAIL_LENGTH] = "";
-
-    while (fgets(line, sizeof(line), file)) // Read file line by line
+#ifdef HAVE_ZLIB
+    if (n > (1u << 30))
+        n = 1u << 30; // zlib counts in uInt
+    while (done == 0 && !in->eof && !in->error)
     {
-        // Remove newline characters (\r or \n) at the end of the line
-        line[strcspn(line, "\r\n")] = 0;
-
-        if (strncmp(line, "FN:", 3) == 0) // Full name line found
+        if (in->zs.avail_in == 0 && !in->input_eof)
         {
-            strncpy(name, line + 3, MAX_NAME_LENGTH - 1); // Copy after "FN:"
-            name[MAX_NAME_LENGTH - 1] = '\0';             // Ensure null termination
+            in->zs.next_in = in->in;
+            in->zs.avail_in = (uInt) fread(in->in, 1, sizeof(in->in), in->fp);
+            stats_count(STAT_BYTES_READ, in->zs.avail_in);
+            in->input_eof = in->zs.avail_in == 0;
+            in->error = ferror(in->fp) != 0;
         }
-        else if (strncmp(line, "TEL", 3) == 0) // Phone line found
+        in->zs.next_out = (Bytef *) out;
+        in->zs.avail_out = (uInt) n;
+        int ret = inflate(&in->zs, Z_NO_FLUSH);
+        done = n - in->zs.avail_out;
+
+        if (ret == Z_STREAM_END) // One member done; another may follow
         {
-            char *p = strchr(line, ':'); // Find ':' to skip "TEL;TYPE=..."
-            if (p)
+            if (in->zs.avail_in == 0 && !in->input_eof)
             {
-                strncpy(phone, p + 1, MAX_PHONE_LENGTH - 1); // Copy number
-                phone[MAX_PHONE_LENGTH - 1] = '\0';
+                in->zs.next_in = in->in;
+                in->zs.avail_in = (uInt) fread(in->in, 1, sizeof(in->in), in->fp);
+                stats_count(STAT_BYTES_READ, in->zs.avail_in);
+                in->input_eof = in->zs.avail_in == 0;
             }
+            if (in->zs.avail_in == 0)
+                in->eof = 1;
+            else
+                inflateReset(&in->zs);
         }
-        else if (strncmp(line, "EMAIL", 5) == 0) // Email line found
+        else if (ret == Z_BUF_ERROR && in->input_eof)
+            in->error = 1; // Truncated
+        else if (ret != Z_OK && ret != Z_BUF_ERROR)
+            in->error = 1; // Damaged
+    }
+    if (in->error)
+        in->eof = 1;
+#endif
+    return done;
+}
+
+// Releases the inflate state
+static void vcf_input_close(VcfInput *in)
+{
+#ifdef HAVE_ZLIB
+    if (in->gzip)
+        inflateEnd(&in->zs);
+#else
+    (void) in;
+#endif
+}
+
+// Function to import contacts from VCF file
+// Streams the file (or standard input for "-") through a fixed VCF_BLOCK_SIZE buffer: each
+// block's whole cards are parsed in parallel and merged, and the partial card at its end
+// moves to the front for the next read, so memory use does not depend on the file size.
+// The buffer only grows for a single card larger than a block. Cards that duplicate a
+// contact are resolved by 'policy' (see batch_merge_dedup()). Gzipped files are inflated
+// on the fly.
+// Returns the number of contacts inserted or updated, or -1 if the file cannot be read or
+// memory ran out (what was merged before is kept)
+long import_from_vcf(const char *filename, ImportPolicy policy)
+{
+    uint64_t started = stats_start();
+    int from_stdin = strcmp(filename, "-") == 0;
+    FILE *fp = from_stdin ? stdin : fopen(filename, "rb"); // Open VCF file for reading
+    if (!fp)
+    {
+        printf("❌ Could not open %s for reading.\n", filename);
+        return -1;
+    }
+
+    VcfInput in;
+    size_t capacity = VCF_BLOCK_SIZE, len = 0;
+    char *buf = malloc(capacity);
+    if (!buf || vcf_input_open(&in, fp) != 0)
+    {
+        if (!buf)
+            printf("❌ Out of memory: cannot allocate the import buffer.\n");
+        else
+#ifdef HAVE_ZLIB
+            printf("❌ Out of memory: cannot decompress %s.\n", filename);
+#else
+            printf("❌ %s is compressed; rebuild with -DHAVE_ZLIB to import it.\n", filename);
+#endif
+        free(buf);
+        if (!from_stdin)
+            fclose(fp);
+        stats_stop(STAT_IMPORT, started);
+        return -1;
+    }
+
+    ImportDedup dedup = {.policy = policy};
+    size_t skipped = 0;
+    int eof = 0, failed = 0;
+    while (!eof && !failed)
+    {
+        len += vcf_input_read(&in, buf + len, capacity - len);
+        eof = in.eof;
+
+        size_t whole = eof ? len : vcard_complete_prefix(buf, len);
+        if (whole == 0 && len == capacity)
         {
-            char *p = strchr(line, ':'); // Find ':' to skip "EMAIL;TYPE=..."
-            if (p)
+            char *grown = capacity <= SIZE_MAX / 2 ? realloc(buf, capacity * 2) : NULL;
+            if (!grown)
             {
-                strncpy(email, p + 1, MAX_EMAIL_LENGTH - 1); // Copy email
-                email[MAX_EMAIL_LENGTH - 1] = '\0';
+                printf("❌ Out of memory: a vCard is larger than %zu bytes.\n", capacity);
+                failed = 1;
+                break;
             }
+            buf = grown;
+            capacity *= 2;
+            continue;
         }
-        else if (strncmp(line, "END:VCARD", 9) == 0) // End of one contact
-        {
-            if (contact_count < MAX_CONTACTS) // Store contact if not full
-            {
-                strncpy(contacts[contact_count].name, name, MAX_NAME_LENGTH);
-                strncpy(contacts[contact_count].phone, phone, MAX_PHONE_LENGTH);
-                strncpy(contacts[contact_count].email, email, MAX_EMAIL_LENGTH);
-                contact_count++; // Increase total contact count
-            }
 
-            // Reset for next contact
-            name[0] = '\0';
-            phone[0] = '\0';
-            email[0] = '\0';
-        }
+        // Card-aligned chunks are parsed and validated in parallel, then merged in file order
+        size_t rejected = 0;
+        if (whole && load_parallel(buf, whole, LOAD_MIN_CHUNK, next_card, parse_vcard_chunk,
+                                   &rejected, &dedup) < 0)
+            failed = 1; // Out of memory; what was merged is kept
+        skipped += rejected;
+        memmove(buf, buf + whole, len - whole);
+        len -= whole;
     }
-
-    fclose(file); // Close VCF file after reading
-    printf("✅ Imported %d contacts from %s\n", contact_count, filename);
+    if (in.error)
+        printf("⚠️ Error while reading %s; imported what was read.\n", filename);
+    vcf_input_close(&in);
+    free(buf);
+    free(dedup.revs);
+    if (!from_stdin)
+        fclose(fp);
+
+    printf("✅ Imported from %s: %zu inserted, %zu updated, %zu skipped as duplicates\n",
+           from_stdin ? "standard input" : filename, dedup.inserted, dedup.updated,
+           dedup.skipped);
+    if (skipped)
+        printf("⚠️ Skipped %zu invalid contact(s).\n", skipped);
+    stats_stop(STAT_IMPORT, started);
+    return failed ? -1 : (long) (dedup.inserted + dedup.updated);
 }
 
 // Export all contacts to a VCF (vCard) file with proper types
-void export_to_vcf(const char *filename)
+// Cards are assembled in an OutBuf from the stored field lengths, so there is no per-field
+// formatting or strlen(); "-" writes to standard output, a name ending in ".gz" is gzipped.
+// Returns 0 on success, -1 if the file cannot be written
+int export_to_vcf(const char *filename)
 {
-    FILE *fp = fopen(filename, "w"); // Open VCF file in write mode
+    uint64_t started = stats_start();
+    store_purge(); // Cards are written straight from the records
+    int to_stdout = strcmp(filename, "-") == 0;
+    size_t name_len = strlen(filename);
+    int compress = name_len > 3 && strcmp(filename + name_len - 3, ".gz") == 0;
+#ifndef HAVE_ZLIB
+    if (compress)
+        printf("⚠️ Built without zlib; %s is written uncompressed.\n", filename);
+#endif
+    FILE *fp = to_stdout ? (result_stream ? result_stream : stdout)
+                         : fopen(filename, compress ? "wb" : "w"); // Open VCF file
     if (!fp)
     {
         printf("❌ Error: Could not open %s for writing.\n", filename);
-        return;
+        stats_stop(STAT_EXPORT, started);
+        return -1;
     }
 
+    OutBuf out;
+    outbuf_init(&out, fp, compress);
     // Loop through all saved contacts and write them in vCard format
-    for (int i = 0; i < contact_count; i++)
+    for (size_t i = 0; i < cur_store()->count; i++)
     {
-        fprintf(fp, "BEGIN:VCARD\n");
-        fprintf(fp, "VERSION:3.0\n");
-
-        fprintf(fp, "FN:%s\n", contacts[i].name); // Write Full Name
+        const Contact *c = &cur_store()->items[i];
+        outbuf_puts(&out, "BEGIN:VCARD\nVERSION:3.0\nFN:");
+        outbuf_put(&out, contact_name(c), c->len[FIELD_NAME]); // Write Full Name
+        outbuf_puts(&out, "\n");
 
         // Phone is always exported as "Mobile"
-        if (strlen(contacts[i].phone) > 0)
-            fprintf(fp, "TEL;TYPE=CELL:%s\n", contacts[i].phone);
+        if (c->len[FIELD_PHONE] > 0)
+        {
+            outbuf_puts(&out, "TEL;TYPE=CELL:");
+            outbuf_put(&out, contact_phone(c), c->len[FIELD_PHONE]);
+            outbuf_puts(&out, "\n");
+        }
 
         // Email is always exported as "Work"
-        if (strlen(contacts[i].email) > 0)
-            fprintf(fp, "EMAIL;TYPE=WORK:%s\n", contacts[i].email);
+        if (c->len[FIELD_EMAIL] > 0)
+        {
+            outbuf_puts(&out, "EMAIL;TYPE=WORK:");
+            outbuf_put(&out, contact_email(c), c->len[FIELD_EMAIL]);
+            outbuf_puts(&out, "\n");
+        }
 
-        fprintf(fp, "END:VCARD\n\n"); // End of one vCard
+        outbuf_puts(&out, "END:VCARD\n\n"); // End of one vCard
     }
 
-    fclose(fp); // Close VCF file after writing
-    printf("✅ Contacts exported successfully to %s\n", filename);
+    int failed = outbuf_finish(&out) != 0;
+    if (!to_stdout)
+        failed = fclose(fp) != 0 || failed; // Close VCF file after writing
+    if (failed)
+        printf("❌ Error: Could not write all contacts to %s.\n", filename);
+    else
+        printf("✅ Contacts exported successfully to %s\n",
+               to_stdout ? "standard output" : filename);
+    stats_stop(STAT_EXPORT, started);
+    return failed ? -1 : 0;
 }
 
-// ----------------- Sanitization helpers -----------------
+// ----------------- Buffered output -----------------
 
-// Trims leading and trailing whitespace from a string in-place
-static void trim_whitespace(char *s)
+// One block of compressed output: 'in' deflated into a standalone gzip member in 'out'
+struct GzipBlock
 {
-    if (!s)
-        return; // Check for NULL pointer
-
-    // Skip leading whitespace
-    char *start = s;
-    while (*start && isspace((unsigned char) *start))
-        start++;
-
-    // Shift string left to remove leading whitespace
-    if (start != s)
-        memmove(s, start, strlen(start) + 1);
+    const char *in;     // Uncompressed bytes (a slice of the OutBuf)
+    size_t in_len;      // Bytes in 'in'
+    unsigned char *out; // Compressed member, reused across flushes
+    size_t out_len;     // Bytes in 'out'
+    size_t out_cap;     // Bytes allocated in 'out'
+    int failed;         // 1 if compression failed
+};
+
+// 1 if saves write contacts.txt and the snapshot gzip-compressed: CMS_COMPRESS is set to a
+// non-zero value and the program was built with zlib. Loading detects either form.
+int save_compressed(void)
+{
+#ifdef HAVE_ZLIB
+    const char *env = getenv("CMS_COMPRESS");
+    return env && atoi(env) != 0;
+#else
+    return 0;
+#endif
+}
 
-    // Trim trailing whitespace
-    size_t len = strlen(s);
-    while (len > 0 && isspace((unsigned char) s[len - 1]))
+// Starts buffering output for 'file' in an OUTBUF_SIZE buffer (a small built-in one if
+// that cannot be allocated, which only costs more writes). With 'compress', the buffer holds
+// one block per worker thread; without zlib, or if that much memory is not available,
+// output is written uncompressed, which every loader also reads.
+void outbuf_init(OutBuf *o, FILE *file, int compress)
+{
+    o->file = file;
+    o->len = 0;
+    o->failed = 0;
+    o->blocks = 0;
+    o->gzip = NULL;
+#ifdef HAVE_ZLIB
+    if (compress)
     {
-        s[--len] = '\0';
+        int blocks = worker_count();
+        o->data = malloc((size_t) blocks * OUTBUF_SIZE);
+        o->gzip = calloc((size_t) blocks, sizeof(struct GzipBlock));
+        if (o->data && o->gzip)
+        {
+            o->blocks = blocks;
+            o->capacity = (size_t) blocks * OUTBUF_SIZE;
+            return;
+        }
+        free(o->data);
+        free(o->gzip);
+        o->gzip = NULL;
+    }
+#else
+    (void) compress;
+#endif
+    o->data = file ? malloc(OUTBUF_SIZE) : NULL; // Memory buffers start small and grow
+    o->capacity = OUTBUF_SIZE;
+    if (!o->data)
+    {
+        o->data = o->fallback;
+        o->capacity = sizeof(o->fallback);
     }
 }
 
-// Replaces commas with spaces to ensure CSV compatibility
-static void replace_commas(char *s)
+#ifdef HAVE_ZLIB
+// Deflates one block into a gzip member
+static void gzip_block(struct GzipBlock *g)
 {
-    if (!s)
-        return; // Check for NULL pointer
-    for (; *s; ++s)
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    g->failed = 1;
+    if (deflateInit2(&zs, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return; // 15 + 16: largest window, gzip wrapper
+
+    size_t bound = deflateBound(&zs, (uLong) g->in_len);
+    if (bound > g->out_cap)
     {
-        if (*s == ',')
-            *s = ' '; // Replace comma with space
+        unsigned char *out = realloc(g->out, bound);
+        if (!out)
+        {
+            deflateEnd(&zs);
+            return;
+        }
+        g->out = out;
+        g->out_cap = bound;
     }
+    zs.next_in = (Bytef *) g->in;
+    zs.avail_in = (uInt) g->in_len;
+    zs.next_out = g->out;
+    zs.avail_out = (uInt) bound;
+    g->failed = deflate(&zs, Z_FINISH) != Z_STREAM_END;
+    g->out_len = zs.total_out;
+    deflateEnd(&zs);
 }
 
-// Sanitizes a contact by trimming whitespace and removing commas
-static void sanitize_contact(Contact *c)
+#ifndef _WIN32
+// Thread entry point: compresses one block
+static void *gzip_worker(void *arg)
 {
-    if (!c)
-        return;                // Check for NULL pointer
-    trim_whitespace(c->name);  // Trim name
-    trim_whitespace(c->phone); // Trim phone
-    trim_whitespace(c->email); // Trim email
-    replace_commas(c->name);   // Remove commas from name
-    replace_commas(c->phone);  // Remove commas from phone
-    replace_commas(c->email);  // Remove commas from email
+    gzip_block(arg);
+    return NULL;
 }
+#endif
 
-// ----------------- Regex util -----------------
-
-// Validates input against a regex pattern
-int validate_with_regex(const char *pattern, const char *input)
+// Compresses the buffered blocks in parallel and writes the members in order
+static void outbuf_flush_gzip(OutBuf *o)
 {
-    regex_t regex; // Regex object
-    int result;
-
-    // Compile the regex pattern
-    result = regcomp(&regex, pattern, REG_EXTENDED | REG_NOSUB);
-    if (result)
+    int n = (int) ((o->len + OUTBUF_SIZE - 1) / OUTBUF_SIZE);
+    for (int t = 0; t < n; t++)
     {
-        printf("Could not compile regex.\n"); // Handle compilation failure
-        return 0;
+        o->gzip[t].in = o->data + (size_t) t * OUTBUF_SIZE;
+        o->gzip[t].in_len = t == n - 1 ? o->len - (size_t) t * OUTBUF_SIZE : OUTBUF_SIZE;
     }
 
-    // Execute regex against input
-    result = regexec(&regex, input, 0, NULL, 0);
-    regfree(&regex);    // Free regex resources
-    return result == 0; // Return 1 if match, 0 if no match
+#ifndef _WIN32
+    pthread_t tids[MAX_WORKER_THREADS];
+    int started[MAX_WORKER_THREADS] = {0};
+    for (int t = 1; t < n; t++)
+        started[t] = pthread_create(&tids[t], NULL, gzip_worker, &o->gzip[t]) == 0;
+    gzip_block(&o->gzip[0]); // The calling thread takes the first block
+    for (int t = 1; t < n; t++)
+    {
+        if (started[t])
+            pthread_join(tids[t], NULL);
+        else
+            gzip_block(&o->gzip[t]); // Could not start a thread: compress inline
+    }
+#else
+    for (int t = 0; t < n; t++)
+        gzip_block(&o->gzip[t]);
+#endif
+
+    for (int t = 0; t < n && !o->failed; t++)
+        if (o->gzip[t].failed ||
+            fwrite(o->gzip[t].out, 1, o->gzip[t].out_len, o->file) != o->gzip[t].out_len)
+            o->failed = 1;
+        else
+            stats_count(STAT_BYTES_WRITTEN, o->gzip[t].out_len);
 }
+#endif
 
-// ----------------- File save/load -----------------
-
-// Saves contacts to a file
-void save_contacts()
+// Writes the buffered bytes in one call (or one gzip member per block); a memory buffer
+// doubles instead, and stops taking bytes if it cannot
+static void outbuf_flush(OutBuf *o)
 {
-    const char *path = "contacts.txt"; // Output file path
-    const char *tmpp = "contacts.tmp"; // Temporary file path
-    FILE *file = fopen(tmpp, "w");     // Open temp file for writing
-    if (!file)
+    if (!o->file)
     {
-        printf("❌ Error opening temp file.\n"); // Handle file open failure
+        char *data = o->data == o->fallback ? malloc(o->capacity * 2)
+                                            : realloc(o->data, o->capacity * 2);
+        if (!data)
+        {
+            o->failed = 1;
+            o->len = 0;
+            return;
+        }
+        if (o->data == o->fallback)
+            memcpy(data, o->fallback, o->len);
+        o->data = data;
+        o->capacity *= 2;
         return;
     }
-
-    for (int i = 0; i < contact_count; i++)
+    if (o->len && !o->failed)
     {
-        // Sanitize contact before saving
-        sanitize_contact(&contacts[i]);
-        // Write contact to file in CSV format
-        fprintf(file, "%s, %s, %s\n", contacts[i].name, contacts[i].phone, contacts[i].email);
+        uint64_t started = stats_start();
+#ifdef HAVE_ZLIB
+        if (o->blocks)
+            outbuf_flush_gzip(o);
+        else
+#endif
+            if (fwrite(o->data, 1, o->len, o->file) != o->len)
+            o->failed = 1;
+        else
+            stats_count(STAT_BYTES_WRITTEN, o->len);
+        stats_stop(STAT_WRITE, started);
     }
-    fclose(file); // Close the temp file
+    o->len = 0;
+}
 
-    // Replace original file with temp file
-    if (remove(path) != 0)
-    { /* ignore if not exists */
-    }
-    if (rename(tmpp, path) != 0)
-    {
-        printf("❌ Error finalizing save.\n"); // Handle rename failure
-    }
-    else
+// Appends n bytes, writing the buffer out whenever it fills
+void outbuf_put(OutBuf *o, const char *data, size_t n)
+{
+    while (n)
     {
-        printf("✅ Contacts saved successfully to file!\n"); // Success message
+        if (o->len == o->capacity)
+            outbuf_flush(o);
+        size_t k = o->capacity - o->len < n ? o->capacity - o->len : n;
+        memcpy(o->data + o->len, data, k);
+        o->len += k;
+        data += k;
+        n -= k;
     }
 }
 
-//---------------------- Load contacts------------------------
-// Loads contacts from a file
-void load_contacts(void)
+// Appends 'value' in decimal, without padding
+void outbuf_u64(OutBuf *o, uint64_t value)
 {
-    FILE *file = fopen("contacts.txt", "r"); // Open file for reading
-    if (file == NULL)
+    char digits[20];
+    size_t n = sizeof(digits);
+    do
     {
-        printf("📂 No contacts file found. Starting fresh.\n"); // Handle missing file
-        return;
+        digits[--n] = (char) ('0' + value % 10);
+        value /= 10;
     }
+    while (value);
+    outbuf_put(o, digits + n, sizeof(digits) - n);
+}
 
-    contact_count = 0; // Reset contact count
+// Writes the rest of the buffer and releases it; the file stays open
+// Returns 0 if every byte was written (or, in memory, kept), -1 otherwise
+int outbuf_finish(OutBuf *o)
+{
+    if (o->file)
+        outbuf_flush(o);
+    for (int t = 0; t < o->blocks; t++)
+        free(o->gzip[t].out);
+    free(o->gzip);
+    if (o->data != o->fallback)
+        free(o->data);
+    o->data = NULL;
+    o->gzip = NULL;
+    o->capacity = 0;
+    return o->failed || (o->file && fflush(o->file) != 0) ? -1 : 0;
+}
 
-    char line[512]; // Buffer for reading lines
-    while (fgets(line, sizeof(line), file) != NULL && contact_count < MAX_CONTACTS)
-    {
-        // Remove trailing newline
-        line[strcspn(line, "\n")] = '\0';
+// Drops the first n bytes of a memory buffer once they have been sent
+void outbuf_consume(OutBuf *o, size_t n)
+{
+    memmove(o->data, o->data + n, o->len - n);
+    o->len -= n;
+}
 
-        // Build the sscanf format string dynamically so it always matches the macros
-        char fmt[96];
-        snprintf(fmt, sizeof(fmt), "%%%d[^,], %%%d[^,], %%%d[^\n]", MAX_NAME_LENGTH - 1,
-                 MAX_PHONE_LENGTH - 1, MAX_EMAIL_LENGTH - 1);
+// ----------------- Contact store -----------------
 
-        int result = sscanf(line, fmt, contacts[contact_count].name, contacts[contact_count].phone,
-                            contacts[contact_count].email);
+// 1 if 'p' points into the loaded snapshot rather than a heap block
+static int in_snapshot(const void *p)
+{
+    const char *c = p;
+    return store_snapshot.data && c >= store_snapshot.data &&
+           c < store_snapshot.data + store_snapshot.size;
+}
 
-        if (result != 3)
-        {
-            printf("Warning: Skipping malformed line in contacts.txt: '%s'\n",
-                   line); // Handle malformed line
-            continue;
-        }
+// realloc() that also accepts blocks inside the snapshot: those are copied to the heap
+static void *block_realloc(void *p, size_t old_bytes, size_t bytes)
+{
+    if (!in_snapshot(p))
+        return realloc(p, bytes);
 
-        // Sanitize loaded contact
-        sanitize_contact(&contacts[contact_count]);
+    void *copy = malloc(bytes);
+    if (copy)
+        memcpy(copy, p, old_bytes < bytes ? old_bytes : bytes);
+    return copy;
+}
 
-        // Validate loaded data
-        if (!validate_with_regex(NAME_REGEX, contacts[contact_count].name) ||
-            !validate_with_regex(PHONE_REGEX, contacts[contact_count].phone) ||
-            !validate_with_regex(EMAIL_REGEX, contacts[contact_count].email))
-        {
-            printf("Warning: Invalid data in line, skipping: '%s'\n", line); // Skip invalid contact
-            continue;                                                        // Skip invalid contact
-        }
+// free() that leaves blocks inside the snapshot alone (they go away with the mapping)
+static void block_free(void *p)
+{
+    if (!in_snapshot(p))
+        free(p);
+}
 
-        contact_count++;
+// Grows the store so it can hold at least 'capacity' contacts
+// Returns 0 on success, -1 if memory could not be allocated (store left unchanged)
+int store_reserve(size_t capacity)
+{
+    if (capacity <= cur_store()->capacity)
+        return 0; // Already large enough
 
-        if (contact_count >= MAX_CONTACTS)
-        {
-            printf(
-                "⚠️ Reached maximum contact limit while loading from file.\n"); // Handle max limit
-            break;
-        }
+    if (capacity > SIZE_MAX / sizeof(Contact))
+    {
+        printf("❌ Out of memory: cannot hold %zu contacts.\n", capacity); // Size overflow
+        return -1;
     }
 
-    fclose(file);                                                  // Close the file
-    printf("📁 %i contact(s) loaded from file.\n", contact_count); // Report loaded contacts
-}
-
+    Contact *items = block_realloc(cur_store()->items, cur_store()->capacity * sizeof(Contact),
+                                   capacity * sizeof(Contact));
+    if (!items)
+    {
+        printf("❌ Out of memory: cannot hold %zu contacts.\n", capacity); // Allocation failure
+        return -1;
+    }
+
+    cur_store()->items = items;
+    cur_store()->capacity = capacity;
+    return 0;
+}
+
+// Grows an arena so 'bytes' more bytes can be bump-allocated without reallocating
+// Returns 0 on success, -1 if memory could not be allocated (arena left unchanged)
+int arena_reserve(StringArena *a, size_t bytes)
+{
+    if (a->capacity - a->used >= bytes && a->data)
+        return 0; // Already large enough
+
+    // Offsets are 32-bit, so the arena can never exceed UINT32_MAX bytes
+    if (bytes > UINT32_MAX - a->used)
+    {
+        printf("❌ Out of memory: string arena limit reached.\n");
+        return -1;
+    }
+
+    size_t needed = a->used + bytes + (a->data ? 0 : 1);
+    size_t capacity = a->capacity ? a->capacity : ARENA_INITIAL_CAPACITY;
+    while (capacity < needed)
+        capacity *= 2; // Amortized doubling
+    if (capacity > UINT32_MAX)
+        capacity = UINT32_MAX;
+
+    char *data = block_realloc(a->data, a->used, capacity);
+    if (!data)
+    {
+        printf("❌ Out of memory: cannot grow string arena to %zu bytes.\n", capacity);
+        return -1;
+    }
+
+    if (!a->data)
+    {
+        data[0] = '\0'; // Offset 0 is the shared empty string used by blank fields
+        a->used = 1;
+    }
+    a->data = data;
+    a->capacity = capacity;
+    return 0;
+}
+
+// Grows the store's string arena (see arena_reserve)
+int store_reserve_arena(size_t bytes)
+{
+    return arena_reserve(&cur_store()->arena, bytes);
+}
+
+// Bump-allocates a copy of the first 'n' bytes of 'value' in an arena
+// Returns 0 and fills 'off'/'len' on success, -1 on out-of-memory
+static int arena_store(StringArena *a, const char *value, size_t n, uint32_t *off, uint8_t *len)
+{
+    if (n == 0)
+    {
+        *off = 0; // Share the arena's empty string
+        *len = 0;
+        return 0;
+    }
+
+    if (arena_reserve(a, n + 1) != 0)
+        return -1;
+
+    memcpy(a->data + a->used, value, n);
+    a->data[a->used + n] = '\0';
+    *off = (uint32_t) a->used;
+    *len = (uint8_t) n;
+    a->used += n + 1;
+    return 0;
+}
+
+// Adds the contact at 'pos' to every active index (0 = ok). Appended contacts wait at the
+// end of the sorted view until sorted_view_sync() merges them in as one batch.
+static int indexes_insert(uint32_t pos)
+{
+    for (int f = 0; f < INDEX_COUNT; f++)
+        if (cur_store()->index[f].active && index_insert(&cur_store()->index[f], pos) != 0)
+            return -1;
+    if (cur_store()->trigrams.active && trigram_insert(&cur_store()->trigrams, pos) != 0)
+        return -1;
+    if (cur_store()->columns.active && columns_insert(&cur_store()->columns, pos) != 0)
+        return -1;
+    return 0;
+}
+
+// Removes the contact at 'pos' from every active lookup index; the sorted view keeps it
+static void indexes_unlink(uint32_t pos)
+{
+    for (int f = 0; f < INDEX_COUNT; f++)
+        if (cur_store()->index[f].active)
+            index_erase(&cur_store()->index[f], pos);
+    if (cur_store()->trigrams.active)
+        trigram_erase(&cur_store()->trigrams, pos);
+}
+
+// Removes the contact at 'pos' from every active index and the sorted view
+static void indexes_erase(uint32_t pos)
+{
+    indexes_unlink(pos);
+    if (cur_store()->view.active)
+        sorted_view_erase(pos);
+    if (cur_store()->columns.active)
+        columns_erase(&cur_store()->columns, pos);
+}
+
+// Moves every position in the active indexes and the view to map[position] after a purge
+static void indexes_renumber(const uint32_t *map)
+{
+    for (int f = 0; f < INDEX_COUNT; f++)
+        if (cur_store()->index[f].active)
+            index_renumber(&cur_store()->index[f], map);
+    if (cur_store()->trigrams.active)
+        trigram_renumber(&cur_store()->trigrams, map);
+    if (cur_store()->columns.active)
+        columns_renumber(&cur_store()->columns, map);
+    if (cur_store()->view.active)
+        sorted_view_renumber(map);
+}
+
+// Rebuilds every active index after contacts were reordered
+static void indexes_rebuild(void)
+{
+    for (int f = 0; f < INDEX_COUNT; f++)
+        if (cur_store()->index[f].active)
+            index_rebuild(&cur_store()->index[f]);
+    if (cur_store()->trigrams.active && trigram_rebuild(&cur_store()->trigrams) != 0)
+        trigram_free(&cur_store()->trigrams); // Rebuilt on the next partial search
+    if (cur_store()->columns.active && columns_rebuild(&cur_store()->columns) != 0)
+        columns_free(&cur_store()->columns); // Rebuilt on the next partial search
+}
+
+// Appends a new empty contact slot, doubling capacity when full
+// Returns NULL if the store could not grow
+Contact *store_append(void)
+{
+    if (cur_store()->count == cur_store()->capacity)
+    {
+        size_t grown = cur_store()->capacity ? cur_store()->capacity * 2 : STORE_INITIAL_CAPACITY;
+        if (store_reserve(grown) != 0)
+            return NULL;
+    }
+
+    Contact *c = &cur_store()->items[cur_store()->count++];
+    memset(c, 0, sizeof(*c)); // All fields point at the empty string
+    return c;
+}
+
+// Appends a contact with the given fields, copying the strings into the arena,
+// sanitizing them in place and indexing the result
+// Returns NULL (and leaves the store unchanged) on out-of-memory
+Contact *store_add(const char *name, const char *phone, const char *email)
+{
+    return store_add_slices(name, strnlen(name, MAX_NAME_LENGTH - 1), phone,
+                            strnlen(phone, MAX_PHONE_LENGTH - 1), email,
+                            strnlen(email, MAX_EMAIL_LENGTH - 1));
+}
+
+// Same as store_add() for fields given as (pointer, length) slices, e.g. straight out of a
+// mapped file; lengths beyond the field limits are truncated
+Contact *store_add_slices(const char *name, size_t name_len, const char *phone,
+                          size_t phone_len, const char *email, size_t email_len)
+{
+    ContactStore *s = cur_store();
+    size_t mark = s->arena.used;
+    Contact *c = store_append();
+    if (!c)
+        return NULL;
+
+    if (name_len > MAX_NAME_LENGTH - 1)
+        name_len = MAX_NAME_LENGTH - 1;
+    if (phone_len > MAX_PHONE_LENGTH - 1)
+        phone_len = MAX_PHONE_LENGTH - 1;
+    if (email_len > MAX_EMAIL_LENGTH - 1)
+        email_len = MAX_EMAIL_LENGTH - 1;
+
+    if (arena_store(&s->arena, name, name_len, &c->off[FIELD_NAME], &c->len[FIELD_NAME]) != 0 ||
+        arena_store(&s->arena, phone, phone_len, &c->off[FIELD_PHONE], &c->len[FIELD_PHONE]) != 0 ||
+        arena_store(&s->arena, email, email_len, &c->off[FIELD_EMAIL], &c->len[FIELD_EMAIL]) != 0)
+    {
+        store_rollback(mark);
+        return NULL;
+    }
+
+    sanitize_contact(s->arena.data, c);
+    c->id = ++s->last_id; // Not handed out again, even if the add is rolled back
+    if (indexes_insert((uint32_t) (s->count - 1)) != 0)
+    {
+        store_rollback(mark);
+        return NULL;
+    }
+    s->dirty = 1;
+    journal_add(c);
+    return c;
+}
+
+// Replaces one field (sanitized); the old bytes stay in the arena until the next compaction
+// Returns 0 on success, -1 on out-of-memory (field left unchanged)
+int store_set_field(Contact *c, ContactField field, const char *value)
+{
+    static const size_t max_len[FIELD_COUNT] = {MAX_NAME_LENGTH - 1, MAX_PHONE_LENGTH - 1,
+                                                MAX_EMAIL_LENGTH - 1};
+    uint32_t off;
+    uint8_t len;
+    if (arena_store(&cur_store()->arena, value, strnlen(value, max_len[field]), &off, &len) != 0)
+        return -1;
+
+    uint32_t pos = (uint32_t) (c - cur_store()->items);
+    int retrigram = cur_store()->trigrams.active && (TRIGRAM_FIELDS & (1u << field));
+    int reorder = cur_store()->view.active && pos < cur_store()->view.count &&
+                  sort_spec_uses(&cur_store()->view.spec, field);
+    for (int i = 0; i < INDEX_COUNT; i++)
+        if (cur_store()->index[i].active && cur_store()->index[i].field == field)
+            index_erase(&cur_store()->index[i], pos); // Unindex under the old key
+    if (retrigram)
+        trigram_erase(&cur_store()->trigrams, pos);
+    if (reorder)
+        sorted_view_erase(pos);
+
+    c->off[field] = off;
+    c->len[field] = len;
+    trim_slice(cur_store()->arena.data, c, field);
+    replace_commas_slice(cur_store()->arena.data, c, field);
+
+    for (int i = 0; i < INDEX_COUNT; i++)
+        if (cur_store()->index[i].active && cur_store()->index[i].field == field)
+            index_insert(&cur_store()->index[i], pos); // Reuses the freed bucket, cannot fail
+    if (retrigram && trigram_insert(&cur_store()->trigrams, pos) != 0)
+        trigram_free(&cur_store()->trigrams); // Drop the index; it is rebuilt on the next search
+    if (cur_store()->columns.active && columns_set(&cur_store()->columns, pos, field) != 0)
+        columns_free(&cur_store()->columns); // Likewise for the columns
+    if (reorder)
+        sorted_view_insert(pos); // Reuses the freed slot, cannot fail
+    cur_store()->dirty = 1;
+    journal_update(pos, field);
+    return 0;
+}
+
+// Removes the most recently appended contact and rewinds the arena to 'arena_mark',
+// the arena size recorded before that contact was added
+void store_rollback(size_t arena_mark)
+{
+    if (cur_store()->count == 0)
+        return;
+    indexes_erase((uint32_t) (cur_store()->count - 1));
+    cur_store()->count--;
+    if (arena_mark && arena_mark <= cur_store()->arena.used)
+        cur_store()->arena.used = arena_mark;
+}
+
+// Marks the contact at 'index' deleted and unindexes it; its slot stays (a tombstone), so
+// no other position changes
+static void store_tombstone(size_t index)
+{
+    journal_erase((uint32_t) index);
+    cur_store()->dirty = 1;
+    indexes_unlink((uint32_t) index);
+    cur_store()->items[index].flags |= CONTACT_DELETED;
+    cur_store()->deleted++;
+}
+
+// Deletes the contact at 'index' in O(1), leaving a tombstone that lookups no longer find.
+// Once tombstones pass 1/STORE_PURGE_FRACTION of the store they are purged in one batch,
+// which renumbers later positions.
+void store_remove(size_t index)
+{
+    if (index >= cur_store()->count || (cur_store()->items[index].flags & CONTACT_DELETED))
+        return; // Out of range or already deleted
+
+    store_tombstone(index);
+    if (cur_store()->deleted > cur_store()->count / STORE_PURGE_FRACTION)
+        store_purge();
+}
+
+// Deletes every contact 'match' accepts in a single pass, then purges once
+// Returns the number of contacts deleted
+size_t store_remove_matching(int (*match)(uint32_t pos, const void *arg), const void *arg)
+{
+    size_t removed = 0;
+    for (size_t i = 0; i < cur_store()->count; i++)
+    {
+        if (match((uint32_t) i, arg) && !(cur_store()->items[i].flags & CONTACT_DELETED))
+        {
+            store_tombstone(i);
+            removed++;
+        }
+    }
+    store_purge();
+    return removed;
+}
+
+// Drops the slots of deleted contacts, keeping the others in order, and renumbers the
+// indexes and the sorted view to match. Journaled, so a replay reaches the same positions.
+// Whole-store operations (save, export, listing, sort) purge first.
+void store_purge(void)
+{
+    if (cur_store()->deleted == 0)
+        return;
+
+    journal_purge();
+    uint32_t *map = malloc(cur_store()->count * sizeof(uint32_t)); // New position per old one
+    size_t n = 0;
+    for (size_t i = 0; i < cur_store()->count; i++)
+    {
+        int gone = (cur_store()->items[i].flags & CONTACT_DELETED) != 0;
+        if (map)
+            map[i] = gone ? UINT32_MAX : (uint32_t) n;
+        if (!gone)
+            cur_store()->items[n++] = cur_store()->items[i];
+    }
+    cur_store()->count = n;
+    cur_store()->deleted = 0;
+    if (map)
+        indexes_renumber(map);
+    else
+    { // Out of memory: rebuild what cannot be renumbered
+        indexes_rebuild();
+        sorted_view_free(&cur_store()->view);
+    }
+    free(map);
+}
+
+// Returns the lowest position whose name matches case-insensitively, or -1
+long store_find_name(const char *name)
+{
+    IndexCursor cur;
+    long best = -1;
+    for (long pos = index_lookup(&cur_store()->index[FIELD_NAME], name, &cur); pos >= 0;
+         pos = index_next(&cur_store()->index[FIELD_NAME], &cur))
+    {
+        if (best < 0 || pos < best)
+            best = pos;
+    }
+    return best;
+}
+
+// Returns the index for 'field', building it from the current contacts on first use
+// so startup never pays for lookups that are not used. Returns NULL on out-of-memory.
+static HashIndex *store_index_slot(int slot)
+{
+    HashIndex *ix = &cur_store()->index[slot];
+    if (!ix->active)
+    {
+        if (index_rebuild(ix) != 0)
+            return NULL;
+        ix->active = 1;
+    }
+    return ix;
+}
+
+HashIndex *store_index(ContactField field)
+{
+    return store_index_slot(field);
+}
+
+// Returns the phonetic name index (see phonetic_key()), built on first use like the
+// phone and email indexes. Returns NULL on out-of-memory.
+HashIndex *store_phonetic(void)
+{
+    return store_index_slot(INDEX_PHONETIC);
+}
+
+// Returns the ID index, built on first use like the phone and email indexes (a CSV load
+// builds it while assigning IDs). Returns NULL on out-of-memory.
+HashIndex *store_ids(void)
+{
+    return store_index_slot(INDEX_ID);
+}
+
+// Returns the position of the contact with ID 'id', or -1 (deleted contacts are not found)
+long store_find_id(uint64_t id)
+{
+    HashIndex *ix = store_ids();
+    return ix && id ? index_find_id(ix, id) : -1;
+}
+
+// Gives every contact loaded from contacts.txt a unique ID: an ID read from the file is
+// kept, and a row without one, or repeating an earlier row's, gets a new one above both
+// the highest ID in the file and the file's "#last-id". Builds the ID index on the way.
+static void store_assign_ids(void)
+{
+    for (size_t i = 0; i < cur_store()->count; i++)
+        if (cur_store()->items[i].id > cur_store()->last_id)
+            cur_store()->last_id = cur_store()->items[i].id;
+
+    HashIndex *ix = &cur_store()->index[INDEX_ID];
+    int indexed = index_reserve(ix, cur_store()->count) == 0; // Without it repeats go unnoticed
+    for (size_t i = 0; i < cur_store()->count; i++)
+    {
+        Contact *c = &cur_store()->items[i];
+        if (c->id == 0 || (indexed && index_find_id(ix, c->id) >= 0))
+            c->id = ++cur_store()->last_id;
+        if (indexed)
+            index_insert(ix, (uint32_t) i); // Reserved above, cannot fail
+    }
+    ix->active = indexed;
+}
+
+// Returns the trigram index, building it on first use. Returns NULL on out-of-memory.
+TrigramIndex *store_trigrams(void)
+{
+    TrigramIndex *tx = &cur_store()->trigrams;
+    if (!tx->active)
+    {
+        if (trigram_rebuild(tx) != 0)
+        {
+            trigram_free(tx);
+            return NULL;
+        }
+        tx->active = 1;
+    }
+    return tx;
+}
+
+// Returns the field columns, building them on first use. Returns NULL on out-of-memory.
+FieldColumns *store_columns(void)
+{
+    FieldColumns *fc = &cur_store()->columns;
+    if (!fc->active)
+    {
+        if (columns_rebuild(fc) != 0)
+        {
+            columns_free(fc);
+            return NULL;
+        }
+        fc->active = 1;
+    }
+    return fc;
+}
+
+// Returns 1 if a contact other than position 'except' has this name (case-insensitive)
+int store_name_taken(const char *name, long except)
+{
+    IndexCursor cur;
+    for (long pos = index_lookup(&cur_store()->index[FIELD_NAME], name, &cur); pos >= 0;
+         pos = index_next(&cur_store()->index[FIELD_NAME], &cur))
+    {
+        if (pos != except)
+            return 1;
+    }
+    return 0;
+}
+
+// Returns the arena bytes needed to hold only the strings 'items' reference
+static size_t arena_live_bytes(const Contact *items, size_t count)
+{
+    size_t live = 1; // Shared empty string
+    for (size_t i = 0; i < count; i++)
+        for (int f = 0; f < FIELD_COUNT; f++)
+            if (items[i].len[f])
+                live += items[i].len[f] + 1u;
+    return live;
+}
+
+// Copies the strings 'items' reference from 'from' into 'to' in record order, rewriting
+// their offsets; 'to' must hold arena_live_bytes(). Returns the bytes used.
+static size_t arena_repack(Contact *items, size_t count, const char *from, char *to)
+{
+    size_t used = 0;
+    to[used++] = '\0';
+    for (size_t i = 0; i < count; i++)
+    {
+        Contact *c = &items[i];
+        for (int f = 0; f < FIELD_COUNT; f++)
+        {
+            if (c->len[f] == 0)
+            {
+                c->off[f] = 0;
+                continue;
+            }
+            memcpy(to + used, from + c->off[f], c->len[f]);
+            to[used + c->len[f]] = '\0';
+            c->off[f] = (uint32_t) used;
+            used += c->len[f] + 1u;
+        }
+    }
+    return used;
+}
+
+// Copies the strings still referenced into a new arena in record order, 'live' bytes long
+// Leaves the arena untouched if the new buffer cannot be allocated
+static void store_repack(size_t live)
+{
+    ContactStore *s = cur_store();
+    char *data = malloc(live);
+    if (!data)
+        return; // Keep the old arena; it is still valid
+
+    size_t used = arena_repack(s->items, s->count, s->arena.data, data);
+    block_free(s->arena.data);
+    s->arena.data = data;
+    s->arena.used = used;
+    s->arena.capacity = live;
+}
+
+// Rebuilds the arena and the columns with only the strings still referenced, in record order
+void store_compact(void)
+{
+    size_t live = arena_live_bytes(cur_store()->items, cur_store()->count);
+    if (!cur_store()->arena.data || live == cur_store()->arena.used)
+        return; // Nothing to reclaim
+
+    store_repack(live);
+    if (cur_store()->columns.active && columns_rebuild(&cur_store()->columns) != 0)
+        columns_free(&cur_store()->columns); // Rebuilt on the next partial search
+}
+
+// Fills 'copy' with a private copy of the store that can be written out while the store
+// keeps changing: the records, only their live strings (compacted), the name index and the
+// sorted view. Returns 0 on success, -1 on out-of-memory ('copy' left empty)
+int store_clone(ContactStore *copy)
+{
+    const ContactStore *s = cur_store();
+    const HashIndex *ix = &s->index[FIELD_NAME];
+    memset(copy, 0, sizeof(*copy));
+    size_t live = arena_live_bytes(s->items, s->count);
+    copy->items = malloc(s->count ? s->count * sizeof(Contact) : 1);
+    copy->arena.data = malloc(live);
+    copy->index[FIELD_NAME] = *ix;
+    copy->index[FIELD_NAME].slots = malloc(ix->capacity ? ix->capacity * sizeof(uint32_t) : 1);
+    copy->index[FIELD_NAME].hashes = malloc(ix->capacity ? ix->capacity * sizeof(uint32_t) : 1);
+    copy->view = s->view;
+    copy->view.order = malloc(s->view.count ? s->view.count * sizeof(uint32_t) : 1);
+    copy->view.capacity = s->view.count;
+    if (!copy->items || !copy->arena.data || !copy->index[FIELD_NAME].slots ||
+        !copy->index[FIELD_NAME].hashes || !copy->view.order)
+    {
+        store_clone_free(copy);
+        return -1;
+    }
+
+    if (s->count)
+        memcpy(copy->items, s->items, s->count * sizeof(Contact));
+    copy->count = copy->capacity = s->count;
+    copy->last_id = s->last_id;
+    copy->arena.used = arena_repack(copy->items, copy->count, s->arena.data, copy->arena.data);
+    copy->arena.capacity = live;
+    if (ix->capacity)
+    {
+        memcpy(copy->index[FIELD_NAME].slots, ix->slots, ix->capacity * sizeof(uint32_t));
+        memcpy(copy->index[FIELD_NAME].hashes, ix->hashes, ix->capacity * sizeof(uint32_t));
+    }
+    if (s->view.count)
+        memcpy(copy->view.order, s->view.order, s->view.count * sizeof(uint32_t));
+    return 0;
+}
+
+// Releases the buffers of a store_clone() copy
+void store_clone_free(ContactStore *copy)
+{
+    free(copy->items);
+    free(copy->arena.data);
+    free(copy->index[FIELD_NAME].slots);
+    free(copy->index[FIELD_NAME].hashes);
+    free(copy->view.order);
+    memset(copy, 0, sizeof(*copy));
+}
+
+// Heap copy of the 'bytes' bytes at 'p', or NULL for an empty block. Sets '*failed' on
+// out-of-memory and copies nothing more once it is set.
+static void *block_copy(const void *p, size_t bytes, int *failed)
+{
+    if (!p || bytes == 0 || *failed)
+        return NULL;
+    void *copy = malloc(bytes);
+    if (!copy)
+    {
+        *failed = 1;
+        return NULL;
+    }
+    return memcpy(copy, p, bytes);
+}
+
+// Fills 'to' with a full copy of 'from' that can change independently: the records, the
+// arena with the same offsets, every built index, the field columns and the sorted view.
+// Blocks are sized to what is in use and grow again on demand. Returns 0, or -1 on
+// out-of-memory ('to' left empty)
+int store_duplicate(const ContactStore *from, ContactStore *to)
+{
+    int failed = 0;
+    *to = *from; // Counts, flags and index settings; every block is replaced below
+    to->items = block_copy(from->items, from->count * sizeof(Contact), &failed);
+    to->capacity = to->items ? from->count : 0;
+    to->arena.data = block_copy(from->arena.data, from->arena.used, &failed);
+    to->arena.capacity = to->arena.data ? from->arena.used : 0;
+    for (int f = 0; f < INDEX_COUNT; f++)
+    {
+        const HashIndex *ix = &from->index[f];
+        to->index[f].slots = block_copy(ix->slots, ix->capacity * sizeof(uint32_t), &failed);
+        to->index[f].hashes = block_copy(ix->hashes, ix->capacity * sizeof(uint32_t), &failed);
+    }
+
+    const TrigramIndex *tx = &from->trigrams;
+    to->trigrams.codes = block_copy(tx->codes, tx->capacity * sizeof(uint32_t), &failed);
+    to->trigrams.lists = block_copy(tx->lists, tx->capacity * sizeof(PostingList), &failed);
+    if (!to->trigrams.lists)
+        to->trigrams.capacity = 0; // Nothing for trigram_free() to walk
+    for (size_t b = 0; b < to->trigrams.capacity; b++)
+    {
+        PostingList *list = &to->trigrams.lists[b];
+        list->items = block_copy(tx->lists[b].items, list->count * sizeof(uint32_t), &failed);
+        list->capacity = list->items ? list->count : 0;
+    }
+
+    const FieldColumns *fc = &from->columns;
+    to->columns.capacity = fc->count;
+    for (int f = 0; f < FIELD_COUNT; f++)
+    {
+        to->columns.text[f].data = block_copy(fc->text[f].data, fc->text[f].used, &failed);
+        to->columns.text[f].capacity = to->columns.text[f].data ? fc->text[f].used : 0;
+        to->columns.off[f] = block_copy(fc->off[f], fc->count * sizeof(uint32_t), &failed);
+        to->columns.len[f] = block_copy(fc->len[f], fc->count, &failed);
+        if (!to->columns.off[f] || !to->columns.len[f])
+            to->columns.capacity = 0; // Grown again on the next add
+    }
+
+    to->view.order = block_copy(from->view.order, from->view.count * sizeof(uint32_t), &failed);
+    to->view.capacity = to->view.order ? from->view.count : 0;
+    if (failed)
+    {
+        store_release(to);
+        return -1;
+    }
+    return 0;
+}
+
+// Returns the memory in use per contact: record plus arena bytes (live and garbage)
+double store_bytes_per_contact(void)
+{
+    const ContactStore *s = cur_store();
+    if (s->count == 0)
+        return 0.0;
+    return (double) (s->count * sizeof(Contact) + s->arena.used) / (double) s->count;
+}
+
+// Prints the bytes-per-contact figure next to the old fixed-width record size
+void store_report_memory(void)
+{
+    if (cur_store()->count == 0)
+        return;
+    printf("📊 Storage: %.1f bytes/contact (%zu contacts, %zu arena bytes; fixed-width: %d)\n",
+           store_bytes_per_contact(), cur_store()->count, cur_store()->arena.used,
+           FIXED_RECORD_SIZE);
+}
+
+// Frees the records, strings, indexes and view of one copy of the store and empties it
+static void store_release(ContactStore *s)
+{
+    block_free(s->items);
+    block_free(s->arena.data);
+    for (int f = 0; f < INDEX_COUNT; f++)
+    {
+        index_free(&s->index[f]);
+        s->index[f].active = (f == FIELD_NAME); // Lazy indexes start unbuilt again
+    }
+    trigram_free(&s->trigrams);
+    columns_free(&s->columns);
+    sorted_view_free(&s->view);
+    s->items = NULL;
+    s->count = s->capacity = s->deleted = 0;
+    s->last_id = 0;
+    memset(&s->arena, 0, sizeof(s->arena));
+}
+
+// Frees all contacts and resets the store
+void store_free(void)
+{
+    store_release(cur_store());
+    if (store_snapshot.data)
+        unmap_file(&store_snapshot); // Nothing points into it any more
+}
+
+// ----------------- ASCII kernels -----------------
+// Case folding, case-insensitive comparison, substring search and byte replacement for
+// fields and queries. Each kernel walks 32-byte blocks with AVX2 (when the CPU has it), then
+// 16-byte blocks with SSE2 or NEON, then 8-byte words, then single bytes. Only 'A'-'Z'
+// fold, exactly like tolower() and strcasecmp() in the C locale the program runs in; every
+// other byte, UTF-8 included, only matches itself.
+
+#define ASCII_ONES 0x0101010101010101ull // 0x01 in every byte of a word
+#define ASCII_HIGH 0x8080808080808080ull // 0x80 in every byte of a word
+
+// Lowercases one byte
+static inline unsigned char ascii_fold(unsigned char ch)
+{
+    return (unsigned char) (ch | (unsigned) ((unsigned) (ch - 'A') < 26u) << 5);
+}
+
+// Lowercases the 8 bytes of a word: a byte gains 0x20 if its top bit is clear and its low
+// 7 bits are in 'A'-'Z'. The sums stay below 0x100 per byte, so nothing carries across.
+static inline uint64_t ascii_fold_word(uint64_t w)
+{
+    uint64_t low = w & ~ASCII_HIGH;
+    uint64_t from_a = low + (0x80 - 'A') * ASCII_ONES;     // Top bit set from 'A' up
+    uint64_t after_z = low + (0x80 - 'Z' - 1) * ASCII_ONES; // Top bit set past 'Z'
+    return w | ((from_a & ~after_z & ~w & ASCII_HIGH) >> 2);
+}
+
+static inline uint64_t ascii_load_word(const char *p) // Unaligned 8-byte load
+{
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+// 0x80 in each zero byte of a word, and nothing elsewhere. Adding 0x7F to the low 7 bits
+// cannot carry into the next byte, so the answer is exact for every byte.
+static inline uint64_t ascii_zero_bytes(uint64_t w)
+{
+    return ~(((w & ~ASCII_HIGH) + ~ASCII_HIGH) | w) & ASCII_HIGH;
+}
+
+// Index of the lowest set bit (m != 0)
+static inline unsigned ascii_ctz(uint64_t m)
+{
+#ifdef __GNUC__
+    return (unsigned) __builtin_ctzll(m);
+#else
+    unsigned n = 0;
+    for (; !(m & 1); m >>= 1)
+        n++;
+    return n;
+#endif
+}
+
+// Puts the bytes of a loaded word's mask in memory order: bit 8 * i + 7 is byte i
+static inline uint64_t ascii_memory_order(uint64_t m)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap64(m);
+#else
+    return m;
+#endif
+}
+
+// 16-byte vectors. ascii_v16_bits() turns a byte-wise compare result into a mask with one
+// bit per byte at (byte index) * ASCII_V16_STEP, all of them set in ASCII_V16_ALL.
+#if defined(ASCII_SSE2)
+#define ASCII_V16 1
+#define ASCII_V16_STEP 1      // movemask: bit i = byte i
+#define ASCII_V16_ALL 0xFFFFu // Every byte
+typedef __m128i AsciiV16;
+
+static inline AsciiV16 ascii_v16_load(const char *p)
+{
+    return _mm_loadu_si128((const __m128i *) (const void *) p);
+}
+static inline void ascii_v16_store(char *p, AsciiV16 v)
+{
+    _mm_storeu_si128((__m128i *) (void *) p, v);
+}
+static inline AsciiV16 ascii_v16_splat(char ch) { return _mm_set1_epi8(ch); }
+static inline AsciiV16 ascii_v16_eq(AsciiV16 a, AsciiV16 b) { return _mm_cmpeq_epi8(a, b); }
+static inline AsciiV16 ascii_v16_and(AsciiV16 a, AsciiV16 b) { return _mm_and_si128(a, b); }
+static inline uint64_t ascii_v16_bits(AsciiV16 eq) { return (uint64_t) _mm_movemask_epi8(eq); }
+static inline AsciiV16 ascii_v16_fold(AsciiV16 v)
+{
+    // Shifted by 0x80 - 'A', 'A'-'Z' are the 26 smallest signed bytes
+    AsciiV16 shifted = _mm_add_epi8(v, _mm_set1_epi8((char) (0x80 - 'A')));
+    AsciiV16 upper = _mm_cmplt_epi8(shifted, _mm_set1_epi8((char) (-128 + 26)));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+static inline AsciiV16 ascii_v16_select(AsciiV16 mask, AsciiV16 yes, AsciiV16 no)
+{
+    return _mm_or_si128(_mm_and_si128(mask, yes), _mm_andnot_si128(mask, no));
+}
+#elif defined(ASCII_NEON)
+#define ASCII_V16 1
+#define ASCII_V16_STEP 4                     // Narrowed compare: 4 bits per byte
+#define ASCII_V16_ALL 0x8888888888888888ull // Top bit of every byte's nibble
+typedef uint8x16_t AsciiV16;
+
+static inline AsciiV16 ascii_v16_load(const char *p) { return vld1q_u8((const uint8_t *) p); }
+static inline void ascii_v16_store(char *p, AsciiV16 v) { vst1q_u8((uint8_t *) p, v); }
+static inline AsciiV16 ascii_v16_splat(char ch) { return vdupq_n_u8((uint8_t) ch); }
+static inline AsciiV16 ascii_v16_eq(AsciiV16 a, AsciiV16 b) { return vceqq_u8(a, b); }
+static inline AsciiV16 ascii_v16_and(AsciiV16 a, AsciiV16 b) { return vandq_u8(a, b); }
+static inline uint64_t ascii_v16_bits(AsciiV16 eq)
+{
+    uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4); // Byte i -> nibble i
+    return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0) & ASCII_V16_ALL;
+}
+static inline AsciiV16 ascii_v16_fold(AsciiV16 v)
+{
+    AsciiV16 upper = vcltq_u8(vsubq_u8(v, vdupq_n_u8('A')), vdupq_n_u8(26));
+    return vorrq_u8(v, vandq_u8(upper, vdupq_n_u8(0x20)));
+}
+static inline AsciiV16 ascii_v16_select(AsciiV16 mask, AsciiV16 yes, AsciiV16 no)
+{
+    return vbslq_u8(mask, yes, no);
+}
+#endif
+
+#ifdef ASCII_AVX2
+#define ASCII_AVX2_FN __attribute__((target("avx2"))) // Compiled for AVX2, called after a check
+
+// 1 if the CPU supports AVX2 (the answer is cached by the compiler's runtime)
+static inline int ascii_avx2(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+ASCII_AVX2_FN static inline __m256i ascii_v32_fold(__m256i v)
+{
+    __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8((char) (0x80 - 'A')));
+    __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8((char) (-128 + 26)), shifted);
+    return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+// ascii_lower() over the whole 32-byte blocks; returns the bytes done
+ASCII_AVX2_FN static size_t ascii_lower_avx2(const char *src, size_t len, char *dst)
+{
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+        _mm256_storeu_si256((__m256i *) (void *) (dst + i),
+                            ascii_v32_fold(_mm256_loadu_si256((const __m256i *) (const void *)
+                                                                  (src + i))));
+    return i;
+}
+
+// ascii_common() over 32-byte blocks: skips blocks that are equal ignoring case
+ASCII_AVX2_FN static size_t ascii_common_avx2(const char *a, const char *b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i x = ascii_v32_fold(_mm256_loadu_si256((const __m256i *) (const void *) (a + i)));
+        __m256i y = ascii_v32_fold(_mm256_loadu_si256((const __m256i *) (const void *) (b + i)));
+        if ((uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) != 0xFFFFFFFFu)
+            break;
+    }
+    return i;
+}
+
+// ascii_replace() over the whole 32-byte blocks; returns the bytes done
+ASCII_AVX2_FN static size_t ascii_replace_avx2(char *s, size_t len, char from, char to)
+{
+    __m256i f = _mm256_set1_epi8(from), t = _mm256_set1_epi8(to);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (const void *) (s + i));
+        __m256i hit = _mm256_cmpeq_epi8(v, f);
+        if (!_mm256_testz_si256(hit, hit))
+            _mm256_storeu_si256((__m256i *) (void *) (s + i), _mm256_blendv_epi8(v, t, hit));
+    }
+    return i;
+}
+
+// ascii_find_lower() over 32-byte blocks of start positions [0, count): positions whose
+// first and last bytes match are verified in full. Returns the first match, or NULL after
+// setting *done to the positions checked.
+ASCII_AVX2_FN static const char *ascii_find_avx2(const char *hay, size_t count, const char *needle,
+                                                 size_t n, size_t *done)
+{
+    __m256i first = _mm256_set1_epi8(needle[0]), last = _mm256_set1_epi8(needle[n - 1]);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i x = ascii_v32_fold(_mm256_loadu_si256((const __m256i *) (const void *) (hay + i)));
+        __m256i y = ascii_v32_fold(
+            _mm256_loadu_si256((const __m256i *) (const void *) (hay + i + n - 1)));
+        uint32_t m = (uint32_t) _mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(x, first), _mm256_cmpeq_epi8(y, last)));
+        for (; m; m &= m - 1)
+        {
+            const char *p = hay + i + ascii_ctz(m);
+            if (ascii_common(p, needle, n) == n)
+                return p;
+        }
+    }
+    *done = i;
+    return NULL;
+}
+#endif
+
+// Writes the lowercase form of len bytes of 'src' to 'dst' (which may be 'src'). Lengths
+// that are not a whole number of blocks finish with one block ending at the last byte,
+// which refolds a few bytes; folding twice changes nothing.
+static void ascii_lower(const char *src, size_t len, char *dst)
+{
+    size_t i = 0;
+#ifdef ASCII_AVX2
+    if (len >= 32 && ascii_avx2())
+        i = ascii_lower_avx2(src, len, dst);
+#endif
+#ifdef ASCII_V16
+    if (len >= 16)
+    {
+        for (; i + 16 <= len; i += 16)
+            ascii_v16_store(dst + i, ascii_v16_fold(ascii_v16_load(src + i)));
+        if (i < len)
+            ascii_v16_store(dst + len - 16, ascii_v16_fold(ascii_v16_load(src + len - 16)));
+        return;
+    }
+#endif
+    if (len >= 8)
+    {
+        for (; i + 8 <= len; i += 8)
+        {
+            uint64_t w = ascii_fold_word(ascii_load_word(src + i));
+            memcpy(dst + i, &w, sizeof(w));
+        }
+        uint64_t w = ascii_fold_word(ascii_load_word(src + len - 8));
+        memcpy(dst + len - 8, &w, sizeof(w));
+        return;
+    }
+    for (; i < len; i++)
+        dst[i] = (char) ascii_fold((unsigned char) src[i]);
+}
+
+#ifdef ASCII_V16
+// Index of the first byte in a 16-byte block where a and b differ ignoring case, or 16
+static inline size_t ascii_diff_v16(const char *a, const char *b)
+{
+    uint64_t eq = ascii_v16_bits(
+        ascii_v16_eq(ascii_v16_fold(ascii_v16_load(a)), ascii_v16_fold(ascii_v16_load(b))));
+    return eq == ASCII_V16_ALL ? 16 : ascii_ctz(eq ^ ASCII_V16_ALL) / ASCII_V16_STEP;
+}
+#endif
+
+// Index of the first byte where two folded words differ (x = their XOR, non-zero)
+static inline size_t ascii_diff_word(uint64_t x)
+{
+    return ascii_ctz(ascii_memory_order(x)) / 8;
+}
+
+// ascii_common() past an equal first word (n >= 8)
+static size_t ascii_common_tail(const char *a, const char *b, size_t n)
+{
+    size_t i = 8;
+    uint64_t x;
+#ifdef ASCII_AVX2
+    if (n >= 32 && ascii_avx2())
+        i = ascii_common_avx2(a, b, n);
+#endif
+#ifdef ASCII_V16
+    if (n >= 16)
+    {
+        for (; i + 16 <= n; i += 16)
+        {
+            size_t d = ascii_diff_v16(a + i, b + i);
+            if (d < 16)
+                return i + d;
+        }
+        return i == n ? n : n - 16 + ascii_diff_v16(a + n - 16, b + n - 16);
+    }
+#endif
+    for (; i + 8 <= n; i += 8)
+    {
+        x = ascii_fold_word(ascii_load_word(a + i)) ^ ascii_fold_word(ascii_load_word(b + i));
+        if (x)
+            return i + ascii_diff_word(x);
+    }
+    if (i == n)
+        return n;
+    x = ascii_fold_word(ascii_load_word(a + n - 8)) ^ ascii_fold_word(ascii_load_word(b + n - 8));
+    return x ? n - 8 + ascii_diff_word(x) : n; // Last word, overlapping the ones compared
+}
+
+// Length of the longest common prefix of a and b (n bytes each), ignoring case
+static inline size_t ascii_common(const char *a, const char *b, size_t n)
+{
+    size_t i = 0;
+    if (n < 8)
+    {
+        while (i < n && ascii_fold((unsigned char) a[i]) == ascii_fold((unsigned char) b[i]))
+            i++;
+        return i;
+    }
+    // Most strings compared differ early, so the first word is settled inline before the
+    // vector stages; AVX2 only skips equal blocks and leaves the exact byte to the later stages
+    uint64_t x = ascii_fold_word(ascii_load_word(a)) ^ ascii_fold_word(ascii_load_word(b));
+    return x ? ascii_diff_word(x) : ascii_common_tail(a, b, n);
+}
+
+// Compares two byte strings ignoring case, in the order strcasecmp() gives them
+static int ascii_casecmp(const char *a, size_t la, const char *b, size_t lb)
+{
+    size_t n = la < lb ? la : lb;
+    size_t i = ascii_common(a, b, n);
+    if (i < n)
+        return (int) ascii_fold((unsigned char) a[i]) - (int) ascii_fold((unsigned char) b[i]);
+    return (la > lb) - (la < lb); // One is a prefix of the other: the shorter sorts first
+}
+
+// 1 if the first n bytes of a and b are equal ignoring case (strncasecmp() == 0 when neither
+// holds a '\0' before n)
+static int ascii_caseeq(const char *a, const char *b, size_t n)
+{
+    return ascii_common(a, b, n) == n;
+}
+
+#ifdef ASCII_V16
+// ascii_find_lower() at the 16 start positions from 'p': the first match, or NULL
+static inline const char *ascii_find_v16(const char *p, const char *needle, size_t n,
+                                         AsciiV16 first, AsciiV16 last)
+{
+    AsciiV16 x = ascii_v16_eq(ascii_v16_fold(ascii_v16_load(p)), first);
+    AsciiV16 y = ascii_v16_eq(ascii_v16_fold(ascii_v16_load(p + n - 1)), last);
+    for (uint64_t m = ascii_v16_bits(ascii_v16_and(x, y)); m; m &= m - 1)
+    {
+        const char *q = p + ascii_ctz(m) / ASCII_V16_STEP;
+        if (ascii_common(q, needle, n) == n)
+            return q;
+    }
+    return NULL;
+}
+#endif
+
+// ascii_find_lower() at the 8 start positions from 'p' (first_w and last_w hold the needle's
+// first and last bytes in every byte): the first match, or NULL
+static inline const char *ascii_find_word(const char *p, const char *needle, size_t n,
+                                          uint64_t first_w, uint64_t last_w)
+{
+    uint64_t x = ascii_fold_word(ascii_load_word(p)) ^ first_w;
+    uint64_t y = ascii_fold_word(ascii_load_word(p + n - 1)) ^ last_w;
+    for (uint64_t m = ascii_memory_order(ascii_zero_bytes(x | y)); m; m &= m - 1)
+    {
+        const char *q = p + ascii_ctz(m) / 8;
+        if (ascii_common(q, needle, n) == n)
+            return q;
+    }
+    return NULL;
+}
+
+// First occurrence of 'needle' (n bytes, already lowercase) in the len bytes of 'hay',
+// ignoring case, or NULL. Each block of start positions is tested against the needle's
+// first and last bytes at once, and only the positions where both match are verified.
+// The last block ends at the last start position; the positions it repeats did not match.
+static const char *ascii_find_lower(const char *hay, size_t len, const char *needle, size_t n)
+{
+    if (n == 0)
+        return hay;
+    if (n > len)
+        return NULL;
+    size_t count = len - n + 1; // Start positions
+    size_t i = 0;
+    const char *p = NULL;
+#ifdef ASCII_AVX2
+    if (count >= 32 && ascii_avx2() && (p = ascii_find_avx2(hay, count, needle, n, &i)) != NULL)
+        return p;
+#endif
+#ifdef ASCII_V16
+    if (count >= 16)
+    {
+        AsciiV16 first = ascii_v16_splat(needle[0]), last = ascii_v16_splat(needle[n - 1]);
+        for (; i + 16 <= count; i += 16)
+            if ((p = ascii_find_v16(hay + i, needle, n, first, last)) != NULL)
+                return p;
+        return i == count ? NULL : ascii_find_v16(hay + count - 16, needle, n, first, last);
+    }
+#endif
+    if (count >= 8)
+    {
+        uint64_t first_w = (unsigned char) needle[0] * ASCII_ONES;
+        uint64_t last_w = (unsigned char) needle[n - 1] * ASCII_ONES;
+        for (; i + 8 <= count; i += 8)
+            if ((p = ascii_find_word(hay + i, needle, n, first_w, last_w)) != NULL)
+                return p;
+        return i == count ? NULL : ascii_find_word(hay + count - 8, needle, n, first_w, last_w);
+    }
+    for (; i < count; i++)
+        if (ascii_fold((unsigned char) hay[i]) == (unsigned char) needle[0] &&
+            ascii_common(hay + i, needle, n) == n)
+            return hay + i;
+    return NULL;
+}
+
+// Replaces every 'from' byte among the first len bytes of 's' with 'to'
+static void ascii_replace(char *s, size_t len, char from, char to)
+{
+    size_t i = 0;
+#ifdef ASCII_AVX2
+    if (len >= 32 && ascii_avx2())
+        i = ascii_replace_avx2(s, len, from, to);
+#endif
+#ifdef ASCII_V16
+    if (len >= 16)
+    {
+        AsciiV16 f = ascii_v16_splat(from), t = ascii_v16_splat(to);
+        for (;; i += 16)
+        {
+            if (i + 16 > len)
+                i = len - 16; // Last block ends at the last byte; replacing twice is harmless
+            AsciiV16 v = ascii_v16_load(s + i), hit = ascii_v16_eq(v, f);
+            if (ascii_v16_bits(hit))
+                ascii_v16_store(s + i, ascii_v16_select(hit, t, v));
+            if (i + 16 == len)
+                return;
+        }
+    }
+#endif
+    for (; i < len; i++)
+        if (s[i] == from)
+            s[i] = to;
+}
+
+// ----------------- Hash index -----------------
+
+// Lowercases ASCII letters so lookups are case-insensitive like strcasecmp()
+static size_t fold_key(const char *value, size_t len, char *out)
+{
+    ascii_lower(value, len, out);
+    out[len] = '\0';
+    return len;
+}
+
+// Canonicalizes a phone number to E.164: drops common separators and prefixes
+// 10-digit Indian mobile numbers with +91, so "98765 43210" and "+919876543210" match
+static size_t phone_key(const char *value, size_t len, char *out)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < len && n < MAX_PHONE_LENGTH + 2; i++)
+    {
+        char ch = value[i];
+        if (ch == ' ' || ch == '-' || ch == '(' || ch == ')' || ch == '.')
+            continue; // Formatting only
+        out[n++] = ch;
+    }
+    out[n] = '\0';
+
+    if (n == 10 && out[0] >= '6' && out[0] <= '9')
+    {
+        memmove(out + 3, out, n + 1);
+        memcpy(out, "+91", 3);
+        n += 3;
+    }
+    return n;
+}
+
+// Soundex digit of a letter: 1-6 for consonant groups, 0 for vowels (and y), which separate
+// repeats, and -1 for h and w, which do not
+static int soundex_digit(unsigned char ch)
+{
+    static const signed char codes[26] = {0, 1, 2, 3, 0, 1, 2, -1, 0, 2, 2, 4, 5,
+                                          5, 0, 1, 2, 6, 2, 3, 0, 1, -1, 2, 0, 2};
+    ch = (unsigned char) tolower(ch);
+    return ch >= 'a' && ch <= 'z' ? codes[ch - 'a'] : -2;
+}
+
+// Phonetic key of a name: each word (split at spaces and hyphens) becomes a 4-digit Soundex
+// code, so "Jon Smyth" and "John Smith" share the key "25002530". Unlike classic Soundex
+// the first letter is coded like the others, so Catherine/Katherine and Filips/Phillips also
+// match; fuzzy search ranks the candidates by edit distance afterwards.
+static size_t phonetic_key(const char *value, size_t len, char *out)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < len && n + 4 < INDEX_KEY_SIZE;)
+    {
+        while (i < len && (value[i] == ' ' || value[i] == '-'))
+            i++; // Word separators
+        if (i == len)
+            break;
+
+        int digits = 0, last = -2;
+        for (; i < len && value[i] != ' ' && value[i] != '-'; i++)
+        {
+            int d = soundex_digit((unsigned char) value[i]);
+            if (d == -2 || d == -1)
+                continue; // Apostrophes, h and w
+            if ((digits == 0 || (d != 0 && d != last)) && digits < 4)
+                out[n + digits++] = (char) ('0' + d); // Repeats of the last code collapse
+            last = d;
+        }
+        if (digits == 0)
+            continue; // A word without letters
+        while (digits < 4)
+            out[n + digits++] = '0';
+        n += 4;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+// FNV-1a hash of a normalized key
+static uint32_t hash_key(const char *key, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (unsigned char) key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Normalizes the indexed field of the contact at 'pos' into 'out'
+static size_t index_key_of(const HashIndex *ix, uint32_t pos, char *out)
+{
+    const Contact *c = &cur_store()->items[pos];
+    if (!ix->key)
+    { // The ID index: the key is the ID's bytes
+        memcpy(out, &c->id, sizeof(c->id));
+        return sizeof(c->id);
+    }
+    return ix->key(contact_field(c, ix->field), c->len[ix->field], out);
+}
+
+// Places an entry into the bucket array without checking load (capacity must have room)
+static void index_place(HashIndex *ix, uint32_t slot, uint32_t hash)
+{
+    size_t mask = ix->capacity - 1;
+    size_t b = hash & mask;
+    while (ix->slots[b] != 0)
+        b = (b + 1) & mask; // Linear probing
+    ix->slots[b] = slot;
+    ix->hashes[b] = hash;
+    ix->used++;
+}
+
+// Reallocates the bucket array to 'capacity' buckets and reinserts existing entries
+static int index_resize(HashIndex *ix, size_t capacity)
+{
+    uint32_t *slots = calloc(capacity, sizeof(uint32_t));
+    uint32_t *hashes = malloc(capacity * sizeof(uint32_t));
+    if (!slots || !hashes)
+    {
+        free(slots);
+        free(hashes);
+        printf("❌ Out of memory: cannot grow index to %zu buckets.\n", capacity);
+        return -1;
+    }
+
+    uint32_t *old_slots = ix->slots, *old_hashes = ix->hashes;
+    size_t old_capacity = ix->capacity;
+    ix->slots = slots;
+    ix->hashes = hashes;
+    ix->capacity = capacity;
+    ix->used = 0;
+    for (size_t b = 0; b < old_capacity; b++)
+        if (old_slots[b])
+            index_place(ix, old_slots[b], old_hashes[b]);
+
+    block_free(old_slots);
+    block_free(old_hashes);
+    return 0;
+}
+
+// Ensures the index can hold 'entries' keys while staying under 70% load
+int index_reserve(HashIndex *ix, size_t entries)
+{
+    size_t capacity = ix->capacity ? ix->capacity : INDEX_INITIAL_CAPACITY;
+    while (entries * 10 > capacity * 7)
+        capacity *= 2;
+    if (capacity == ix->capacity)
+        return 0;
+    return index_resize(ix, capacity);
+}
+
+// Adds the contact at 'pos' under its normalized key
+int index_insert(HashIndex *ix, uint32_t pos)
+{
+    if (index_reserve(ix, ix->used + 1) != 0)
+        return -1;
+
+    char key[INDEX_KEY_SIZE];
+    size_t len = index_key_of(ix, pos, key);
+    index_place(ix, pos + 1, hash_key(key, len));
+    return 0;
+}
+
+// Removes the entry for the contact at 'pos' (its key must not have changed since insert)
+void index_erase(HashIndex *ix, uint32_t pos)
+{
+    if (ix->used == 0)
+        return;
+
+    char key[INDEX_KEY_SIZE];
+    size_t len = index_key_of(ix, pos, key);
+    size_t mask = ix->capacity - 1;
+    size_t i = hash_key(key, len) & mask;
+    while (ix->slots[i] != pos + 1)
+    {
+        if (ix->slots[i] == 0)
+            return; // Not indexed
+        i = (i + 1) & mask;
+    }
+
+    // Backward-shift deletion keeps probe chains intact without tombstones
+    size_t j = i;
+    while (1)
+    {
+        j = (j + 1) & mask;
+        if (ix->slots[j] == 0)
+            break;
+        size_t home = ix->hashes[j] & mask;
+        // Move j back into the hole unless its home bucket lies cyclically in (i, j]
+        int stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays)
+        {
+            ix->slots[i] = ix->slots[j];
+            ix->hashes[i] = ix->hashes[j];
+            i = j;
+        }
+    }
+    ix->slots[i] = 0;
+    ix->used--;
+}
+
+// Moves every indexed position to map[position] after a purge (deleted contacts must
+// already be unindexed)
+void index_renumber(HashIndex *ix, const uint32_t *map)
+{
+    for (size_t b = 0; b < ix->capacity; b++)
+        if (ix->slots[b])
+            ix->slots[b] = map[ix->slots[b] - 1] + 1;
+}
+
+// Clears the index and reinserts every contact (used after reordering the store)
+int index_rebuild(HashIndex *ix)
+{
+    if (ix->capacity)
+        memset(ix->slots, 0, ix->capacity * sizeof(uint32_t));
+    ix->used = 0;
+    if (index_reserve(ix, cur_store()->count) != 0)
+        return -1;
+
+    char key[INDEX_KEY_SIZE];
+    for (size_t i = 0; i < cur_store()->count; i++)
+    {
+        if (cur_store()->items[i].flags & CONTACT_DELETED)
+            continue;
+        size_t len = index_key_of(ix, (uint32_t) i, key);
+        index_place(ix, (uint32_t) i + 1, hash_key(key, len));
+    }
+    return 0;
+}
+
+// Scans forward from the cursor's bucket for the next contact with the cursor's key
+long index_next(const HashIndex *ix, IndexCursor *cur)
+{
+    if (ix->capacity == 0)
+        return -1;
+
+    size_t mask = ix->capacity - 1;
+    char key[INDEX_KEY_SIZE];
+    while (ix->slots[cur->bucket] != 0)
+    {
+        size_t b = cur->bucket;
+        cur->bucket = (b + 1) & mask;
+        if (ix->hashes[b] != cur->hash)
+            continue;
+
+        uint32_t pos = ix->slots[b] - 1;
+        size_t len = index_key_of(ix, pos, key);
+        if (len == cur->key_len && memcmp(key, cur->key, len) == 0)
+            return pos;
+    }
+    return -1;
+}
+
+// Starts a lookup for 'value' and returns the first matching position, or -1
+long index_lookup(const HashIndex *ix, const char *value, IndexCursor *cur)
+{
+    size_t len = strnlen(value, INDEX_KEY_SIZE - 1);
+    cur->key_len = ix->key(value, len, cur->key);
+    cur->hash = hash_key(cur->key, cur->key_len);
+    cur->bucket = ix->capacity ? (cur->hash & (ix->capacity - 1)) : 0;
+    return index_next(ix, cur);
+}
+
+// Returns the position indexed under ID 'id' in the ID index, or -1
+static long index_find_id(const HashIndex *ix, uint64_t id)
+{
+    IndexCursor cur;
+    cur.key_len = sizeof(id);
+    memcpy(cur.key, &id, sizeof(id));
+    cur.hash = hash_key(cur.key, cur.key_len);
+    cur.bucket = ix->capacity ? (cur.hash & (ix->capacity - 1)) : 0;
+    return index_next(ix, &cur);
+}
+
+// Frees the bucket arrays
+void index_free(HashIndex *ix)
+{
+    block_free(ix->slots);
+    block_free(ix->hashes);
+    ix->slots = NULL;
+    ix->hashes = NULL;
+    ix->capacity = 0;
+    ix->used = 0;
+}
+
+// ----------------- Trigram index -----------------
+// Every run of three lowercase bytes in an indexed field maps to the sorted positions of the
+// contacts containing it. A partial query only verifies the contacts on the shortest posting
+// list among its own trigrams instead of scanning the whole store.
+
+// Packs three bytes (lowercased) into a non-zero trigram code
+static uint32_t trigram_code(const char *s)
+{
+    return ((uint32_t) (unsigned char) tolower((unsigned char) s[0]) << 16) |
+           ((uint32_t) (unsigned char) tolower((unsigned char) s[1]) << 8) |
+           (uint32_t) (unsigned char) tolower((unsigned char) s[2]);
+}
+
+// Bucket for 'code' (its own or the empty one where it would go); capacity must be non-zero
+static size_t trigram_bucket(const TrigramIndex *tx, uint32_t code)
+{
+    size_t mask = tx->capacity - 1;
+    size_t b = (code * 2654435761u) & mask; // Multiplicative hashing
+    while (tx->codes[b] != 0 && tx->codes[b] != code)
+        b = (b + 1) & mask;
+    return b;
+}
+
+// Resizes the trigram table to 'capacity' buckets, moving the posting lists across
+static int trigram_resize(TrigramIndex *tx, size_t capacity)
+{
+    uint32_t *codes = calloc(capacity, sizeof(uint32_t));
+    PostingList *lists = calloc(capacity, sizeof(PostingList));
+    if (!codes || !lists)
+    {
+        free(codes);
+        free(lists);
+        printf("❌ Out of memory: cannot grow trigram index.\n");
+        return -1;
+    }
+
+    TrigramIndex grown = {codes, lists, capacity, tx->used, tx->active};
+    for (size_t b = 0; b < tx->capacity; b++)
+    {
+        if (tx->codes[b] == 0)
+            continue;
+        size_t nb = trigram_bucket(&grown, tx->codes[b]);
+        codes[nb] = tx->codes[b];
+        lists[nb] = tx->lists[b];
+    }
+    free(tx->codes);
+    free(tx->lists);
+    *tx = grown;
+    return 0;
+}
+
+// Returns the posting list for 'code', creating an empty one if needed (NULL on OOM)
+static PostingList *trigram_list(TrigramIndex *tx, uint32_t code)
+{
+    if ((tx->used + 1) * 10 > tx->capacity * 7)
+    {
+        size_t capacity = tx->capacity ? tx->capacity * 2 : INDEX_INITIAL_CAPACITY;
+        if (trigram_resize(tx, capacity) != 0)
+            return NULL;
+    }
+
+    size_t b = trigram_bucket(tx, code);
+    if (tx->codes[b] == 0)
+    {
+        tx->codes[b] = code;
+        tx->used++;
+    }
+    return &tx->lists[b];
+}
+
+// Inserts 'pos' into a sorted posting list; duplicates are ignored
+static int posting_insert(PostingList *list, uint32_t pos)
+{
+    // Appends are the common case: new contacts always have the highest position
+    size_t at = list->count;
+    if (at > 0 && list->items[at - 1] >= pos)
+    {
+        size_t lo = 0, hi = list->count;
+        while (lo < hi)
+        {
+            size_t mid = lo + (hi - lo) / 2;
+            if (list->items[mid] < pos)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo < list->count && list->items[lo] == pos)
+            return 0; // Already present (trigram repeats within this contact)
+        at = lo;
+    }
+
+    if (list->count == list->capacity)
+    {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 4;
+        uint32_t *items = realloc(list->items, capacity * sizeof(uint32_t));
+        if (!items)
+        {
+            printf("❌ Out of memory: cannot grow trigram index.\n");
+            return -1;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+
+    memmove(&list->items[at + 1], &list->items[at], (list->count - at) * sizeof(uint32_t));
+    list->items[at] = pos;
+    list->count++;
+    return 0;
+}
+
+// Removes 'pos' from a sorted posting list if present
+static void posting_erase(PostingList *list, uint32_t pos)
+{
+    size_t lo = 0, hi = list->count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (list->items[mid] < pos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < list->count && list->items[lo] == pos)
+    {
+        memmove(&list->items[lo], &list->items[lo + 1],
+                (list->count - lo - 1) * sizeof(uint32_t));
+        list->count--;
+    }
+}
+
+// Adds every trigram of the contact's indexed fields
+int trigram_insert(TrigramIndex *tx, uint32_t pos)
+{
+    const Contact *c = &cur_store()->items[pos];
+    for (int f = 0; f < FIELD_COUNT; f++)
+    {
+        if (!(TRIGRAM_FIELDS & (1u << f)))
+            continue;
+        const char *s = contact_field(c, (ContactField) f);
+        for (size_t i = 0; i + 3 <= c->len[f]; i++)
+        {
+            PostingList *list = trigram_list(tx, trigram_code(s + i));
+            if (!list || posting_insert(list, pos) != 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+// Removes the contact from the lists of all its trigrams (fields must be unchanged)
+void trigram_erase(TrigramIndex *tx, uint32_t pos)
+{
+    if (tx->capacity == 0)
+        return;
+
+    const Contact *c = &cur_store()->items[pos];
+    for (int f = 0; f < FIELD_COUNT; f++)
+    {
+        if (!(TRIGRAM_FIELDS & (1u << f)))
+            continue;
+        const char *s = contact_field(c, (ContactField) f);
+        for (size_t i = 0; i + 3 <= c->len[f]; i++)
+        {
+            size_t b = trigram_bucket(tx, trigram_code(s + i));
+            if (tx->codes[b] != 0)
+                posting_erase(&tx->lists[b], pos);
+        }
+    }
+}
+
+// Moves every listed position to map[position] after a purge; the map keeps order, so the
+// lists stay sorted
+void trigram_renumber(TrigramIndex *tx, const uint32_t *map)
+{
+    for (size_t b = 0; b < tx->capacity; b++)
+    {
+        PostingList *list = &tx->lists[b];
+        for (uint32_t k = 0; k < list->count; k++)
+            list->items[k] = map[list->items[k]];
+    }
+}
+
+// Empties every posting list and reindexes all contacts
+int trigram_rebuild(TrigramIndex *tx)
+{
+    for (size_t b = 0; b < tx->capacity; b++)
+        tx->lists[b].count = 0;
+    for (size_t i = 0; i < cur_store()->count; i++)
+        if (!(cur_store()->items[i].flags & CONTACT_DELETED) &&
+            trigram_insert(tx, (uint32_t) i) != 0)
+            return -1;
+    return 0;
+}
+
+// Returns the shortest posting list among the query's trigrams; every contact containing
+// the lowercase query is on it. Returns NULL if the query is too short to use the index.
+const PostingList *trigram_candidates(const TrigramIndex *tx, const char *lower)
+{
+    static const PostingList empty = {NULL, 0, 0};
+    size_t len = strlen(lower);
+    if (len < 3)
+        return NULL;
+    if (tx->capacity == 0)
+        return &empty;
+
+    const PostingList *best = NULL;
+    for (size_t i = 0; i + 3 <= len; i++)
+    {
+        size_t b = trigram_bucket(tx, trigram_code(lower + i));
+        if (tx->codes[b] == 0)
+            return &empty; // Trigram never seen, so nothing can match
+        if (!best || tx->lists[b].count < best->count)
+            best = &tx->lists[b];
+    }
+    return best;
+}
+
+// Frees all posting lists and the table
+void trigram_free(TrigramIndex *tx)
+{
+    for (size_t b = 0; b < tx->capacity; b++)
+        free(tx->lists[b].items);
+    free(tx->codes);
+    free(tx->lists);
+    memset(tx, 0, sizeof(*tx));
+}
+
+// ----------------- Field columns -----------------
+// The records keep every field of a contact together, which suits lookups and writing
+// contacts out. Sorts and scans read one field of every contact, so they use these columns
+// instead: a sort by email walks the email column, and a partial name search the names,
+// without bringing anything else into the cache. Values are copied in when contacts are
+// added or changed; a changed value leaves its old bytes behind until the next rebuild.
+
+// Grows every column so it can hold 'positions' positions (0 = ok)
+static int columns_reserve(FieldColumns *fc, size_t positions)
+{
+    if (positions <= fc->capacity)
+        return 0;
+    size_t capacity = fc->capacity ? fc->capacity : STORE_INITIAL_CAPACITY;
+    while (capacity < positions)
+        capacity *= 2; // Amortized doubling, like the records
+    for (int f = 0; f < FIELD_COUNT; f++)
+    {
+        uint32_t *off = realloc(fc->off[f], capacity * sizeof(uint32_t));
+        if (off)
+            fc->off[f] = off;
+        uint8_t *len = realloc(fc->len[f], capacity);
+        if (len)
+            fc->len[f] = len;
+        if (!off || !len)
+            return -1; // The columns that did grow keep their larger blocks
+    }
+    fc->capacity = capacity;
+    return 0;
+}
+
+// Copies one field of the contact at 'pos' to the end of its column (0 = ok)
+int columns_set(FieldColumns *fc, uint32_t pos, ContactField field)
+{
+    const Contact *c = &cur_store()->items[pos];
+    size_t n = c->len[field];
+    StringArena *text = &fc->text[field];
+    if (n == 0)
+    {
+        fc->off[field][pos] = 0; // The column's empty string
+        fc->len[field][pos] = 0;
+        return 0;
+    }
+    if (arena_reserve(text, n + 1) != 0)
+        return -1;
+
+    char *to = text->data + text->used;
+    if (COLUMN_FOLDED & (1u << field))
+        ascii_lower(contact_field(c, field), n, to);
+    else
+        memcpy(to, contact_field(c, field), n);
+    to[n] = '\0';
+    fc->off[field][pos] = (uint32_t) text->used;
+    fc->len[field][pos] = (uint8_t) n;
+    text->used += n + 1;
+    return 0;
+}
+
+// Copies every field of the contact appended at 'pos' (= fc->count) into the columns
+int columns_insert(FieldColumns *fc, uint32_t pos)
+{
+    if (pos != fc->count || columns_reserve(fc, (size_t) pos + 1) != 0)
+        return -1;
+    for (int f = 0; f < FIELD_COUNT; f++)
+        if (columns_set(fc, pos, (ContactField) f) != 0)
+            return -1;
+    fc->count++;
+    return 0;
+}
+
+// Drops the contact at 'pos' if it is the last one (a rolled-back add). Deleted contacts
+// keep their values until the purge; scans skip them by their record's flags.
+void columns_erase(FieldColumns *fc, uint32_t pos)
+{
+    if ((size_t) pos + 1 == fc->count)
+        fc->count--;
+}
+
+// Drops purged positions and moves the others to map[position]. The map keeps order, so
+// every entry moves down or stays.
+void columns_renumber(FieldColumns *fc, const uint32_t *map)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < fc->count; i++)
+    {
+        if (map[i] == UINT32_MAX)
+            continue;
+        for (int f = 0; f < FIELD_COUNT; f++)
+        {
+            fc->off[f][map[i]] = fc->off[f][i];
+            fc->len[f][map[i]] = fc->len[f][i];
+        }
+        n++;
+    }
+    fc->count = n;
+}
+
+// Copies every contact into the columns again, in record order and without the bytes of
+// old values
+int columns_rebuild(FieldColumns *fc)
+{
+    size_t bytes[FIELD_COUNT] = {0};
+    for (size_t i = 0; i < cur_store()->count; i++)
+        for (int f = 0; f < FIELD_COUNT; f++)
+            if (cur_store()->items[i].len[f])
+                bytes[f] += cur_store()->items[i].len[f] + 1u;
+
+    fc->count = 0;
+    if (columns_reserve(fc, cur_store()->count) != 0)
+        return -1;
+    for (int f = 0; f < FIELD_COUNT; f++)
+    {
+        fc->text[f].used = fc->text[f].data ? 1 : 0; // Keep only the empty string
+        if (arena_reserve(&fc->text[f], bytes[f]) != 0)
+            return -1;
+    }
+    for (size_t i = 0; i < cur_store()->count; i++)
+        for (int f = 0; f < FIELD_COUNT; f++)
+            columns_set(fc, (uint32_t) i, (ContactField) f); // Reserved above, cannot fail
+    fc->count = cur_store()->count;
+    return 0;
+}
+
+// Frees every column
+void columns_free(FieldColumns *fc)
+{
+    for (int f = 0; f < FIELD_COUNT; f++)
+    {
+        free(fc->text[f].data);
+        free(fc->off[f]);
+        free(fc->len[f]);
+    }
+    memset(fc, 0, sizeof(*fc));
+}
+
+// ----------------- Sanitization helpers -----------------
+
+// Trims leading and trailing whitespace from a string in-place
+static void trim_whitespace(char *s)
+{
+    if (!s)
+        return; // Check for NULL pointer
+
+    // Skip leading whitespace
+    char *start = s;
+    while (*start && isspace((unsigned char) *start))
+        start++;
+
+    // Shift string left to remove leading whitespace
+    if (start != s)
+        memmove(s, start, strlen(start) + 1);
+
+    // Trim trailing whitespace
+    size_t len = strlen(s);
+    while (len > 0 && isspace((unsigned char) s[len - 1]))
+    {
+        s[--len] = '\0';
+    }
+}
+
+// Trims an arena slice in place by narrowing its offset/length (no bytes are moved)
+static void trim_slice(char *arena, Contact *c, ContactField field)
+{
+    const char *s = arena + c->off[field];
+    size_t start = 0, len = c->len[field];
+
+    while (start < len && isspace((unsigned char) s[start]))
+        start++; // Skip leading whitespace
+    while (len > start && isspace((unsigned char) s[len - 1]))
+        len--; // Drop trailing whitespace
+
+    if (start == len)
+    {
+        c->off[field] = 0; // Nothing left; point at the empty string
+        c->len[field] = 0;
+        return;
+    }
+
+    c->off[field] += (uint32_t) start;
+    c->len[field] = (uint8_t) (len - start);
+    arena[c->off[field] + c->len[field]] = '\0'; // Re-terminate the slice
+}
+
+// Replaces commas with spaces inside an arena slice to ensure CSV compatibility
+static void replace_commas_slice(char *arena, Contact *c, ContactField field)
+{
+    ascii_replace(arena + c->off[field], c->len[field], ',', ' '); // Replace commas with spaces
+}
+
+// Sanitizes a contact by trimming whitespace and removing commas
+static void sanitize_contact(char *arena, Contact *c)
+{
+    if (!c)
+        return; // Check for NULL pointer
+    for (int f = 0; f < FIELD_COUNT; f++)
+    {
+        trim_slice(arena, c, (ContactField) f);           // Trim field
+        replace_commas_slice(arena, c, (ContactField) f); // Remove commas from field
+    }
+}
+
+// ----------------- Regex util -----------------
+
+typedef struct
+{
+    const char *pattern; // Pattern text, used as the registry key
+    regex_t regex;       // Compiled form of the pattern
+#ifdef CMS_STATS
+    atomic_uint_fast64_t calls;    // validate_with_regex() checks against the pattern
+    atomic_uint_fast64_t rejected; // Of those, inputs that did not match
+#endif
+} CompiledRegex;
+
+static CompiledRegex regex_registry[REGEX_REGISTRY_SIZE]; // Compiled patterns
+static size_t regex_registry_count = 0;                   // Number of registry entries in use
+
+// Returns the registry entry for 'pattern', compiling and registering it on first use
+// Returns NULL if the pattern does not compile or the registry is full
+static CompiledRegex *validator_lookup(const char *pattern)
+{
+    // Pattern constants are string literals, so a pointer match is the common case
+    for (size_t i = 0; i < regex_registry_count; i++)
+        if (regex_registry[i].pattern == pattern)
+            return &regex_registry[i];
+    for (size_t i = 0; i < regex_registry_count; i++)
+        if (strcmp(regex_registry[i].pattern, pattern) == 0)
+            return &regex_registry[i];
+
+    if (regex_registry_count == REGEX_REGISTRY_SIZE)
+        return NULL; // No room to cache a new pattern
+
+    CompiledRegex *entry = &regex_registry[regex_registry_count];
+    if (regcomp(&entry->regex, pattern, REG_EXTENDED | REG_NOSUB) != 0)
+        return NULL;
+    entry->pattern = pattern;
+    regex_registry_count++;
+    return entry;
+}
+
+// Compiles every pattern the program uses so no regcomp() happens on hot paths
+int validator_registry_init(void)
+{
+    static const char *const patterns[] = {
+        NAME_REGEX,        PHONE_REGEX,  EMAIL_REGEX,         CONFIRM_REGEX,
+        SORT_CHOICE_REGEX, DIGITS_REGEX, SEARCH_CHOICE_REGEX, PHONE_QUERY_REGEX,
+        SORT_SPEC_REGEX,   IMPORT_POLICY_REGEX,
+    };
+    int status = 0;
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++)
+    {
+        if (!validator_lookup(patterns[i]))
+        {
+            printf("Could not compile regex.\n"); // Handle compilation failure
+            status = -1;
+        }
+    }
+    return status;
+}
+
+// Frees all compiled patterns
+void validator_registry_free(void)
+{
+    for (size_t i = 0; i < regex_registry_count; i++)
+        regfree(&regex_registry[i].regex);
+    regex_registry_count = 0;
+}
+
+// Validates input against a regex pattern using the precompiled registry entry
+int validate_with_regex(const char *pattern, const char *input)
+{
+    CompiledRegex *entry = validator_lookup(pattern);
+    if (!entry)
+    {
+        printf("Could not compile regex.\n"); // Handle compilation failure
+        return 0;
+    }
+
+    // Execute regex against input
+    uint64_t started = stats_start();
+    int matched = regexec(&entry->regex, input, 0, NULL, 0) == 0; // 1 if match, 0 if no match
+    stats_stop(STAT_REGEX, started);
+#ifdef CMS_STATS
+    atomic_fetch_add_explicit(&entry->calls, 1, memory_order_relaxed);
+    if (!matched)
+        atomic_fetch_add_explicit(&entry->rejected, 1, memory_order_relaxed);
+#endif
+    return matched;
+}
+
+// ----------------- Hand-written validators -----------------
+// Bulk loaders call validate_field(), which uses these instead of regexec(). Build with
+// -DUSE_REGEX_VALIDATORS to route it through the regex registry instead, or with
+// -DVALIDATOR_CROSSCHECK to run both and abort on any disagreement.
+
+static int is_ascii_letter(unsigned char ch)
+{
+    return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z');
+}
+
+static int is_ascii_digit(unsigned char ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+// NAME_REGEX: ^[A-Za-z][A-Za-z '-]{0,48}[A-Za-z]$
+int is_valid_name(const char *s, size_t len)
+{
+    if (len < 2 || len > 50)
+        return 0;
+    if (!is_ascii_letter((unsigned char) s[0]) || !is_ascii_letter((unsigned char) s[len - 1]))
+        return 0;
+    for (size_t i = 1; i < len - 1; i++)
+    {
+        unsigned char ch = (unsigned char) s[i];
+        if (!is_ascii_letter(ch) && ch != ' ' && ch != '\'' && ch != '-')
+            return 0;
+    }
+    return 1;
+}
+
+// PHONE_REGEX: ^((\+91[6-9][0-9]{9})|([6-9][0-9]{9})|(\+[1-9][0-9]{6,14}))$
+// The +91 branch is a subset of the international branch, so only two shapes remain
+int is_valid_phone(const char *s, size_t len)
+{
+    size_t start;
+    if (s[0] == '+')
+    {
+        // International: '+', a non-zero digit, then 6-14 more digits
+        if (len < 8 || len > 16 || s[1] < '1' || s[1] > '9')
+            return 0;
+        start = 2;
+    }
+    else
+    {
+        // Indian local: exactly 10 digits starting with 6-9
+        if (len != 10 || s[0] < '6' || s[0] > '9')
+            return 0;
+        start = 1;
+    }
+
+    for (size_t i = start; i < len; i++)
+        if (!is_ascii_digit((unsigned char) s[i]))
+            return 0;
+    return 1;
+}
+
+// EMAIL_REGEX: ^[a-z0-9._%+-]+@[a-zA-Z0-9.-]+\.[a-zA-Z]{2,}$
+// Neither character class contains '@', so there is exactly one; the TLD cannot contain
+// '.', so the regex's final "\." is always the last dot in the domain
+int is_valid_email(const char *s, size_t len)
+{
+    size_t i = 0;
+    while (i < len)
+    {
+        unsigned char ch = (unsigned char) s[i];
+        if (!((ch >= 'a' && ch <= 'z') || is_ascii_digit(ch) || ch == '.' || ch == '_' ||
+              ch == '%' || ch == '+' || ch == '-'))
+            break;
+        i++;
+    }
+    if (i == 0 || i >= len || s[i] != '@')
+        return 0; // Empty local part or no '@' right after it
+
+    size_t domain = i + 1, last_dot = 0;
+    for (i = domain; i < len; i++)
+    {
+        unsigned char ch = (unsigned char) s[i];
+        if (ch == '.')
+            last_dot = i;
+        else if (!is_ascii_letter(ch) && !is_ascii_digit(ch) && ch != '-')
+            return 0;
+    }
+    if (last_dot <= domain || len - last_dot - 1 < 2)
+        return 0; // Need at least one domain character before the dot and a 2+ letter TLD
+
+    for (i = last_dot + 1; i < len; i++)
+        if (!is_ascii_letter((unsigned char) s[i]))
+            return 0;
+    return 1;
+}
+
+// validate_field() without the statistics
+static int validate_field_value(ContactField field, const char *s, size_t len)
+{
+    static const char *const patterns[FIELD_COUNT] = {NAME_REGEX, PHONE_REGEX, EMAIL_REGEX};
+#ifdef USE_REGEX_VALIDATORS
+    (void) len;
+    return validate_with_regex(patterns[field], s);
+#else
+    int result;
+    switch (field)
+    {
+        case FIELD_NAME:
+            result = is_valid_name(s, len);
+            break;
+        case FIELD_PHONE:
+            result = is_valid_phone(s, len);
+            break;
+        default:
+            result = is_valid_email(s, len);
+            break;
+    }
+#ifdef VALIDATOR_CROSSCHECK
+    // Differential check: the hand-written validator must agree with the regex exactly
+    if (result != validate_with_regex(patterns[field], s))
+    {
+        fprintf(stderr, "Validator mismatch on '%s' (pattern %s)\n", s, patterns[field]);
+        abort();
+    }
+#else
+    (void) patterns;
+#endif
+    return result;
+#endif
+}
+
+// Validates a contact field on bulk paths (load/import)
+int validate_field(ContactField field, const char *s, size_t len)
+{
+    uint64_t started = stats_start();
+    int valid = validate_field_value(field, s, len);
+    stats_stop((StatTimer) (STAT_VALIDATE_NAME + field), started);
+    if (!valid)
+        stats_count((StatCounter) (STAT_REJECTED_NAME + field), 1);
+    return valid;
+}
+
+// ----------------- Statistics -----------------
+
+#ifdef CMS_STATS
+// Monotonic time in nanoseconds
+uint64_t stats_clock(void)
+{
+    struct timespec ts;
+#ifndef _WIN32
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+// Adds one call of 'ns' nanoseconds to a timer
+void stats_record(StatTimer timer, uint64_t ns)
+{
+    StatTimerEntry *t = &stat_timers[timer];
+    atomic_fetch_add_explicit(&t->calls, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&t->total_ns, ns, memory_order_relaxed);
+    uint_fast64_t max = atomic_load_explicit(&t->max_ns, memory_order_relaxed);
+    while (ns > max && !atomic_compare_exchange_weak_explicit(&t->max_ns, &max, ns,
+                                                              memory_order_relaxed,
+                                                              memory_order_relaxed))
+        ; // 'max' was reloaded; retry while this call is still the longest
+}
+#endif
+
+// Fills 'rows' with every timer and counter, then each regex pattern checked so far.
+// Returns the number of rows (0 when built without CMS_STATS).
+size_t stats_rows(StatRow rows[STAT_ROWS_MAX])
+{
+#ifdef CMS_STATS
+    static const char *const timer_names[STAT_TIMER_COUNT] = {
+        "load",          "save",           "import",         "export",
+        "sort",          "search_index",   "search_partial", "search_fuzzy",
+        "read",          "parse",          "validate_name",  "validate_phone",
+        "validate_email", "regex",         "write",          "sync",
+    };
+    static const char *const counter_names[STAT_COUNTER_COUNT] = {
+        "bytes_read", "bytes_written", "rejected_name", "rejected_phone", "rejected_email",
+    };
+    size_t n = 0;
+    for (int t = 0; t < STAT_TIMER_COUNT; t++, n++)
+    {
+        rows[n].kind = "time";
+        rows[n].name = timer_names[t];
+        rows[n].value[0] = atomic_load_explicit(&stat_timers[t].calls, memory_order_relaxed);
+        rows[n].value[1] = atomic_load_explicit(&stat_timers[t].total_ns, memory_order_relaxed);
+        rows[n].value[2] = atomic_load_explicit(&stat_timers[t].max_ns, memory_order_relaxed);
+    }
+    for (int k = 0; k < STAT_COUNTER_COUNT; k++, n++)
+    {
+        rows[n].kind = "count";
+        rows[n].name = counter_names[k];
+        rows[n].value[0] = atomic_load_explicit(&stat_counters[k], memory_order_relaxed);
+        rows[n].value[1] = rows[n].value[2] = 0;
+    }
+    for (size_t i = 0; i < regex_registry_count; i++)
+    {
+        uint64_t calls = atomic_load_explicit(&regex_registry[i].calls, memory_order_relaxed);
+        if (calls == 0)
+            continue; // Registered up front but never used
+        rows[n].kind = "regex";
+        rows[n].name = regex_registry[i].pattern;
+        rows[n].value[0] = calls;
+        rows[n].value[1] = atomic_load_explicit(&regex_registry[i].rejected,
+                                                memory_order_relaxed);
+        rows[n].value[2] = 0;
+        n++;
+    }
+    return n;
+#else
+    (void) rows;
+    return 0;
+#endif
+}
+
+// Prints the statistics for people: timers that ran, in milliseconds, then the counters and
+// the regex patterns checked
+void stats_print(FILE *out)
+{
+#ifdef CMS_STATS
+    StatRow rows[STAT_ROWS_MAX];
+    size_t n = stats_rows(rows);
+    fprintf(out, "📊 Statistics since start:\n");
+    fprintf(out, "%-16s %10s %14s %12s %12s\n", "Operation", "Calls", "Total ms", "Mean us",
+            "Max ms");
+    for (size_t i = 0; i < n; i++)
+        if (strcmp(rows[i].kind, "time") == 0 && rows[i].value[0])
+            fprintf(out, "%-16s %10llu %14.3f %12.3f %12.3f\n", rows[i].name,
+                    (unsigned long long) rows[i].value[0], rows[i].value[1] / 1e6,
+                    rows[i].value[1] / 1e3 / (double) rows[i].value[0], rows[i].value[2] / 1e6);
+    for (size_t i = 0; i < n; i++)
+        if (strcmp(rows[i].kind, "count") == 0)
+            fprintf(out, "%-16s %10llu\n", rows[i].name, (unsigned long long) rows[i].value[0]);
+    for (size_t i = 0; i < n; i++)
+        if (strcmp(rows[i].kind, "regex") == 0)
+            fprintf(out, "regex %10llu checked, %10llu rejected: %s\n",
+                    (unsigned long long) rows[i].value[0], (unsigned long long) rows[i].value[1],
+                    rows[i].name);
+#else
+    fprintf(out, "ℹ️ Statistics are not compiled in; rebuild with -DCMS_STATS.\n");
+#endif
+}
+
+// Dumps the statistics to standard error at exit when CMS_STATS_DUMP is set to a nonzero
+// number
+void stats_dump_at_exit(void)
+{
+    const char *env = getenv("CMS_STATS_DUMP");
+    if (env && atoi(env) != 0)
+        stats_print(stderr);
+}
+
+// ----------------- Binary snapshot -----------------
+
+// Rounds a section size up to the 8-byte alignment sections start on
+static uint64_t snapshot_align(uint64_t n)
+{
+    return (n + 7u) & ~(uint64_t) 7u;
+}
+
+// Folds 'n' bytes into a running checksum, a word at a time (FNV-1a over 64-bit words).
+// Sections are 8-byte multiples, so feeding them one by one equals hashing the whole body.
+static uint64_t snapshot_checksum(uint64_t h, const void *data, size_t n)
+{
+    const unsigned char *p = data;
+    for (; n >= 8; p += 8, n -= 8)
+    {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        h = (h ^ w) * 1099511628211u;
+    }
+    for (; n > 0; p++, n--)
+        h = (h ^ *p) * 1099511628211u;
+    return h;
+}
+
+// Flushes a file's data to stable storage (0 = ok)
+static int file_sync(FILE *file)
+{
+    if (fflush(file) != 0)
+        return -1;
+#ifndef _WIN32
+    uint64_t started = stats_start();
+    int result = fsync(fileno(file));
+    stats_stop(STAT_SYNC, started);
+    return result;
+#else
+    return 0;
+#endif
+}
+
+// Reads the size and modification time (ns) of a file; returns 0 on success
+static int file_stamp(const char *path, uint64_t *size, uint64_t *mtime)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return -1;
+    *size = (uint64_t) st.st_size;
+#ifndef _WIN32
+    *mtime = (uint64_t) st.st_mtim.tv_sec * 1000000000u + (uint64_t) st.st_mtim.tv_nsec;
+#else
+    *mtime = (uint64_t) st.st_mtime * 1000000000u;
+#endif
+    return 0;
+}
+
+
+// Writes a store (records, compacted arena, name index) to SNAPSHOT_PATH, stamped with the
+// size and time of the CSV saved with it so a hand-edited contacts.txt wins on load, and
+// with the last journal sequence number it contains.
+// The file is written under a temporary name and renamed, so a mapped snapshot stays valid.
+// With save_compressed() it is gzipped; loading then inflates it instead of mapping it.
+// Returns 0 on success, -1 on failure (any old snapshot no longer matches and is ignored)
+int save_snapshot(const ContactStore *s, uint64_t seq, uint64_t source_size,
+                  uint64_t source_mtime)
+{
+    const char *tmpp = SNAPSHOT_PATH ".tmp"; // Temporary file path
+    const HashIndex *ix = &s->index[FIELD_NAME];
+
+    SnapshotHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    hdr.version = SNAPSHOT_VERSION;
+    hdr.record_size = (uint32_t) sizeof(Contact);
+    hdr.count = s->count;
+    hdr.arena_bytes = s->arena.data ? s->arena.used : 0;
+    hdr.index_buckets = ix->capacity;
+    hdr.index_used = ix->used;
+    hdr.source_size = source_size;
+    hdr.source_mtime = source_mtime;
+    hdr.journal_seq = seq;
+    hdr.last_id = s->last_id;
+    if (s->view.active)
+    {
+        hdr.view_count = s->view.count;
+        hdr.view_spec = s->view.spec;
+    }
+
+    FILE *file = fopen(tmpp, "wb");
+    if (!file)
+        return -1;
+
+    // The blob's last partial word goes out zero-padded, keeping every section word-aligned
+    size_t whole = (size_t) (hdr.arena_bytes & ~(uint64_t) 7u);
+    char tail[8] = {0};
+    if (hdr.arena_bytes > whole)
+        memcpy(tail, s->arena.data + whole, (size_t) hdr.arena_bytes - whole);
+
+    // Likewise the view's last position when there is an odd number of them
+    size_t pairs = (size_t) (hdr.view_count & ~(uint64_t) 1u);
+    uint32_t last[2] = {hdr.view_count > pairs ? s->view.order[pairs] : 0, 0};
+
+    const void *sections[] = {s->items,  s->arena.data, tail, ix->slots,
+                              ix->hashes, s->view.order, last};
+    size_t sizes[] = {s->count * sizeof(Contact), whole,
+                      hdr.arena_bytes > whole ? sizeof(tail) : 0,
+                      ix->capacity * sizeof(uint32_t), ix->capacity * sizeof(uint32_t),
+                      pairs * sizeof(uint32_t), hdr.view_count > pairs ? sizeof(last) : 0};
+    size_t n = sizeof(sections) / sizeof(sections[0]);
+
+    // The checksum goes in the header, so it is computed before anything is written; a
+    // compressed stream cannot be patched afterwards
+    uint64_t h = 14695981039346656037u; // FNV offset basis
+    for (size_t i = 0; i < n; i++)
+        if (sizes[i])
+            h = snapshot_checksum(h, sections[i], sizes[i]);
+    hdr.checksum = h;
+
+    OutBuf out;
+    outbuf_init(&out, file, save_compressed());
+    outbuf_put(&out, (const char *) &hdr, sizeof(hdr));
+    for (size_t i = 0; i < n; i++)
+        if (sizes[i])
+            outbuf_put(&out, sections[i], sizes[i]);
+    int failed = outbuf_finish(&out) != 0;
+    failed = failed || file_sync(file) != 0;
+    failed = fclose(file) != 0 || failed;
+
+#ifdef _WIN32
+    remove(SNAPSHOT_PATH); // rename() does not replace existing files on Windows
+#endif
+    if (failed || rename(tmpp, SNAPSHOT_PATH) != 0)
+    {
+        remove(tmpp);
+        return -1;
+    }
+    return 0;
+}
+
+// Loads the store from SNAPSHOT_PATH in one mapping: records, arena and name index are used
+// in place (copy-on-write), so startup does no parsing, validation or index building.
+// The snapshot is only used when its stamp matches contacts.txt and its checksum is intact.
+// Returns 0 if loaded ('*seq' = last journal entry it contains), -1 if there is no usable
+// snapshot (the store is left empty)
+int load_snapshot(uint64_t *seq)
+{
+    uint64_t size, mtime;
+    if (file_stamp(CONTACTS_PATH, &size, &mtime) != 0)
+        return -1; // No CSV: start fresh, as before snapshots existed
+
+    MappedFile mf;
+    if (map_file_private(SNAPSHOT_PATH, &mf) != 0)
+        return -1;
+
+    const char *reason = NULL;
+    SnapshotHeader hdr;
+    uint64_t records = 0, blob = 0, buckets = 0, view = 0;
+    if (mf.size < sizeof(hdr))
+        reason = "truncated header";
+    else
+    {
+        memcpy(&hdr, mf.data, sizeof(hdr));
+        records = hdr.count * sizeof(Contact);
+        blob = snapshot_align(hdr.arena_bytes);
+        buckets = hdr.index_buckets * sizeof(uint32_t);
+        view = snapshot_align(hdr.view_count * sizeof(uint32_t));
+        if (memcmp(hdr.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+            reason = "not a snapshot";
+        else if (hdr.version != SNAPSHOT_VERSION || hdr.record_size != sizeof(Contact))
+            reason = "unsupported version";
+        else if (hdr.source_size != size || hdr.source_mtime != mtime)
+            reason = ""; // contacts.txt was changed after the snapshot: reload it quietly
+        else if (hdr.count > UINT32_MAX || hdr.arena_bytes > UINT32_MAX ||
+                 hdr.index_buckets > UINT32_MAX || hdr.index_used != hdr.count ||
+                 (hdr.index_buckets & (hdr.index_buckets - 1)) != 0 ||
+                 (hdr.count && hdr.index_buckets == 0) || hdr.view_count > hdr.count ||
+                 (hdr.view_count && hdr.view_spec.count == 0) ||
+                 mf.size != sizeof(hdr) + records + blob + 2 * buckets + view)
+            reason = "inconsistent sizes";
+        else if (hdr.view_spec.count && !sort_spec_valid(&hdr.view_spec))
+            reason = "unknown sort key";
+        else if (snapshot_checksum(14695981039346656037u, mf.data + sizeof(hdr),
+                                   mf.size - sizeof(hdr)) != hdr.checksum)
+            reason = "checksum mismatch";
+        else if (hdr.arena_bytes && mf.data[sizeof(hdr) + records] != '\0')
+            reason = "bad string blob";
+    }
+
+    if (reason)
+    {
+        if (*reason)
+            printf("⚠️ Ignoring %s (%s); loading %s.\n", SNAPSHOT_PATH, reason, CONTACTS_PATH);
+        unmap_file(&mf);
+        return -1;
+    }
+
+    store_free(); // Start from an empty store
+    store_snapshot = mf;
+    char *base = (char *) mf.data + sizeof(hdr);
+    HashIndex *ix = &cur_store()->index[FIELD_NAME];
+    cur_store()->items = hdr.count ? (Contact *) base : NULL;
+    cur_store()->count = cur_store()->capacity = (size_t) hdr.count;
+    cur_store()->arena.data = hdr.arena_bytes ? base + records : NULL;
+    cur_store()->arena.used = cur_store()->arena.capacity = (size_t) hdr.arena_bytes;
+    ix->slots = hdr.index_buckets ? (uint32_t *) (base + records + blob) : NULL;
+    ix->hashes = hdr.index_buckets ? (uint32_t *) (base + records + blob + buckets) : NULL;
+    ix->capacity = (size_t) hdr.index_buckets;
+    ix->used = (size_t) hdr.index_used;
+    cur_store()->last_id = hdr.last_id; // The ID index is built on first use
+    *seq = hdr.journal_seq;
+
+    // The view is copied out of the mapping: it grows and shrinks with the store
+    SortedView *v = &cur_store()->view;
+    if (hdr.view_spec.count)
+    {
+        v->order = malloc(hdr.view_count ? hdr.view_count * sizeof(uint32_t) : 1);
+        if (!v->order)
+        {
+            printf("❌ Out of memory: cannot keep the sort order of %zu contacts.\n",
+                   cur_store()->count);
+            return 0; // The contacts are loaded; only the order is lost
+        }
+        if (hdr.view_count)
+            memcpy(v->order, base + records + blob + 2 * buckets,
+                   (size_t) hdr.view_count * sizeof(uint32_t));
+        v->count = v->capacity = (size_t) hdr.view_count;
+        v->spec = hdr.view_spec;
+        v->active = 1;
+    }
+    return 0;
+}
+
+// ----------------- File save/load -----------------
+
+// Writes a checkpoint of cp->copy: the CSV to contacts.tmp, then the snapshot stamped with
+// that file, then contacts.tmp is renamed over contacts.txt (rename keeps size and mtime).
+// At every crash point the files on disk plus the journal still describe the latest state.
+// Runs on the background compaction thread, so it must not print or touch the live store.
+// Returns 0 on success, 1 if only the snapshot failed, -1 if the temp file cannot be opened,
+// -2 if it cannot be renamed into place, -3 if writing it failed
+static int checkpoint_write(Checkpoint *cp)
+{
+    const ContactStore *s = &cp->copy;
+    int compress = save_compressed();
+    FILE *file = fopen(CSV_TMP_PATH, compress ? "wb" : "w"); // Open temp file for writing
+    if (!file)
+        return -1;
+
+    OutBuf out;
+    outbuf_init(&out, file, compress);
+    if (s->last_id) // "#last-id 42": IDs of deleted contacts are not handed out again
+    {
+        outbuf_puts(&out, "#last-id ");
+        outbuf_u64(&out, s->last_id);
+        outbuf_puts(&out, "\n");
+    }
+    if (s->view.active) // "#sort domain,name": the order to keep after loading the file
+    {
+        outbuf_puts(&out, "#sort ");
+        for (size_t k = 0; k < s->view.spec.count; k++)
+        {
+            outbuf_puts(&out, k ? "," : "");
+            outbuf_puts(&out, sort_key_name((SortField) s->view.spec.keys[k]));
+        }
+        outbuf_puts(&out, "\n");
+    }
+    for (size_t i = 0; i < s->count; i++)
+    {
+        const Contact *c = &s->items[i];
+        // Write contact to file in CSV format: "name, phone, email, id"
+        outbuf_put(&out, s->arena.data + c->off[FIELD_NAME], c->len[FIELD_NAME]);
+        outbuf_puts(&out, ", ");
+        outbuf_put(&out, s->arena.data + c->off[FIELD_PHONE], c->len[FIELD_PHONE]);
+        outbuf_puts(&out, ", ");
+        outbuf_put(&out, s->arena.data + c->off[FIELD_EMAIL], c->len[FIELD_EMAIL]);
+        outbuf_puts(&out, ", ");
+        outbuf_u64(&out, c->id);
+        outbuf_puts(&out, "\n");
+    }
+    int failed = outbuf_finish(&out) != 0;
+    failed = failed || file_sync(file) != 0;
+    failed = fclose(file) != 0 || failed; // Close the temp file
+    if (failed)
+    {
+        remove(CSV_TMP_PATH);
+        return -3;
+    }
+
+    int result = 0;
+    if (file_stamp(CSV_TMP_PATH, &cp->size, &cp->mtime) != 0 ||
+        save_snapshot(s, cp->seq, cp->size, cp->mtime) != 0)
+        result = 1; // The stale snapshot will not match the new CSV and is ignored
+
+    // Replace original file with temp file
+#ifdef _WIN32
+    remove(CONTACTS_PATH); // rename() does not replace existing files on Windows
+#endif
+    if (rename(CSV_TMP_PATH, CONTACTS_PATH) != 0)
+        return -2;
+    return result;
+}
+
+// Saves contacts to a file
+// Returns 0 if the files now hold every contact (also when nothing changed), -1 if the
+// save failed (the store stays dirty for the next attempt)
+int save_contacts()
+{
+    journal_finish(); // A background save must not write the same files
+    if (!cur_store()->dirty)
+    {
+        printf("ℹ️ No changes to save.\n"); // Files already match the store
+        return 0;
+    }
+
+    uint64_t started = stats_start();
+    // Fields were sanitized when they were added or changed, so records are written as is
+    store_purge();      // Drop the slots of deleted contacts
+    store_compact();    // Reclaim arena space left behind by edits and deletes
+
+    Checkpoint cp = {.copy = *cur_store(), .seq = journal.seq}; // Writes the live store directly
+    int result = checkpoint_write(&cp);
+    cur_store()->dirty = result < 0; // A failed save is tried again by the next one
+    if (result == -1)
+        printf("❌ Error opening temp file.\n"); // Handle file open failure
+    else if (result == -3)
+        printf("❌ Error writing temp file.\n"); // Handle write failure
+    else if (result == -2)
+        printf("❌ Error finalizing save.\n"); // Handle rename failure
+    else
+    {
+        printf("✅ Contacts saved successfully to file!\n"); // Success message
+        if (result == 1)
+            printf("⚠️ Could not write %s; the next start will parse %s.\n", SNAPSHOT_PATH,
+                   CONTACTS_PATH);
+        journal_rebase(cp.seq, cp.size, cp.mtime, UINT64_MAX); // Everything is in the files
+        store_report_memory();
+    }
+    stats_stop(STAT_SAVE, started);
+    return result < 0 ? -1 : 0;
+}
+
+//---------------------- Load contacts------------------------
+
+// Maps a whole file (or reads it into memory where mmap is unavailable). A writable mapping
+// is private: writes stay in this process and never reach the file.
+// Returns 0 on success, -1 if the file cannot be opened or read
+static int map_file_raw(const char *path, MappedFile *mf, int writable)
+{
+    mf->data = NULL;
+    mf->size = 0;
+    mf->mapped = 0;
+
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size > 0)
+    {
+        int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+        void *data = mmap(NULL, (size_t) st.st_size, prot, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            if (!writable)
+                posix_madvise(data, (size_t) st.st_size, POSIX_MADV_SEQUENTIAL); // Forward scan
+            mf->data = data;
+            mf->size = (size_t) st.st_size;
+            mf->mapped = 1;
+        }
+    }
+    close(fd); // The mapping stays valid after close
+    if (mf->mapped || st.st_size == 0)
+        return 0;
+    // mmap failed (e.g. special file): fall through to buffered reads
+#endif
+
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return -1;
+
+    size_t capacity = 0;
+    char block[1 << 16]; // Buffered reads in 64 KiB blocks
+    size_t n;
+    while ((n = fread(block, 1, sizeof(block), file)) > 0)
+    {
+        if (mf->size + n > capacity)
+        {
+            size_t grown = capacity ? capacity * 2 : sizeof(block);
+            while (grown < mf->size + n)
+                grown *= 2;
+            char *data = realloc((char *) mf->data, grown);
+            if (!data)
+            {
+                free((char *) mf->data);
+                fclose(file);
+                mf->data = NULL;
+                mf->size = 0;
+                return -1;
+            }
+            mf->data = data;
+            capacity = grown;
+        }
+        memcpy((char *) mf->data + mf->size, block, n);
+        mf->size += n;
+    }
+    fclose(file);
+    return 0;
+}
+
+// 1 if a buffer starts with the gzip magic bytes
+static int is_gzip(const char *data, size_t size)
+{
+    return size >= 2 && (unsigned char) data[0] == 0x1f && (unsigned char) data[1] == 0x8b;
+}
+
+#ifdef HAVE_ZLIB
+// Replaces a gzip file's contents with the inflated data (every concatenated member) in a
+// heap buffer. Returns 0 on success, -1 if the data is damaged or memory runs out (the file
+// is left as it was).
+static int gunzip_file(MappedFile *mf)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK) // 15 + 16: largest window, gzip wrapper
+        return -1;
+
+    const unsigned char *in = (const unsigned char *) mf->data;
+    size_t in_left = mf->size, len = 0;
+    size_t capacity = mf->size <= SIZE_MAX / 4 ? mf->size * 4 : mf->size;
+    char *data = malloc(capacity);
+    int result = data ? 0 : -1;
+    while (result == 0)
+    {
+        if (zs.avail_in == 0 && in_left) // zlib counts in uInt: feed at most 1 GiB at a time
+        {
+            zs.next_in = (Bytef *) in;
+            zs.avail_in = in_left > (1u << 30) ? 1u << 30 : (uInt) in_left;
+            in += zs.avail_in;
+            in_left -= zs.avail_in;
+        }
+        if (len == capacity)
+        {
+            char *grown = capacity <= SIZE_MAX / 2 ? realloc(data, capacity * 2) : NULL;
+            if (!grown)
+            {
+                result = -1;
+                break;
+            }
+            data = grown;
+            capacity *= 2;
+        }
+        size_t room = capacity - len;
+        zs.next_out = (Bytef *) data + len;
+        zs.avail_out = room > (1u << 30) ? 1u << 30 : (uInt) room;
+        uInt offered = zs.avail_out;
+        int ret = inflate(&zs, Z_NO_FLUSH);
+        len += offered - zs.avail_out;
+
+        if (ret == Z_STREAM_END)
+        {
+            if (zs.avail_in == 0 && in_left == 0)
+                break; // Last member done
+            inflateReset(&zs); // Next member
+        }
+        else if (ret != Z_OK && (ret != Z_BUF_ERROR || (zs.avail_in == 0 && in_left == 0)))
+            result = -1; // Damaged or truncated
+    }
+    inflateEnd(&zs);
+
+    if (result != 0)
+    {
+        free(data);
+        return -1;
+    }
+    unmap_file(mf);
+    mf->data = data;
+    mf->size = len;
+    mf->mapped = 0;
+    return 0;
+}
+#endif
+
+// map_file_raw(), then transparently inflates a gzip file into memory
+// Returns 0 on success, -1 if the file cannot be read, -2 if it is compressed and cannot be
+// inflated (damaged, out of memory, or built without zlib)
+static int map_file_mode(const char *path, MappedFile *mf, int writable)
+{
+    uint64_t started = stats_start();
+    if (map_file_raw(path, mf, writable) != 0)
+        return -1;
+    stats_count(STAT_BYTES_READ, mf->size);
+    int result = 0;
+    if (is_gzip(mf->data, mf->size))
+    {
+        result = -2;
+#ifdef HAVE_ZLIB
+        if (gunzip_file(mf) == 0)
+            result = 0;
+#endif
+        if (result != 0)
+            unmap_file(mf);
+    }
+    stats_stop(STAT_READ, started);
+    return result;
+}
+
+// Maps a whole file read-only for a forward scan (see map_file_mode)
+int map_file(const char *path, MappedFile *mf)
+{
+    return map_file_mode(path, mf, 0);
+}
+
+// Maps a whole file copy-on-write, so its contents can be used as live store memory
+int map_file_private(const char *path, MappedFile *mf)
+{
+    return map_file_mode(path, mf, 1);
+}
+
+// Releases a file obtained with map_file()
+void unmap_file(MappedFile *mf)
+{
+#ifndef _WIN32
+    if (mf->mapped)
+        munmap((void *) mf->data, mf->size);
+    else
+#endif
+        free((char *) mf->data);
+    mf->data = NULL;
+    mf->size = 0;
+    mf->mapped = 0;
+}
+
+// ----------------- Parallel loading -----------------
+
+// Appends formatted text to a buffer; output is dropped if memory runs out
+static void text_printf(TextBuffer *t, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+        return;
+
+    if (t->len + (size_t) n + 1 > t->capacity)
+    {
+        size_t capacity = t->capacity ? t->capacity : 256;
+        while (capacity < t->len + (size_t) n + 1)
+            capacity *= 2;
+        char *data = realloc(t->data, capacity);
+        if (!data)
+            return;
+        t->data = data;
+        t->capacity = capacity;
+    }
+
+    va_start(ap, fmt);
+    vsnprintf(t->data + t->len, (size_t) n + 1, fmt, ap);
+    va_end(ap);
+    t->len += (size_t) n;
+}
+
+// Returns the worker thread count: worker_threads if set, else CMS_THREADS, else core count
+int worker_count(void)
+{
+    int n = worker_threads;
+    if (n <= 0)
+    {
+        const char *env = getenv("CMS_THREADS");
+        n = env ? atoi(env) : 0;
+    }
+#ifndef _WIN32
+    if (n <= 0)
+        n = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (n <= 0)
+        n = 1;
+    return n > MAX_WORKER_THREADS ? MAX_WORKER_THREADS : n;
+}
+
+// Appends a contact built from field slices to a batch, sanitized in the batch's arena
+// Returns the contact, or NULL on out-of-memory (batch marked and left unchanged)
+static Contact *batch_add(LoadBatch *b, const char *name, size_t name_len, const char *phone,
+                          size_t phone_len, const char *email, size_t email_len)
+{
+    if (b->count == b->capacity)
+    {
+        size_t capacity = b->capacity ? b->capacity * 2 : STORE_INITIAL_CAPACITY;
+        Contact *items = realloc(b->items, capacity * sizeof(Contact));
+        if (!items)
+        {
+            b->out_of_memory = 1;
+            return NULL;
+        }
+        b->items = items;
+        b->capacity = capacity;
+    }
+
+    if (name_len > MAX_NAME_LENGTH - 1)
+        name_len = MAX_NAME_LENGTH - 1;
+    if (phone_len > MAX_PHONE_LENGTH - 1)
+        phone_len = MAX_PHONE_LENGTH - 1;
+    if (email_len > MAX_EMAIL_LENGTH - 1)
+        email_len = MAX_EMAIL_LENGTH - 1;
+
+    size_t mark = b->arena.used;
+    Contact *c = &b->items[b->count];
+    c->flags = 0;
+    c->id = 0;                // Set by the caller from a file's ID column, if any
+    if (arena_store(&b->arena, name, name_len, &c->off[FIELD_NAME], &c->len[FIELD_NAME]) != 0 ||
+        arena_store(&b->arena, phone, phone_len, &c->off[FIELD_PHONE], &c->len[FIELD_PHONE]) != 0 ||
+        arena_store(&b->arena, email, email_len, &c->off[FIELD_EMAIL], &c->len[FIELD_EMAIL]) != 0)
+    {
+        if (mark)
+            b->arena.used = mark;
+        b->out_of_memory = 1;
+        return NULL;
+    }
+    b->count++;
+
+    static char empty[1] = ""; // Arena is still unallocated only if every field was blank
+    sanitize_contact(b->arena.data ? b->arena.data : empty, c);
+    return c;
+}
+
+// Validates a batch contact's fields with the bulk-path validators
+static int batch_contact_valid(const LoadBatch *b, const Contact *c)
+{
+    const char *base = b->arena.data ? b->arena.data : "";
+    return validate_field(FIELD_NAME, base + c->off[FIELD_NAME], c->len[FIELD_NAME]) &&
+           validate_field(FIELD_PHONE, base + c->off[FIELD_PHONE], c->len[FIELD_PHONE]) &&
+           validate_field(FIELD_EMAIL, base + c->off[FIELD_EMAIL], c->len[FIELD_EMAIL]);
+}
+
+// Drops the last contact of a batch and rewinds its arena to 'mark'
+static void batch_rollback(LoadBatch *b, size_t mark)
+{
+    if (b->count == 0)
+        return;
+    b->count--;
+    if (b->count < b->revs_len)
+        b->revs[b->count] = 0; // The slot's next contact may have no REV
+    if (mark)
+        b->arena.used = mark;
+}
+
+// Records the REV of the batch's last contact; contacts without one read as 0
+static void batch_set_rev(LoadBatch *b, uint64_t rev)
+{
+    size_t i = b->count - 1;
+    if (i >= b->revs_len)
+    {
+        uint64_t *revs = realloc(b->revs, b->capacity * sizeof(uint64_t));
+        if (!revs)
+        {
+            b->out_of_memory = 1;
+            return;
+        }
+        memset(revs + b->revs_len, 0, (b->capacity - b->revs_len) * sizeof(uint64_t));
+        b->revs = revs;
+        b->revs_len = b->capacity;
+    }
+    b->revs[i] = rev;
+}
+
+// Releases a batch's buffers
+static void batch_free(LoadBatch *b)
+{
+    free(b->items);
+    free(b->arena.data);
+    free(b->revs);
+    free(b->log.data);
+}
+
+// Runs a batch's parser over its chunk
+static void batch_parse(LoadBatch *b)
+{
+    uint64_t started = stats_start();
+    b->parse(b);
+    stats_stop(STAT_PARSE, started);
+}
+
+#ifndef _WIN32
+// Thread entry point: parses one batch
+static void *batch_worker(void *arg)
+{
+    batch_parse(arg);
+    return NULL;
+}
+#endif
+
+// Returns the contact a card duplicates: the one with the same name (case-insensitive), or
+// failing that the one with the same phone number (E.164) and email. -1 if there is none.
+static long import_find(const char *const fields[FIELD_COUNT], const HashIndex *phones)
+{
+    long pos = store_find_name(fields[FIELD_NAME]);
+    if (pos >= 0)
+        return pos;
+
+    size_t email_len = strlen(fields[FIELD_EMAIL]);
+    IndexCursor cur;
+    for (pos = index_lookup(phones, fields[FIELD_PHONE], &cur); pos >= 0;
+         pos = index_next(phones, &cur))
+    {
+        const Contact *c = &cur_store()->items[pos];
+        if (c->len[FIELD_EMAIL] == email_len &&
+            ascii_caseeq(contact_email(c), fields[FIELD_EMAIL], email_len))
+            return pos;
+    }
+    return -1;
+}
+
+// Remembers the REV applied to store position 'pos' during this import (0 = ok, -1 = OOM)
+static int import_set_rev(ImportDedup *d, size_t pos, uint64_t rev)
+{
+    if (pos >= d->revs_len)
+    {
+        size_t len = cur_store()->capacity > pos ? cur_store()->capacity : pos + 1;
+        uint64_t *revs = realloc(d->revs, len * sizeof(uint64_t));
+        if (!revs)
+            return -1;
+        memset(revs + d->revs_len, 0, (len - d->revs_len) * sizeof(uint64_t));
+        d->revs = revs;
+        d->revs_len = len;
+    }
+    d->revs[pos] = rev;
+    return 0;
+}
+
+// Applies the import policy to a card that duplicates the contact at 'pos'. Contacts do not
+// store a revision, so for keep-newest one that existed before the import is older than any
+// card with a REV; among cards of the same import, the newest REV wins.
+// Returns 0 on success, -1 on out-of-memory
+static int import_resolve(ImportDedup *d, long pos, const char *const fields[FIELD_COUNT],
+                          uint64_t rev)
+{
+    ImportPolicy policy = d->policy;
+    if (policy == IMPORT_KEEP_NEWEST)
+    {
+        uint64_t current = (size_t) pos < d->revs_len ? d->revs[pos] : 0;
+        if (rev <= current)
+            policy = IMPORT_SKIP;
+        else if (import_set_rev(d, (size_t) pos, rev) != 0)
+            return -1;
+        else
+            policy = IMPORT_OVERWRITE;
+    }
+
+    int changed = 0;
+    if (policy != IMPORT_SKIP)
+    {
+        Contact *c = &cur_store()->items[pos];
+        for (int f = policy == IMPORT_MERGE ? FIELD_PHONE : FIELD_NAME; f < FIELD_COUNT; f++)
+        {
+            if (strcmp(contact_field(c, (ContactField) f), fields[f]) == 0)
+                continue; // Unchanged fields are neither rewritten nor journaled
+            if (store_set_field(c, (ContactField) f, fields[f]) != 0)
+                return -1;
+            changed = 1;
+        }
+    }
+    if (changed)
+        d->updated++;
+    else
+        d->skipped++;
+    return 0;
+}
+
+// Merges a parsed batch contact by contact, resolving duplicates through the name and phone
+// hash indexes: O(1) per card, so a re-import costs the same as the first import. New
+// contacts become visible to later cards at once, so duplicates inside the feed are caught.
+// Returns 0 on success, -1 on out-of-memory
+static int batch_merge_dedup(LoadBatch *b, ImportDedup *d)
+{
+    HashIndex *phones = store_index(FIELD_PHONE);
+    if (!phones || store_reserve(cur_store()->count + b->count) != 0 ||
+        index_reserve(&cur_store()->index[FIELD_NAME], cur_store()->count + b->count) != 0 ||
+        index_reserve(phones, cur_store()->count + b->count) != 0)
+        return -1;
+
+    const char *base = b->arena.data ? b->arena.data : "";
+    for (size_t i = 0; i < b->count; i++)
+    {
+        const Contact *in = &b->items[i];
+        const char *fields[FIELD_COUNT];
+        for (int f = 0; f < FIELD_COUNT; f++)
+            fields[f] = base + in->off[f];
+        uint64_t rev = i < b->revs_len ? b->revs[i] : 0;
+
+        long pos = import_find(fields, phones);
+        if (pos >= 0)
+        {
+            if (import_resolve(d, pos, fields, rev) != 0)
+                return -1;
+            continue;
+        }
+
+        if (!store_add_slices(fields[FIELD_NAME], in->len[FIELD_NAME], fields[FIELD_PHONE],
+                              in->len[FIELD_PHONE], fields[FIELD_EMAIL], in->len[FIELD_EMAIL]))
+            return -1;
+        d->inserted++;
+        if (rev && import_set_rev(d, cur_store()->count - 1, rev) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+// Moves a parsed batch into the store: one arena copy, rebased offsets, index updates
+// Returns 0 on success, -1 on out-of-memory
+static int batch_merge(LoadBatch *b)
+{
+    size_t bytes = b->arena.used > 1 ? b->arena.used - 1 : 0; // Skip the batch's empty string
+    if (store_reserve(cur_store()->count + b->count) != 0 || store_reserve_arena(bytes) != 0 ||
+        index_reserve(&cur_store()->index[FIELD_NAME], cur_store()->count + b->count) != 0)
+        return -1;
+
+    uint32_t base = (uint32_t) cur_store()->arena.used - 1; // Batch offset 1 lands at the arena end
+    if (bytes)
+        memcpy(cur_store()->arena.data + cur_store()->arena.used, b->arena.data + 1, bytes);
+    cur_store()->arena.used += bytes;
+
+    for (size_t i = 0; i < b->count; i++)
+    {
+        Contact *c = &cur_store()->items[cur_store()->count];
+        *c = b->items[i];
+        for (int f = 0; f < FIELD_COUNT; f++)
+            if (c->len[f])
+                c->off[f] += base;
+        cur_store()->count++;
+        if (indexes_insert((uint32_t) (cur_store()->count - 1)) != 0)
+        {
+            indexes_erase((uint32_t) (cur_store()->count - 1));
+            cur_store()->count--;
+            return -1;
+        }
+        cur_store()->dirty = 1;
+        journal_add(c); // Imports are journaled; the startup load is not
+    }
+    return 0;
+}
+
+// Splits [data, data + size) into chunks at boundaries found by next_boundary(), parses them
+// on worker threads, then merges the results in file order so the store, the warnings and
+// the counts are identical to a serial parse. Chunks are at least 'min_chunk' bytes.
+// Returns the number of contacts added, or -1 if memory ran out part way (what was merged
+// before that point is kept). '*rejected' receives the number of records that failed
+// validation in the merged chunks. With 'dedup', cards that duplicate a contact are
+// resolved by its policy instead of appended (see batch_merge_dedup()).
+long load_parallel(const char *data, size_t size, size_t min_chunk,
+                   const char *(*next_boundary)(const char *p, const char *end),
+                   void (*parse)(LoadBatch *b), size_t *rejected, ImportDedup *dedup)
+{
+    int threads = worker_count();
+    if ((size_t) threads > size / min_chunk)
+        threads = (int) (size / min_chunk);
+    if (threads < 1)
+        threads = 1;
+
+    LoadBatch *batches = calloc((size_t) threads, sizeof(LoadBatch));
+    if (!batches)
+    {
+        printf("❌ Out of memory: cannot allocate load batches.\n");
+        return -1;
+    }
+
+    // Cut the input into roughly equal chunks, moving each cut forward to a boundary
+    const char *p = data, *end = data + size;
+    int n = 0;
+    for (int t = 0; t < threads && p < end; t++)
+    {
+        const char *cut = data + size / (size_t) threads * (size_t) (t + 1);
+        if (t == threads - 1)
+            cut = end; // Last chunk takes the remainder
+        if (cut < p)
+            cut = p;
+        cut = (cut >= end) ? end : next_boundary(cut, end);
+        batches[n].begin = p;
+        batches[n].end = cut;
+        batches[n].parse = parse;
+        n++;
+        p = cut;
+    }
+
+#ifndef _WIN32
+    pthread_t tids[MAX_WORKER_THREADS];
+    int started[MAX_WORKER_THREADS] = {0};
+    for (int t = 1; t < n; t++)
+        started[t] = pthread_create(&tids[t], NULL, batch_worker, &batches[t]) == 0;
+    if (n > 0)
+        batch_parse(&batches[0]); // The calling thread takes the first chunk
+    for (int t = 1; t < n; t++)
+    {
+        if (started[t])
+            pthread_join(tids[t], NULL);
+        else
+            batch_parse(&batches[t]); // Could not start a thread: parse inline
+    }
+#else
+    for (int t = 0; t < n; t++)
+        batch_parse(&batches[t]);
+#endif
+
+    size_t before = cur_store()->count;
+    int failed = 0;
+    *rejected = 0;
+    for (int t = 0; t < n; t++)
+    {
+        LoadBatch *b = &batches[t];
+        if (!failed)
+        {
+            if (b->log.len)
+                fputs(b->log.data, stdout); // Warnings in file order
+            if ((dedup ? batch_merge_dedup(b, dedup) : batch_merge(b)) != 0 ||
+                b->out_of_memory)
+                failed = 1; // Later chunks would leave a gap, so drop them
+            *rejected += b->rejected;
+        }
+        batch_free(b);
+    }
+    free(batches);
+    return failed ? -1 : (long) (cur_store()->count - before);
+}
+
+// Returns the start of the line after the one containing 'p'
+static const char *next_line(const char *p, const char *end)
+{
+    const char *nl = memchr(p, '\n', (size_t) (end - p));
+    return nl ? nl + 1 : end;
+}
+
+// One logical vCard content line, "[group.]NAME[;params]:value", possibly folded over
+// several physical lines (RFC 6350 3.2: a line break followed by a space or tab)
+typedef struct
+{
+    const char *name;   // Property name, without the group prefix
+    size_t name_len;    // Length of 'name'
+    const char *params; // Parameters after the name, without the leading ';'
+    size_t params_len;  // Length of 'params' (0 if none)
+    const char *value;  // Raw value after ':' (folds and escapes still in place)
+    const char *end;    // End of the logical line (the last physical line's '\n' or '\r')
+} VcardLine;
+
+// Returns 1 if the physical line starting at 'p' continues the previous one
+static int vcard_folded(const char *p, const char *end)
+{
+    return p < end && (*p == ' ' || *p == '\t');
+}
+
+// Splits the logical line starting at 'p' into 'line' and returns the start of the next one.
+// A line without ':' has an empty value.
+static const char *vcard_next_line(const char *p, const char *end, VcardLine *line)
+{
+    const char *next = next_line(p, end);
+    while (vcard_folded(next, end))
+        next = next_line(next, end);
+    line->end = next;
+    while (line->end > p && (line->end[-1] == '\n' || line->end[-1] == '\r'))
+        line->end--;
+
+    // Name (skipping "group."), then parameters up to the first ':' outside quotes
+    const char *q = p, *name = p;
+    while (q < line->end && *q != ';' && *q != ':')
+    {
+        if (*q == '.')
+            name = q + 1;
+        q++;
+    }
+    line->name = name;
+    line->name_len = (size_t) (q - name);
+    line->params = q < line->end && *q == ';' ? q + 1 : q;
+    int quoted = 0;
+    while (q < line->end && (quoted || *q != ':'))
+    {
+        if (*q == '"')
+            quoted = !quoted;
+        q++;
+    }
+    line->params_len = (size_t) (q - line->params);
+    line->value = q < line->end ? q + 1 : line->end;
+    return next;
+}
+
+// 1 if the property name of 'line' is 'name' (case-insensitive)
+static int vcard_is(const VcardLine *line, const char *name)
+{
+    return line->name_len == strlen(name) && ascii_caseeq(line->name, name, line->name_len);
+}
+
+// Copies component 'component' of a ';'-separated value (or all of it, if -1) into 'out',
+// removing folds and "\," "\;" "\\" "\n" escapes; stops after 'max' bytes. Escaped
+// newlines become spaces. Returns the length copied ('out' is '\0'-terminated).
+static size_t vcard_value_copy(const char *v, const char *end, int component, char *out,
+                               size_t max)
+{
+    size_t n = 0;
+    int index = 0;
+    while (v < end && n < max)
+    {
+        char ch = *v++;
+        if (ch == '\r' || ch == '\n')
+        {
+            while (v < end && (*v == '\r' || *v == '\n'))
+                v++;
+            if (vcard_folded(v, end))
+                v++; // Fold: the break and one space or tab are dropped
+            continue;
+        }
+        if (ch == ';' && component >= 0)
+        {
+            if (index++ == component)
+                break;
+            continue;
+        }
+        if (ch == '\\' && v < end)
+        {
+            ch = *v++;
+            if (ch == 'n' || ch == 'N')
+                ch = ' ';
+        }
+        if (component < 0 || index == component)
+            out[n++] = ch;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+// 1 if a parameter list marks its property as preferred ("TYPE=pref" or "PREF=1")
+static int vcard_preferred(const VcardLine *line)
+{
+    return ascii_find_lower(line->params, line->params_len, "pref", 4) != NULL;
+}
+
+// Value chosen so far for one field of the card being parsed
+typedef struct
+{
+    char text[MAX_EMAIL_LENGTH]; // Unfolded, unescaped value
+    size_t len;                  // Length of 'text'
+    int valid;                   // 1 if 'text' passes the field's validation
+    int preferred;               // 1 if the property carried a PREF parameter
+    int set;                     // 1 once a value was seen
+} VcardField;
+
+// Offers one more value for a field. Of several TEL or EMAIL lines, the card keeps a
+// preferred valid value, else the first valid one, else the first one seen.
+static void vcard_offer(VcardField *f, ContactField field, const VcardLine *line, int component,
+                        int preferred)
+{
+    static const size_t max_len[FIELD_COUNT] = {MAX_NAME_LENGTH - 1, MAX_PHONE_LENGTH - 1,
+                                                MAX_EMAIL_LENGTH - 1};
+    char text[MAX_EMAIL_LENGTH];
+    size_t len = vcard_value_copy(line->value, line->end, component, text, max_len[field]);
+
+    size_t start = 0, stop = len; // Validate the value as it will be stored: trimmed
+    while (start < stop && isspace((unsigned char) text[start]))
+        start++;
+    while (stop > start && isspace((unsigned char) text[stop - 1]))
+        stop--;
+    int valid = validate_field(field, text + start, stop - start);
+
+    if (f->set && (f->valid > valid || (f->valid == valid && (f->preferred || !preferred))))
+        return; // Keep the current value
+    memcpy(f->text, text, len + 1);
+    f->len = len;
+    f->valid = valid;
+    f->preferred = preferred;
+    f->set = 1;
+}
+
+// Reads a REV value ("2024-01-15T10:30:00Z", "20240115T103000Z" or a bare date) as the
+// number YYYYMMDDhhmmss, so later revisions compare greater. Returns 0 if there is no date.
+static uint64_t vcard_rev(const VcardLine *line)
+{
+    char text[32];
+    size_t len = vcard_value_copy(line->value, line->end, -1, text, sizeof(text) - 1);
+    uint64_t rev = 0;
+    int digits = 0;
+    for (size_t i = 0; i < len && digits < 14; i++)
+    {
+        if (text[i] >= '0' && text[i] <= '9')
+        {
+            rev = rev * 10 + (uint64_t) (text[i] - '0');
+            digits++;
+        }
+    }
+    if (digits < 8)
+        return 0;
+    for (; digits < 14; digits++)
+        rev *= 10; // Missing time of day counts as midnight
+    return rev;
+}
+
+// Returns the start of the line after the next "END:VCARD" line at or after 'p', so chunks
+// always hold whole cards
+static const char *next_card(const char *p, const char *end)
+{
+    p = next_line(p, end); // 'p' may be mid-line
+    while (p < end)
+    {
+        const char *next = next_line(p, end);
+        if (end - p >= 9 && ascii_caseeq(p, "END:VCARD", 9))
+            return next;
+        p = next;
+    }
+    return end;
+}
+
+// Parses the vCards of one chunk with the tokenizer above: FN (or N when a card has no FN),
+// TEL and EMAIL fill the fields of the current card, REV is kept for keep-newest imports,
+// END:VCARD stores it if every field validates. Other properties are ignored.
+static void parse_vcard_chunk(LoadBatch *b)
+{
+    VcardField fields[FIELD_COUNT];
+    VcardField family_first; // "Given Family" built from N, used when there is no FN
+    uint64_t rev = 0; // REV of the current card
+    memset(fields, 0, sizeof(fields));
+    memset(&family_first, 0, sizeof(family_first));
+
+    const char *p = b->begin;
+    while (p < b->end)
+    {
+        VcardLine line;
+        p = vcard_next_line(p, b->end, &line);
+
+        if (vcard_is(&line, "FN")) // Full name line found
+            vcard_offer(&fields[FIELD_NAME], FIELD_NAME, &line, -1, 0);
+        else if (vcard_is(&line, "N") && !family_first.set) // Structured name
+        {
+            char given[MAX_NAME_LENGTH], family[MAX_NAME_LENGTH];
+            size_t gl = vcard_value_copy(line.value, line.end, 1, given, MAX_NAME_LENGTH - 1);
+            size_t fl = vcard_value_copy(line.value, line.end, 0, family, MAX_NAME_LENGTH - 1);
+            size_t n = 0;
+            memcpy(family_first.text, given, gl);
+            n += gl;
+            if (gl && fl && n < MAX_NAME_LENGTH - 1)
+                family_first.text[n++] = ' ';
+            size_t room = MAX_NAME_LENGTH - 1 - n;
+            memcpy(family_first.text + n, family, fl < room ? fl : room);
+            n += fl < room ? fl : room;
+            family_first.text[n] = '\0';
+            family_first.len = n;
+            family_first.set = 1;
+        }
+        else if (vcard_is(&line, "TEL")) // Phone line found
+            vcard_offer(&fields[FIELD_PHONE], FIELD_PHONE, &line, -1, vcard_preferred(&line));
+        else if (vcard_is(&line, "EMAIL")) // Email line found
+            vcard_offer(&fields[FIELD_EMAIL], FIELD_EMAIL, &line, -1, vcard_preferred(&line));
+        else if (vcard_is(&line, "REV")) // Revision timestamp, for keep-newest imports
+            rev = vcard_rev(&line);
+        else if (vcard_is(&line, "BEGIN")) // Start of a contact
+        {
+            memset(fields, 0, sizeof(fields));
+            memset(&family_first, 0, sizeof(family_first));
+            rev = 0;
+        }
+        else if (vcard_is(&line, "END")) // End of one contact
+        {
+            const VcardField *name = fields[FIELD_NAME].set ? &fields[FIELD_NAME] : &family_first;
+            size_t mark = b->arena.used; // Arena position to rewind to
+            Contact *c = batch_add(b, name->text, name->len, fields[FIELD_PHONE].text,
+                                   fields[FIELD_PHONE].len, fields[FIELD_EMAIL].text,
+                                   fields[FIELD_EMAIL].len);
+            if (!c)
+                return; // Out of memory, keep what was imported so far
+
+            if (!batch_contact_valid(b, c))
+            {
+                batch_rollback(b, mark); // Drop cards with invalid fields
+                b->rejected++;
+            }
+            else if (rev)
+                batch_set_rev(b, rev);
+
+            // Reset for next contact
+            memset(fields, 0, sizeof(fields));
+            memset(&family_first, 0, sizeof(family_first));
+            rev = 0;
+        }
+    }
+}
+
+// Returns the length of the longest prefix of [data, data + len) that ends right after an
+// "END:VCARD" line, or 0 if there is none
+static size_t vcard_complete_prefix(const char *data, size_t len)
+{
+    size_t line_end = len; // One past the '\n' of the line being looked at
+    while (line_end > 0 && data[line_end - 1] != '\n')
+        line_end--; // The last line is incomplete until its '\n' arrives
+    while (line_end > 0)
+    {
+        size_t start = line_end - 1;
+        while (start > 0 && data[start - 1] != '\n')
+            start--;
+        if (line_end - start >= 9 && ascii_caseeq(data + start, "END:VCARD", 9))
+            return line_end;
+        line_end = start;
+    }
+    return 0;
+}
+
+// Skips whitespace like the ' ' directive in a scanf format
+static const char *skip_spaces(const char *p, const char *end)
+{
+    while (p < end && isspace((unsigned char) *p))
+        p++;
+    return p;
+}
+
+// Parses an optional contact ID: up to 19 decimal digits, then nothing but whitespace.
+// A blank field is ID 0 (none). Returns 0, or -1 if the field is malformed.
+static int parse_contact_id(const char *p, const char *end, uint64_t *id)
+{
+    const char *start = p = skip_spaces(p, end);
+    uint64_t value = 0;
+    for (; p < end && *p >= '0' && *p <= '9' && p - start < 19; p++)
+        value = value * 10 + (uint64_t) (*p - '0');
+    if (skip_spaces(p, end) != end)
+        return -1;
+    *id = value;
+    return 0;
+}
+
+// Parses one "name, phone, email[, id]" line (without its '\n') into a batch, with the
+// acceptance rules the old "%49[^,], %16[^,], %253[^\n]" sscanf() had for the first three
+// Returns 1 if stored, 0 if rejected (a warning is logged), -1 on out-of-memory
+static int parse_contact_line(LoadBatch *b, const char *line, const char *end)
+{
+    int len = (int) (end - line);
+
+    // Name: 1-49 bytes up to the first comma
+    const char *comma = memchr(line, ',', (size_t) (end - line));
+    size_t name_len = comma ? (size_t) (comma - line) : (size_t) (end - line);
+    const char *phone = comma ? skip_spaces(comma + 1, end) : end;
+
+    // Phone: 1-16 bytes up to the next comma
+    const char *comma2 = comma ? memchr(phone, ',', (size_t) (end - phone)) : NULL;
+    size_t phone_len = comma2 ? (size_t) (comma2 - phone) : 0;
+    const char *email = comma2 ? skip_spaces(comma2 + 1, end) : end;
+
+    // Email: the rest of the line or up to a third comma, truncated to 253 bytes
+    const char *comma3 = comma2 ? memchr(email, ',', (size_t) (end - email)) : NULL;
+    size_t email_len = (size_t) ((comma3 ? comma3 : end) - email);
+
+    // ID: after the third comma; files written before IDs existed have none
+    uint64_t id = 0;
+    if (!comma || name_len == 0 || name_len > MAX_NAME_LENGTH - 1 || !comma2 || phone_len == 0 ||
+        phone_len > MAX_PHONE_LENGTH - 1 || email_len == 0 ||
+        (comma3 && parse_contact_id(comma3 + 1, end, &id) != 0))
+    {
+        text_printf(&b->log, "Warning: Skipping malformed line in contacts.txt: '%.*s'\n", len,
+                    line); // Handle malformed line
+        return 0;
+    }
+
+    size_t mark = b->arena.used; // Arena position to rewind to on rejection
+    Contact *c = batch_add(b, line, name_len, phone, phone_len, email, email_len);
+    if (!c)
+        return -1;
+
+    // Validate loaded data
+    if (!batch_contact_valid(b, c))
+    {
+        text_printf(&b->log, "Warning: Invalid data in line, skipping: '%.*s'\n", len, line);
+        batch_rollback(b, mark); // Skip invalid contact
+        b->rejected++;
+        return 0;
+    }
+    c->id = id; // Checked for repeats by store_assign_ids() once the whole file is in
+    return 1;
+}
+
+// Parses the contacts.txt lines of one chunk
+static void parse_contacts_chunk(LoadBatch *b)
+{
+    size_t size = (size_t) (b->end - b->begin);
+    // Failures here fall back to incremental growth
+    arena_reserve(&b->arena, size); // Strings never exceed the chunk
+    b->items = malloc((size / AVG_LINE_ESTIMATE + 1) * sizeof(Contact));
+    b->capacity = b->items ? size / AVG_LINE_ESTIMATE + 1 : 0;
+
+    // Single forward scan: split records on '\n' and parse each one in place
+    const char *p = b->begin;
+    while (p < b->end)
+    {
+        const char *nl = memchr(p, '\n', (size_t) (b->end - p));
+        const char *line_end = nl ? nl : b->end;
+        if (parse_contact_line(b, p, line_end) < 0)
+        {
+            b->out_of_memory = 1; // Keep the contacts parsed so far
+            return;
+        }
+        p = line_end + 1;
+    }
+}
+
+// Reads the property lines at the start of contacts.txt ("#last-id 42", "#sort domain,name").
+// Names start with a letter, so no contact line begins with '#'; unknown properties are
+// skipped. Returns the first contact line
+static const char *csv_properties(const char *p, const char *end, uint64_t *last_id,
+                                  SortSpec *sort)
+{
+    while (p < end && *p == '#')
+    {
+        const char *nl = memchr(p, '\n', (size_t) (end - p));
+        const char *line_end = nl ? nl : end;
+        char value[64];
+        size_t n = (size_t) (line_end - p);
+        if (n > 9 && memcmp(p, "#last-id ", 9) == 0 &&
+            parse_contact_id(p + 9, line_end, last_id) != 0)
+            printf("⚠️ Ignoring malformed last ID in %s.\n", CONTACTS_PATH);
+        if (n > 6 && n - 6 < sizeof(value) && memcmp(p, "#sort ", 6) == 0)
+        {
+            memcpy(value, p + 6, n - 6);
+            value[n - 6] = '\0';
+            trim_whitespace(value);
+            if (sort_spec_parse(value, sort) != 0)
+            {
+                printf("⚠️ Ignoring unknown sort order '%s' in %s.\n", value, CONTACTS_PATH);
+                sort->count = 0;
+            }
+        }
+        p = nl ? nl + 1 : end;
+    }
+    return p;
+}
+
+// Loads contacts from a file
+void load_contacts(void)
+{
+    uint64_t started = stats_start();
+    uint64_t seq;
+    if (load_snapshot(&seq) == 0) // Saved state is already validated and indexed
+    {
+        printf("📁 %zu contact(s) loaded from snapshot.\n", cur_store()->count);
+        store_report_memory();
+        journal_open(1, seq); // Reapply changes made after that save
+        stats_stop(STAT_LOAD, started);
+        return;
+    }
+
+    MappedFile mf;
+    int mapped = map_file(CONTACTS_PATH, &mf); // Map file for reading
+    if (mapped == -2) // Starting fresh would overwrite the file at the next save
+    {
+#ifdef HAVE_ZLIB
+        printf("❌ %s is compressed but could not be decompressed.\n", CONTACTS_PATH);
+#else
+        printf("❌ %s is compressed; rebuild with -DHAVE_ZLIB to load it.\n", CONTACTS_PATH);
+#endif
+        exit(EXIT_FAILURE);
+    }
+    if (mapped != 0)
+    {
+        printf("📂 No contacts file found. Starting fresh.\n"); // Handle missing file
+        journal_open(0, 0);
+        stats_stop(STAT_LOAD, started);
+        return;
+    }
+
+    cur_store()->count = 0; // Reset contact count
+
+    // Reserve capacity up front from the file size to avoid repeated growth while loading
+    if (mf.size > 0)
+    {
+        // Failures here fall back to incremental growth
+        store_reserve(mf.size / AVG_LINE_ESTIMATE + 1); // Records
+        store_reserve_arena(mf.size);                   // Strings never exceed the file
+        index_reserve(&cur_store()->index[FIELD_NAME], mf.size / AVG_LINE_ESTIMATE + 1);
+    }
+
+    SortSpec sort = {.count = 0};
+    uint64_t last_id = 0;
+    const char *rows =
+        mf.size ? csv_properties(mf.data, mf.data + mf.size, &last_id, &sort) : mf.data;
+
+    // Newline-aligned chunks are parsed and validated in parallel, then merged in file order
+    size_t rejected;
+    if (load_parallel(rows, mf.size - (size_t) (rows - mf.data), LOAD_MIN_CHUNK, next_line,
+                      parse_contacts_chunk, &rejected, NULL) < 0)
+        printf("⚠️ Stopped loading from file: out of memory.\n"); // Handle allocation failure
+    cur_store()->last_id = last_id; // Raised to the highest ID in the file if that is above it
+    store_assign_ids();      // Rows without an ID get one
+    if (sort.count)
+        sorted_view_restore(&sort); // The file may have been edited: sort the positions again
+
+    unmap_file(&mf);                                               // Release the file
+    printf("📁 %zu contact(s) loaded from file.\n", cur_store()->count); // Report loaded contacts
+    store_report_memory();
+    cur_store()->dirty = 1; // The records match the file, but the next save must snapshot them
+    journal_open(0, 0); // Reapply changes made after the last save
+    stats_stop(STAT_LOAD, started);
+}
+
+// ----------------- Journal -----------------
+
+// Returns the length of the intact entry at 'p' and its sequence number, or 0 if the entry
+// is truncated or fails its checksum (e.g. torn by a crash mid-write)
+static size_t journal_entry(const char *p, const char *end, uint64_t *seq)
+{
+    uint32_t size, check;
+    if (end - p < 8)
+        return 0;
+    memcpy(&size, p, sizeof(size));
+    memcpy(&check, p + 4, sizeof(check));
+    if (size < 14 || (size_t) (end - p - 8) < size || hash_key(p + 8, size) != check)
+        return 0;
+    memcpy(seq, p + 8, sizeof(*seq));
+    return 8 + (size_t) size;
+}
+
+// Appends one entry; a no-op while not journaling. A failed write turns journaling off,
+// leaving the save at exit as the only persistence. While reader threads are running the
+// entry is also kept for the other copy of the store (see StoreVersions).
+static void journal_log(JournalOp op, int arg, uint32_t pos, const Contact *c, int fields)
+{
+    if (versions.replaying)
+        return;
+    if (!journal.file && journal.unavailable)
+        journal.failed = 1; // Not logged: only the next save keeps this change
+    if (!journal.file && !versions.published)
+        return;
+
+    unsigned char buf[8 + 14 + FIELD_COUNT * (1 + 255) + sizeof(uint64_t)];
+    uint64_t seq = journal.seq + 1;
+    size_t n = 8; // Room for the size and checksum
+    memcpy(buf + n, &seq, sizeof(seq));
+    n += sizeof(seq);
+    buf[n++] = (unsigned char) op;
+    buf[n++] = (unsigned char) arg;
+    memcpy(buf + n, &pos, sizeof(pos));
+    n += sizeof(pos);
+    for (int f = 0; f < FIELD_COUNT; f++)
+    {
+        if (!(fields & (1 << f)))
+            continue;
+        buf[n++] = c->len[f];
+        memcpy(buf + n, contact_field(c, (ContactField) f), c->len[f]);
+        n += c->len[f];
+    }
+    if (op == JOURNAL_ADD_ID)
+    {
+        memcpy(buf + n, &c->id, sizeof(c->id));
+        n += sizeof(c->id);
+    }
+
+    uint32_t size = (uint32_t) (n - 8);
+    uint32_t check = hash_key((const char *) buf + 8, size);
+    memcpy(buf, &size, sizeof(size));
+    memcpy(buf + 4, &check, sizeof(check));
+    if (versions.published)
+        outbuf_put(&versions.log, (const char *) buf, n);
+    if (!journal.file)
+        return;
+    if (journal_held.active)
+    {
+        outbuf_put(&journal_held.entries, (const char *) buf, n);
+        journal.seq = seq;
+        return;
+    }
+    if (fwrite(buf, 1, n, journal.file) != n)
+    {
+        printf("⚠️ Could not write %s; changes will only be saved at exit.\n", JOURNAL_PATH);
+        fclose(journal.file);
+        journal.file = NULL;
+        journal.failed = journal.unavailable = 1;
+        return;
+    }
+    journal.seq = seq;
+    journal.bytes += n;
+    stats_count(STAT_BYTES_WRITTEN, n);
+    journal.pending++;
+}
+
+static void journal_add(const Contact *c)
+{
+    journal_log(JOURNAL_ADD_ID, 0, (uint32_t) (c - cur_store()->items), c, (1 << FIELD_COUNT) - 1);
+}
+
+static void journal_update(uint32_t pos, ContactField field)
+{
+    journal_log(JOURNAL_UPDATE, field, pos, &cur_store()->items[pos], 1 << field);
+}
+
+static void journal_erase(uint32_t pos)
+{
+    journal_log(JOURNAL_ERASE, 0, pos, NULL, 0);
+}
+
+static void journal_purge(void)
+{
+    journal_log(JOURNAL_PURGE, 0, 0, NULL, 0);
+}
+
+// The first key goes in 'arg' and the others, plus one each, in the low bytes of 'position'
+static void journal_sort(const SortSpec *spec)
+{
+    uint32_t more = 0;
+    for (size_t k = spec->count; k-- > 1;)
+        more = (more << 8) | (spec->keys[k] + 1u);
+    journal_log(JOURNAL_SORT, spec->keys[0], more, NULL, 0);
+}
+
+// Applies one entry payload to the store; returns 0, or -1 if it does not fit the store
+static int journal_apply(const char *p, size_t size)
+{
+    unsigned char op = (unsigned char) p[8], arg = (unsigned char) p[9];
+    uint32_t pos;
+    memcpy(&pos, p + 10, sizeof(pos));
+
+    char values[FIELD_COUNT][256]; // Values, '\0'-terminated
+    size_t lens[FIELD_COUNT];
+    int count = op == JOURNAL_ADD || op == JOURNAL_ADD_ID ? FIELD_COUNT
+                : op == JOURNAL_UPDATE                   ? 1
+                                                         : 0;
+    const char *v = p + 14, *end = p + size;
+    for (int i = 0; i < count; i++)
+    {
+        if (v >= end || (size_t) (end - v - 1) < (unsigned char) *v)
+            return -1;
+        lens[i] = (unsigned char) *v++;
+        memcpy(values[i], v, lens[i]);
+        values[i][lens[i]] = '\0';
+        v += lens[i];
+    }
+    uint64_t id = 0;
+    if (op == JOURNAL_ADD_ID)
+    {
+        if ((size_t) (end - v) != sizeof(id))
+            return -1;
+        memcpy(&id, v, sizeof(id));
+        v += sizeof(id);
+    }
+    if (v != end || (op == JOURNAL_ADD_ID && id == 0))
+        return -1;
+
+    switch (op)
+    {
+        case JOURNAL_ADD:
+        case JOURNAL_ADD_ID:
+            if (op == JOURNAL_ADD_ID)
+                cur_store()->last_id = id - 1; // The add hands out the logged ID again
+            return store_add_slices(values[0], lens[0], values[1], lens[1], values[2], lens[2])
+                       ? 0
+                       : -1;
+        case JOURNAL_UPDATE:
+            if (pos >= cur_store()->count || arg >= FIELD_COUNT)
+                return -1;
+            return store_set_field(&cur_store()->items[pos], (ContactField) arg, values[0]);
+        case JOURNAL_DELETE:
+        case JOURNAL_ERASE:
+            if (pos >= cur_store()->count || (cur_store()->items[pos].flags & CONTACT_DELETED))
+                return -1;
+            store_tombstone(pos); // Purges are logged as entries of their own
+            if (op == JOURNAL_DELETE)
+                store_purge(); // Later entries expect the gap closed
+            return 0;
+        case JOURNAL_PURGE:
+            store_purge();
+            return 0;
+        case JOURNAL_SORT:
+        {
+            SortSpec spec = {{arg}, 1};
+            for (; pos && spec.count < SORT_SPEC_MAX_KEYS; pos >>= 8)
+                spec.keys[spec.count++] = (uint8_t) ((pos & 0xffu) - 1u);
+            return pos || !sort_spec_valid(&spec) ? -1 : store_sort(&spec);
+        }
+    }
+    return -1;
+}
+
+// Replaces the journal with one based on files that contain every change up to 'base_seq'
+// (contacts.txt stamped 'size'/'mtime'). Intact entries in (base_seq, keep_until] are
+// carried over, e.g. changes made while a background save was running. Logging resumes on
+// the new file.
+void journal_rebase(uint64_t base_seq, uint64_t size, uint64_t mtime, uint64_t keep_until)
+{
+    const char *tmpp = JOURNAL_PATH ".tmp"; // Temporary file path
+    if (journal.file)
+    {
+        fflush(journal.file);
+        fclose(journal.file);
+        journal.file = NULL;
+    }
+
+    // Find the run of intact entries after 'base_seq' in the current journal
+    MappedFile mf;
+    const char *from = NULL, *to = NULL;
+    uint64_t last = base_seq;
+    int mapped = keep_until > base_seq && map_file(JOURNAL_PATH, &mf) == 0;
+    if (mapped && mf.size >= sizeof(JournalHeader) &&
+        memcmp(mf.data, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) == 0)
+    {
+        const char *p = mf.data + sizeof(JournalHeader), *end = mf.data + mf.size;
+        uint64_t seq;
+        size_t n;
+        while ((n = journal_entry(p, end, &seq)) != 0 && seq <= keep_until)
+        {
+            if (seq > base_seq)
+            {
+                if (seq != last + 1)
+                    break; // Gap: later entries cannot be applied
+                if (!from)
+                    from = p;
+                last = seq;
+                to = p + n;
+            }
+            p += n;
+        }
+    }
+
+    JournalHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    hdr.version = JOURNAL_VERSION;
+    hdr.base_seq = base_seq;
+    hdr.base_size = size;
+    hdr.base_mtime = mtime;
+
+    FILE *file = fopen(tmpp, "wb");
+    int failed = !file || fwrite(&hdr, sizeof(hdr), 1, file) != 1 ||
+                 (from && fwrite(from, 1, (size_t) (to - from), file) != (size_t) (to - from));
+    failed = (file && file_sync(file) != 0) || failed;
+    failed = (file && fclose(file) != 0) || failed;
+    size_t kept = from ? (size_t) (to - from) : 0;
+    if (mapped)
+        unmap_file(&mf);
+
+#ifdef _WIN32
+    remove(JOURNAL_PATH); // rename() does not replace existing files on Windows
+#endif
+    if (failed || rename(tmpp, JOURNAL_PATH) != 0 || !(journal.file = fopen(JOURNAL_PATH, "ab")))
+    {
+        remove(tmpp);
+        printf("⚠️ Could not write %s; changes will only be saved at exit.\n", JOURNAL_PATH);
+        journal.unavailable = 1;
+        return;
+    }
+    journal.seq = last;
+    journal.bytes = sizeof(hdr) + kept;
+    journal.pending = 0;
+    journal.unavailable = 0;
+}
+
+// Replays the journal on top of what load_contacts() just loaded, then starts logging.
+// After a snapshot, entries past its sequence number 'seq' are replayed; after a CSV load,
+// the journal is used only if it was started on that exact contacts.txt.
+void journal_open(int from_snapshot, uint64_t seq)
+{
+    uint64_t size = UINT64_MAX, mtime = 0; // Stamp of contacts.txt (UINT64_MAX = missing)
+    file_stamp(CONTACTS_PATH, &size, &mtime);
+
+    uint64_t base = seq; // Last change already contained in the loaded files
+    uint64_t applied = seq; // Last change now in the store
+    MappedFile mf;
+    if (map_file(JOURNAL_PATH, &mf) == 0)
+    {
+        JournalHeader hdr;
+        const char *reason = NULL;
+        if (mf.size < sizeof(hdr))
+            reason = "truncated header";
+        else
+        {
+            memcpy(&hdr, mf.data, sizeof(hdr));
+            if (memcmp(hdr.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0)
+                reason = "not a journal";
+            else if (hdr.version != JOURNAL_VERSION)
+                reason = "unsupported version";
+            else if (from_snapshot ? hdr.base_seq > seq
+                                   : hdr.base_size != size || hdr.base_mtime != mtime)
+                reason = "contacts.txt changed since it was written";
+        }
+
+        if (reason)
+            printf("⚠️ Ignoring %s (%s).\n", JOURNAL_PATH, reason);
+        else
+        {
+            if (!from_snapshot)
+                base = hdr.base_seq;
+
+            // Apply the intact, consecutive entries the loaded files do not contain yet
+            const char *p = mf.data + sizeof(hdr), *end = mf.data + mf.size;
+            uint64_t last = hdr.base_seq, entry_seq;
+            size_t n, replayed = 0;
+            while (p < end && (n = journal_entry(p, end, &entry_seq)) != 0 &&
+                   entry_seq == last + 1)
+            {
+                if (entry_seq > base && journal_apply(p + 8, n - 8) != 0)
+                    break;
+                replayed += entry_seq > base;
+                last = entry_seq;
+                p += n;
+            }
+            if (last > applied)
+                applied = last;
+            if (p < end)
+                printf("⚠️ %s ends with a damaged entry; later changes were dropped.\n",
+                       JOURNAL_PATH);
+            if (replayed)
+                printf("ℹ️ Replayed %zu unsaved change(s) from %s.\n", replayed, JOURNAL_PATH);
+        }
+        unmap_file(&mf);
+    }
+
+    // The store now matches the files plus the kept entries; log on top of them
+    journal_rebase(base, size, mtime, applied);
+}
+
+#ifndef _WIN32
+// Compaction thread: writes the checkpoint prepared by journal_commit()
+static void *checkpoint_worker(void *arg)
+{
+    Checkpoint *cp = arg;
+    cp->result = checkpoint_write(cp);
+    atomic_store(&journal.done, 1);
+    return NULL;
+}
+#endif
+
+// Makes every change logged since the last call durable with one fsync (the whole menu
+// action is one batch). Once the journal passes JOURNAL_COMPACT_BYTES, a copy of the store
+// is saved in the background and the journal is then restarted from that save.
+// Returns 0, or -1 if a change since the last call could not be written or synced; it is
+// then only saved with the store (at exit), and must not be reported as durable.
+int journal_commit(void)
+{
+    int result = journal.failed ? -1 : 0;
+    journal.failed = 0;
+    if (journal.file && journal.pending)
+    {
+        if (file_sync(journal.file) != 0)
+        {
+            printf("⚠️ Could not sync %s.\n", JOURNAL_PATH);
+            result = -1;
+        }
+        journal.pending = 0;
+    }
+
+    if (journal.compacting && atomic_load(&journal.done))
+        journal_finish(); // Collect a finished background save
+
+    if (!journal.file || journal.compacting || journal.bytes < JOURNAL_COMPACT_BYTES)
+        return result;
+    store_purge(); // The saved files hold no tombstones; later entries count without them
+    if (store_clone(&journal.checkpoint.copy) != 0)
+        return result; // Out of memory: retry after the next change
+    journal.checkpoint.seq = journal.seq;
+    journal.compacting = 1;
+    atomic_store(&journal.done, 0);
+#ifndef _WIN32
+    journal.threaded =
+        pthread_create(&journal.thread, NULL, checkpoint_worker, &journal.checkpoint) == 0;
+    if (journal.threaded)
+        return result;
+#endif
+    journal.checkpoint.result = checkpoint_write(&journal.checkpoint); // No thread: save now
+    atomic_store(&journal.done, 1);
+    journal_finish();
+    return result;
+}
+
+// Waits for a background save, then restarts the journal after it
+void journal_finish(void)
+{
+    if (!journal.compacting)
+        return;
+#ifndef _WIN32
+    if (journal.threaded)
+        pthread_join(journal.thread, NULL);
+    journal.threaded = 0;
+#endif
+    journal.compacting = 0;
+
+    Checkpoint *cp = &journal.checkpoint;
+    if (cp->result >= 0)
+        journal_rebase(cp->seq, cp->size, cp->mtime, UINT64_MAX);
+    else
+        printf("⚠️ Background save failed; changes remain in %s.\n", JOURNAL_PATH);
+    store_clone_free(&cp->copy);
+}
+
+// Keeps the entries logged from now on in memory instead of writing them, so a batch that
+// fails part way leaves no trace in the journal
+void journal_hold(void)
+{
+    outbuf_init(&journal_held.entries, NULL, 0);
+    journal_held.seq = journal.seq;
+    journal_held.active = 1;
+}
+
+// Ends journal_hold(). With 'keep', the held entries are appended to the journal and synced
+// in one go; otherwise, or if that fails, they are dropped and the journal is cut back to
+// where it was, so no part of the batch is replayed. Returns 0 once kept entries are
+// durable, -1 if they are not (or nothing was held; e.g. no journal could be opened).
+int journal_release(int keep)
+{
+    if (!journal_held.active)
+        return keep ? -1 : 0;
+    journal_held.active = 0;
+
+    OutBuf *held = &journal_held.entries;
+    int failed = !keep || held->failed || !journal.file;
+    if (!failed && held->len)
+    {
+        failed = fwrite(held->data, 1, held->len, journal.file) != held->len ||
+                 file_sync(journal.file) != 0;
+        if (failed)
+        {
+            fflush(journal.file); // Bytes still buffered would land after the cut
+#ifndef _WIN32
+            if (ftruncate(fileno(journal.file), (off_t) journal.bytes) != 0)
+#else
+            if (_chsize_s(_fileno(journal.file), (__int64) journal.bytes) != 0)
+#endif
+                printf("⚠️ Could not restore %s.\n", JOURNAL_PATH);
+            printf("⚠️ Could not write %s; changes will only be saved at exit.\n",
+                   JOURNAL_PATH);
+            fclose(journal.file);
+            journal.file = NULL;
+            journal.unavailable = 1;
+        }
+        else
+        {
+            journal.bytes += held->len;
+            stats_count(STAT_BYTES_WRITTEN, held->len);
+        }
+    }
+    if (failed)
+        journal.seq = journal_held.seq; // The held entries were never logged
+    outbuf_finish(held);
+    return failed && keep ? -1 : 0;
+}
+
+// Stops logging (the journal file stays for the next start)
+void journal_close(void)
+{
+    journal_finish();
+    if (journal.file)
+    {
+        fflush(journal.file);
+        fclose(journal.file);
+        journal.file = NULL;
+    }
+}
+
 // ----------------- Menu + input validation -----------------
 
-// Displays the main menu
-void show_menu(void)
+// Displays the main menu
+void show_menu(void)
+{
+    printf("//--------Menu---------//\n");   // Menu header
+    printf("1. Add Contact\n");              // Option 1
+    printf("2. View Contacts\n");            // Option 2
+    printf("3. Search Contacts\n");          // Option 3
+    printf("4. Delete Contacts\n");          // Option 4
+    printf("5. Update Contact\n");           // Option 5
+    printf("6. Sort Contacts\n");            // Option 6
+    printf("7. Export Contacts as VCF\n");   // Option 7
+    printf("8. Import Contacts from VCF\n"); // Option 8
+    printf("9. Exit\n");                     // Option 9
+    printf("10. Show Statistics\n");         // Option 10 (kept after Exit so 9 stays Exit)
+}
+
+// Gets and validates user menu choice
+int get_menu_choice(void)
+{
+    int choice;
+    char buffer[50]; // Buffer for input
+
+    while (1) // Loop until valid input
+    {
+        printf("Enter your choice: "); // Prompt for input
+
+        if (fgets(buffer, sizeof(buffer), stdin) != NULL)
+        {
+            // Remove trailing newline
+            buffer[strcspn(buffer, "\n")] = '\0';
+
+            // Check for empty input
+            if (strlen(buffer) == 0)
+            {
+                printf("Input cannot be empty. Please try again.\n"); // Handle empty input
+                continue;
+            }
+
+            // Convert input to number
+            char *endptr;
+            choice = strtol(buffer, &endptr, 10);
+            if (*endptr != '\0')
+            {
+                printf("Invalid input. Please enter a number.\n"); // Handle non-numeric input
+                continue;
+            }
+
+            // Check range
+            if (choice < 1 || choice > 10)
+            {
+                printf("Choice out of range. Please enter 1-10.\n"); // Handle out-of-range input
+                continue;
+            }
+
+            return choice; // Return valid choice
+        }
+        else if (feof(stdin))
+        {
+            printf("\n");
+            return 9; // End of input (e.g. a piped session, or "-" as import file): exit
+        }
+        else
+        {
+            printf("Error reading input. Please try again.\n"); // Handle input error
+            clearerr(stdin);                                    // Clear input error state
+        }
+    }
+}
+
+// ----------------- Helper input functions -----------------
+
+// Safe line input (fgets + trim newline)
+void get_input(const char *prompt, char *buffer, size_t size)
+{
+    // Prompt
+    printf("%s", prompt);
+
+    // Use fgets to allow spaces
+    if (fgets(buffer, (int) size, stdin) == NULL)
+    {
+        // if EOF or error, ensure buffer is empty string
+        buffer[0] = '\0';
+        return;
+    }
+
+    // If input didn’t fit into buffer completely, flush leftover
+    if (strchr(buffer, '\n') == NULL)
+    {
+        int ch;
+        while ((ch = getchar()) != '\n' && ch != EOF)
+            ; // flush until newline
+    }
+
+    // Trim trailing newline if present
+    buffer[strcspn(buffer, "\n")] = '\0';
+
+    trim_whitespace(buffer);
+}
+
+// Core function for validated input
+// allow_empty = 0 → empty input is rejected
+// allow_empty = 1 → empty input is accepted
+// Validate input with regex, optionally allow empty input
+void get_validated_input(const char *prompt, char *buffer, size_t size, const char *pattern,
+                         int allow_empty)
+{
+    while (1)
+    {
+        get_input(prompt, buffer, size);
+
+        // Empty input handling
+        if (buffer[0] == '\0')
+        {
+            if (allow_empty)
+                return; // accept empty if allowed
+            printf("❌ Input cannot be empty. Please try again.\n");
+            continue;
+        }
+
+        // Length check
+        if (strlen(buffer) >= size)
+        {
+            printf("❌ Input too long. Maximum length is %zu characters.\n", size - 1);
+            continue;
+        }
+
+        // Validate regex if provided
+        if (pattern == NULL || validate_with_regex(pattern, buffer))
+        {
+            return; // ✅ Valid input
+        }
+
+        // Give user an idea of expected format
+        const char *format_msg;
+        if (strcmp(pattern, NAME_REGEX) == 0)
+        {
+            format_msg = "Letters, spaces, hyphens, or apostrophes (1-49 chars)";
+        }
+        else if (strcmp(pattern, PHONE_REGEX) == 0)
+        {
+            format_msg = "10-15 digits, optional + e.g., (International: +14155552671), (Indian: "
+                         "+919876543210 or 9876543210)";
+        }
+        else if (strcmp(pattern, CONFIRM_REGEX) == 0)
+        {
+            format_msg = "Single character: 'y' or 'n'";
+        }
+        else if (strcmp(pattern, SEARCH_CHOICE_REGEX) == 0)
+        {
+            format_msg = "1, 2, 3, 4 or 5";
+        }
+        else if (strcmp(pattern, IMPORT_POLICY_REGEX) == 0)
+        {
+            format_msg = "1, 2, 3 or 4";
+        }
+        else if (strcmp(pattern, PHONE_QUERY_REGEX) == 0)
+        {
+            format_msg = "Digits with optional +, spaces, dashes or brackets";
+        }
+        else if (strcmp(pattern, SORT_CHOICE_REGEX) == 0)
+        {
+            if (!validate_with_regex(DIGITS_REGEX, buffer))
+            {
+                format_msg = "❌ Invalid input. Enter a number (1-6).";
+            }
+            else
+            {
+                format_msg = "❌ Choice out of range. Enter between 1 and 6.";
+            }
+        }
+        else if (strcmp(pattern, SORT_SPEC_REGEX) == 0)
+        {
+            format_msg = "Up to 3 of name, phone, email, domain, country (e.g., domain,name)";
+        }
+        else
+        {
+            format_msg = "Valid email (e.g., user@domain.com)";
+        }
+        printf("Expected format: %s\n", format_msg);
+    }
+}
+
+// Strict input validation (no empty input allowed)
+void get_valid_input(const char *prompt, char *buffer, size_t size, const char *pattern)
+{
+    get_validated_input(prompt, buffer, size, pattern,
+                        0); // Call validated input with no empty allowed
+}
+
+// Optional input validation (empty input allowed)
+void get_optional_valid_input(const char *prompt, char *buffer, size_t size, const char *pattern)
+{
+    get_validated_input(prompt, buffer, size, pattern,
+                        1); // Call validated input with empty allowed
+}
+
+// ----------------- Add contact -----------------
+
+// Adds a new contact to the contacts array
+void add_contacts(void)
+{
+    char name[MAX_NAME_LENGTH], phone[MAX_PHONE_LENGTH], email[MAX_EMAIL_LENGTH];
+
+    // Get and validate contact details
+    get_valid_input("Enter name (1-49 chars): ", name, MAX_NAME_LENGTH, NAME_REGEX); // Get name
+    get_valid_input(
+        "Enter phone e.g., (International: +14155552671), (Indian: +919876543210 or 9876543210): ",
+        phone, MAX_PHONE_LENGTH, PHONE_REGEX); // Get phone
+    get_valid_input("Enter email (e.g., user@domain.com): ", email, MAX_EMAIL_LENGTH,
+                    EMAIL_REGEX); // Get email
+
+    if (store_find_name(name) >= 0)
+    {
+        printf("Cannot add: Name '%s' already exists.\n", name); // Handle duplicate name
+        return;
+    }
+
+    Contact *c = store_add(name, phone, email); // Copy fields into the store
+    if (!c)
+    {
+        printf("❌ Contact not added.\n"); // Out-of-memory already reported by the store
+        return;
+    }
+
+    // Display added contact
+    printf("\nContact added:\n");
+    printf("%s\n", contact_name(c));  // Show name
+    printf("%s\n", contact_phone(c)); // Show phone
+    printf("%s\n", contact_email(c)); // Show email
+}
+
+// ----------------- View contacts -----------------
+
+// Appends 'len' bytes of 's' left-aligned in a 'width'-byte column, like printf's "%-Ns"
+// (or "%-N.Ns" with 'clip'); fields are ASCII, so bytes are columns
+static void outbuf_column(OutBuf *o, const char *s, size_t len, size_t width, int clip)
+{
+    static const char spaces[32] = "                                ";
+    if (clip && len > width)
+        len = width;
+    outbuf_put(o, s, len);
+    for (size_t pad = len < width ? width - len : 0; pad > 0;)
+    {
+        size_t k = pad < sizeof(spaces) ? pad : sizeof(spaces);
+        outbuf_put(o, spaces, k);
+        pad -= k;
+    }
+}
+
+// Appends a row number left-aligned in a 'width'-byte column
+static void outbuf_rank(OutBuf *o, size_t rank, size_t width)
+{
+    char digits[24];
+    size_t n = sizeof(digits);
+    do
+    {
+        digits[--n] = (char) ('0' + rank % 10);
+        rank /= 10;
+    }
+    while (rank);
+    outbuf_column(o, digits + n, sizeof(digits) - n, width, 0);
+}
+
+// One contact list row: "%-3zu %-30.30s %-16.16s %-25.25s"
+static void render_view_row(OutBuf *o, size_t rank, const Contact *c)
+{
+    outbuf_rank(o, rank + 1, 3);
+    outbuf_puts(o, " ");
+    outbuf_column(o, contact_name(c), c->len[FIELD_NAME], 30, 1);
+    outbuf_puts(o, " ");
+    outbuf_column(o, contact_phone(c), c->len[FIELD_PHONE], 16, 1);
+    outbuf_puts(o, " ");
+    outbuf_column(o, contact_email(c), c->len[FIELD_EMAIL], 25, 1);
+    outbuf_puts(o, "\n");
+}
+
+// Rows per page: CMS_PAGE_SIZE if set, else VIEW_PAGE_SIZE
+static size_t page_size(void)
+{
+    const char *env = getenv("CMS_PAGE_SIZE");
+    long n = env ? atol(env) : 0;
+    return n > 0 ? (size_t) n : VIEW_PAGE_SIZE;
+}
+
+// 1 if standard output is an interactive terminal
+static int stdout_is_terminal(void)
+{
+#ifndef _WIN32
+    return isatty(fileno(stdout));
+#else
+    return _isatty(_fileno(stdout));
+#endif
+}
+
+// Formats rows [first, first + count) into one buffer and writes it in one go
+static void page_render(const RowSource *rows, size_t first, size_t count)
+{
+    OutBuf out;
+    outbuf_init(&out, stdout, 0);
+    for (size_t rank = first; rank < rows->count && rank - first < count; rank++)
+    {
+        size_t pos = rows->positions  ? rows->positions[rank]
+                     : rows->ordered ? cur_store()->view.order[rank]
+                                     : rank;
+        rows->render(&out, rank, &cur_store()->items[pos]);
+    }
+    outbuf_finish(&out);
+}
+
+// Prints a table's rows. On a terminal they are shown a page at a time, each page formatted
+// into one buffer and written at once, with commands to move between pages; the cost of a
+// page does not depend on the number of rows. Otherwise (a pipe or file) every row goes out
+// through the same buffer in large writes, with no prompts.
+void page_rows(const RowSource *rows)
+{
+    if (!stdout_is_terminal())
+    {
+        page_render(rows, 0, rows->count);
+        return;
+    }
+
+    size_t size = page_size(), page = 0;
+    while (rows->count)
+    {
+        size_t pages = (rows->count + size - 1) / size;
+        page_render(rows, page * size, size);
+        if (pages == 1)
+            break;
+
+        char cmd[32]; // Pager command
+        char prompt[128];
+        snprintf(prompt, sizeof(prompt),
+                 "-- Page %zu/%zu -- [Enter/n] next, p previous, [j] N jump, s N rows, q quit: ",
+                 page + 1, pages);
+        get_input(prompt, cmd, sizeof(cmd));
+        long arg = atol(isalpha((unsigned char) cmd[0]) ? cmd + 1 : cmd); // "j 3" or "3"
+        if (cmd[0] == '\0' || cmd[0] == 'n')
+        {
+            if (++page == pages || feof(stdin))
+                break; // Past the last page, or no more input
+        }
+        else if (cmd[0] == 'p')
+            page = page ? page - 1 : 0;
+        else if ((cmd[0] == 'j' || isdigit((unsigned char) cmd[0])) && arg > 0)
+            page = (size_t) arg <= pages ? (size_t) arg - 1 : pages - 1;
+        else if (cmd[0] == 's' && arg > 0)
+        {
+            page = page * size / (size_t) arg; // Keep the first row of this page in view
+            size = (size_t) arg;
+        }
+        else if (cmd[0] == 'q')
+            break;
+        else
+            printf("⚠️ Unknown command '%s'.\n", cmd);
+    }
+}
+
+// Displays all contacts in a formatted table, in the order of the last sort if one is kept
+void view_contacts(void)
+{
+    store_purge(); // Ranks are positions, so no slot may be a tombstone
+    if (cur_store()->count == 0)
+    {
+        printf("No contacts in Contact manager, add yours :)\n"); // Handle empty contact list
+        return;
+    }
+
+    // Print table header
+    printf("\n📒 Contact List (%zu):\n", cur_store()->count);
+    printf("-------------------------------------------------------------------------\n");
+    printf("%-3s %-30s %-16s %-25s\n", "#", "Name", "Phone", "Email");
+    printf("-------------------------------------------------------------------------\n");
+
+    RowSource rows = {NULL, sorted_view_sync() == 0, cur_store()->count, render_view_row};
+    page_rows(&rows);
+    printf("-------------------------------------------------------------------------\n"); // Print
+                                                                                           // table
+                                                                                           // footer
+}
+
+// ----------------- Update contact -----------------
+
+// Updates an existing contact's details
+void update_contact(void)
+{
+    if (cur_store()->count == cur_store()->deleted)
+    {
+        printf("No contacts in Contact manager, add yours :)\n"); // Handle empty contact list
+        return;
+    }
+
+    char name[MAX_NAME_LENGTH];
+    get_valid_input("Enter name to update: ", name, MAX_NAME_LENGTH,
+                    NAME_REGEX); // Get name to update
+
+    long i = store_find_name(name); // Case-insensitive hash lookup
+    if (i < 0)
+    {
+        printf("Contact '%s' not found.\n", name); // Handle contact not found
+        return;
+    }
+
+    Contact *c = &cur_store()->items[i];
+    printf("\n📞 Contact Found:\n"); // Display found contact
+    printf("Name: %s\n", contact_name(c));
+    printf("Phone: %s\n", contact_phone(c));
+    printf("Email: %s\n\n", contact_email(c));
+
+    printf("Enter new details (press Enter to keep existing value)\n"); // Prompt for new details
+
+    char new_name[MAX_NAME_LENGTH];
+    char new_email[MAX_EMAIL_LENGTH];
+    char new_phone[MAX_PHONE_LENGTH];
+    int updated = 0; // Track if updates were made
+
+    // Update name
+    get_optional_valid_input("Enter new name (1-49 chars): ", new_name, MAX_NAME_LENGTH,
+                             NAME_REGEX);
+    if (new_name[0] != '\0' && strcmp(new_name, contact_name(c)) != 0)
+    {
+        // Check for duplicate name
+        if (store_name_taken(new_name, i))
+        {
+            printf("Cannot update: Name '%s' already exists.\n",
+                   new_name); // Handle duplicate name
+            return;
+        }
+        printf("Name: '%s' → '%s'\n", contact_name(c), new_name); // Show name change
+        if (store_set_field(c, FIELD_NAME, new_name) != 0)         // Update name
+            return;
+        updated = 1;
+    }
+
+    // Update phone
+    get_optional_valid_input("Enter new phone e.g., (International: +14155552671), "
+                             "(Indian: +919876543210 or 9876543210): ",
+                             new_phone, MAX_PHONE_LENGTH, PHONE_REGEX);
+    if (new_phone[0] != '\0' && strcmp(new_phone, contact_phone(c)) != 0)
+    {
+        printf("Phone: '%s' → '%s'\n", contact_phone(c), new_phone); // Show phone change
+        if (store_set_field(c, FIELD_PHONE, new_phone) != 0)          // Update phone
+            return;
+        updated = 1;
+    }
+
+    // Update email
+    get_optional_valid_input("Enter new email (e.g., user@domain.com): ", new_email,
+                             MAX_EMAIL_LENGTH, EMAIL_REGEX);
+    if (new_email[0] != '\0' && strcmp(new_email, contact_email(c)) != 0)
+    {
+        printf("Email: '%s' → '%s'\n", contact_email(c), new_email); // Show email change
+        if (store_set_field(c, FIELD_EMAIL, new_email) != 0)          // Update email
+            return;
+        updated = 1;
+    }
+
+    if (updated)
+        printf("\n✅ Contact updated successfully!\n\n"); // Confirm update
+    else
+    {
+        printf("\nℹ️ No changes were made to the contact.\n"); // No changes made
+        printf("Name: %s\n", contact_name(c));
+        printf("Phone: %s\n", contact_phone(c));
+        printf("Email: %s\n\n", contact_email(c));
+    }
+}
+
+// ----------------- Delete contacts -----------------
+
+// Deletes a contact by name
+void delete_contacts(void)
+{
+    if (cur_store()->count == cur_store()->deleted)
+    {
+        printf("No contacts to delete.\n"); // Handle empty contact list
+        return;
+    }
+
+    char name[MAX_NAME_LENGTH];
+    get_valid_input("Enter name to delete: ", name, MAX_NAME_LENGTH,
+                    NAME_REGEX); // Get name to delete
+
+    long i = store_find_name(name); // Case-insensitive hash lookup
+    if (i < 0)
+    {
+        printf("Contact '%s' not found.\n", name); // Handle contact not found
+        return;
+    }
+
+    const Contact *c = &cur_store()->items[i];
+    printf("\n📞 Contact Found:\n"); // Display found contact
+    printf("Name: %s\n", contact_name(c));
+    printf("Phone: %s\n", contact_phone(c));
+    printf("Email: %s\n", contact_email(c));
+
+    char confirm[2];
+    get_valid_input("Are you sure you want to delete this contact? [y/n]: ", confirm,
+                    sizeof(confirm), CONFIRM_REGEX); // Get confirmation
+
+    if (confirm[0] == 'y' || confirm[0] == 'Y')
+    {
+        store_remove((size_t) i); // Leaves a tombstone; later contacts keep their positions
+        printf("✅ Contact '%s' deleted successfully.\n\n", name); // Confirm deletion
+    }
+    else
+    {
+        printf("❌ Deletion cancelled.\n\n"); // Cancellation message
+    }
+}
+
+// Deletes-by-predicate test: 1 if the email at 'pos' is in the domain 'arg' (the part after
+// '@', compared case-insensitively)
+static int contact_in_domain(uint32_t pos, const void *arg)
+{
+    size_t email_len;
+    const char *email = scan_value(pos, FIELD_EMAIL, &email_len), *end = email + email_len;
+    const char *at = memchr(email, '@', email_len);
+    size_t len = strlen(arg);
+    return at && (size_t) (end - at - 1) == len && ascii_caseeq(at + 1, arg, len);
+}
+
+// ----------------- Search contacts -----------------
+
+// Orders contact positions ascending (qsort callback)
+static int compare_positions(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+// Returns 1 if any trigram-indexed field of the contact at 'pos' contains 'lower' (n bytes)
+// case-insensitively
+static int contact_contains(uint32_t pos, const char *lower, size_t n)
+{
+    for (int f = 0; f < FIELD_COUNT; f++)
+    {
+        size_t len;
+        if (!(TRIGRAM_FIELDS & (1u << f)))
+            continue;
+        const char *value = scan_value(pos, (ContactField) f, &len);
+        if (ascii_find_lower(value, len, lower, n))
+            return 1;
+    }
+    return 0;
+}
+
+// One search results row: "%-3d %-15s %-15s %-25s"
+static void render_search_row(OutBuf *o, size_t rank, const Contact *c)
+{
+    outbuf_rank(o, rank + 1, 3);
+    outbuf_puts(o, " ");
+    outbuf_column(o, contact_name(c), c->len[FIELD_NAME], 15, 0);
+    outbuf_puts(o, " ");
+    outbuf_column(o, contact_phone(c), c->len[FIELD_PHONE], 15, 0);
+    outbuf_puts(o, " ");
+    outbuf_column(o, contact_email(c), c->len[FIELD_EMAIL], 25, 0);
+    outbuf_puts(o, "\n");
+}
+
+// Allocates room for 'n' matching positions (at least one)
+static uint32_t *alloc_matches(size_t n)
+{
+    uint32_t *matches = malloc((n ? n : 1) * sizeof(uint32_t));
+    if (!matches)
+        printf("❌ Out of memory while searching.\n");
+    return matches;
+}
+
+// Collects, in contact order, every contact whose indexed field matches 'value' into a new
+// array '*out'. Returns the number of matches, or -1 on out-of-memory
+static long collect_index_matches(HashIndex *ix, const char *value, uint32_t **out)
+{
+    uint64_t started = stats_start();
+    size_t n = 0;
+    IndexCursor cur;
+    for (long pos = index_lookup(ix, value, &cur); pos >= 0; pos = index_next(ix, &cur))
+        n++;
+
+    uint32_t *matches = alloc_matches(n);
+    if (!matches)
+        return -1;
+    n = 0;
+    for (long pos = index_lookup(ix, value, &cur); pos >= 0; pos = index_next(ix, &cur))
+        matches[n++] = (uint32_t) pos;
+    qsort(matches, n, sizeof(uint32_t), compare_positions);
+    *out = matches;
+    stats_stop(STAT_SEARCH_INDEX, started);
+    return (long) n;
+}
+
+// Edit distance between two strings counting insertions, deletions, substitutions and swaps
+// of adjacent characters (optimal string alignment). Stops early and returns max + 1 once
+// every alignment costs more than 'max'. Strings are at most MAX_NAME_LENGTH - 1 bytes.
+static int edit_distance_within(const char *a, size_t la, const char *b, size_t lb, int max)
+{
+    if ((la > lb ? la - lb : lb - la) > (size_t) max)
+        return max + 1;
+
+    int rows[3][MAX_NAME_LENGTH]; // Two rows back, previous row, current row
+    int *before = rows[0], *prev = rows[1], *cur = rows[2];
+    for (size_t j = 0; j <= lb; j++)
+        prev[j] = (int) j;
+    for (size_t i = 1; i <= la; i++)
+    {
+        cur[0] = (int) i;
+        int row_min = cur[0];
+        for (size_t j = 1; j <= lb; j++)
+        {
+            int d = prev[j - 1] + (a[i - 1] != b[j - 1]); // Match or substitute
+            if (prev[j] + 1 < d)
+                d = prev[j] + 1; // Delete
+            if (cur[j - 1] + 1 < d)
+                d = cur[j - 1] + 1; // Insert
+            if (i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1] &&
+                before[j - 2] + 1 < d)
+                d = before[j - 2] + 1; // Swap
+            cur[j] = d;
+            if (d < row_min)
+                row_min = d;
+        }
+        if (row_min > max)
+            return max + 1; // Rows never decrease
+        int *spare = before;
+        before = prev;
+        prev = cur;
+        cur = spare;
+    }
+    return prev[lb] > max ? max + 1 : prev[lb];
+}
+
+// Collects into 'out' the FUZZY_TOP_K contacts whose names sound like 'query' (same phonetic
+// key) and are within a few edits of it, closest first. Only the contacts sharing the key
+// are compared, so the cost depends on how common the name sounds, not on the directory
+// size. Returns the number of matches, or -1 on out-of-memory
+static long collect_fuzzy_matches(const char *query, uint32_t out[FUZZY_TOP_K])
+{
+    uint64_t started = stats_start();
+    HashIndex *ix = store_phonetic();
+    if (!ix)
+    {
+        printf("❌ Out of memory while building the phonetic index.\n");
+        return -1;
+    }
+
+    char q[MAX_NAME_LENGTH];
+    size_t ql = fold_key(query, strnlen(query, MAX_NAME_LENGTH - 1), q);
+    int max = ql < 4 ? 1 : ql < 8 ? 2 : 3; // Edits allowed grow with the query length
+
+    struct
+    {
+        int dist;     // Edit distance to the query
+        uint32_t pos; // Contact position
+    } best[FUZZY_TOP_K];
+    int n = 0;
+
+    IndexCursor cur;
+    for (long pos = index_lookup(ix, query, &cur); pos >= 0; pos = index_next(ix, &cur))
+    {
+        const Contact *c = &cur_store()->items[pos];
+        char name[MAX_NAME_LENGTH];
+        size_t len = fold_key(contact_name(c), c->len[FIELD_NAME], name);
+        int d = edit_distance_within(q, ql, name, len, max);
+        if (d > max)
+            continue;
+
+        // Insert into the ranked list: closest first, then contact order
+        int k = n;
+        if (n < FUZZY_TOP_K)
+            n++;
+        else if (d > best[n - 1].dist ||
+                 (d == best[n - 1].dist && (uint32_t) pos > best[n - 1].pos))
+            continue; // Worse than every listed match
+        else
+            k = n - 1; // Replaces the worst listed match
+        while (k > 0 && (best[k - 1].dist > d ||
+                         (best[k - 1].dist == d && best[k - 1].pos > (uint32_t) pos)))
+        {
+            best[k] = best[k - 1];
+            k--;
+        }
+        best[k].dist = d;
+        best[k].pos = (uint32_t) pos;
+    }
+
+    for (int k = 0; k < n; k++)
+        out[k] = best[k].pos;
+    stats_stop(STAT_SEARCH_FUZZY, started);
+    return n;
+}
+
+// Collects, in contact order, every contact with a field containing 'lower' into a new
+// array '*out'. Returns the number of matches, or -1 on out-of-memory
+static long collect_partial_matches(const char *lower, uint32_t **out)
+{
+    uint64_t started = stats_start();
+    TrigramIndex *tx = store_trigrams();
+    store_columns(); // Without them (out of memory) the records are scanned instead
+    const PostingList *candidates = tx ? trigram_candidates(tx, lower) : NULL;
+    uint32_t *matches = alloc_matches(candidates ? candidates->count : cur_store()->count);
+    if (!matches)
+        return -1;
+
+    size_t n = 0, lower_len = strlen(lower);
+    if (candidates)
+    { // Only contacts sharing the query's rarest trigram can match
+        for (uint32_t k = 0; k < candidates->count; k++)
+            if (contact_contains(candidates->items[k], lower, lower_len))
+                matches[n++] = candidates->items[k];
+    }
+    else
+    { // Query shorter than a trigram: scan every contact
+        for (size_t i = 0; i < cur_store()->count; i++)
+            if (contact_contains((uint32_t) i, lower, lower_len) &&
+                !(cur_store()->items[i].flags & CONTACT_DELETED)) // Only matches touch the records
+                matches[n++] = (uint32_t) i;
+    }
+    *out = matches;
+    stats_stop(STAT_SEARCH_PARTIAL, started);
+    return (long) n;
+}
+
+// Searches for contacts by name (exact, partial or fuzzy), or reverse-looks-up by phone or
+// email. Exact, fuzzy, phone and email searches go through hash indexes; all but the name
+// index are built on first use.
+void search_contact(void)
+{
+    if (cur_store()->count == cur_store()->deleted)
+    {
+        printf("No contacts in Contact manager, add yours :)\n"); // Handle empty contact list
+        return;
+    }
+
+    // Prompt for search type
+    char choice_str[2];
+    get_valid_input("Search type (1 = Exact, 2 = Partial, 3 = Phone, 4 = Email, 5 = Fuzzy): ",
+                    choice_str, sizeof(choice_str), SEARCH_CHOICE_REGEX); // Get search type
+    int search_type = choice_str[0] - '0'; // Convert char to int (1-5)
+
+    // Get search value
+    char query[MAX_EMAIL_LENGTH];
+    if (search_type == 3)
+        get_valid_input("Enter phone to search: ", query, MAX_PHONE_LENGTH + 8,
+                        PHONE_QUERY_REGEX); // Separators such as spaces or dashes are ignored
+    else if (search_type == 4)
+        get_valid_input("Enter email to search: ", query, MAX_EMAIL_LENGTH,
+                        NULL); // Matched case-insensitively
+#ifdef TRIGRAM_ALL_FIELDS
+    else if (search_type == 2)
+        get_valid_input("Enter name, phone or email text to search: ", query, MAX_EMAIL_LENGTH,
+                        NULL); // Partial search spans every field
+#endif
+    else if (search_type == 5)
+        get_valid_input("Enter name to search (approximate spelling is fine): ", query,
+                        MAX_NAME_LENGTH, NAME_REGEX); // Matched by sound and edit distance
+    else
+        get_valid_input("Enter name to search: ", query, MAX_NAME_LENGTH,
+                        NAME_REGEX); // Get name to search
+
+    HashIndex *ix = NULL;
+    if (search_type != 2 && search_type != 5)
+    {
+        ContactField field = search_type == 3 ? FIELD_PHONE
+                             : search_type == 4 ? FIELD_EMAIL
+                                                : FIELD_NAME;
+        ix = store_index(field);
+        if (!ix)
+            return; // Out-of-memory already reported
+    }
+
+    long found;
+    uint32_t fuzzy[FUZZY_TOP_K];
+    uint32_t *matches = fuzzy;
+    if (ix)
+    { // Exact name, phone or email match
+        found = collect_index_matches(ix, query, &matches);
+    }
+    else if (search_type == 5)
+    { // Fuzzy match, closest first
+        found = collect_fuzzy_matches(query, fuzzy);
+    }
+    else
+    { // Partial match
+        // Convert search text to lowercase for case-insensitive comparison
+        char temp_search[MAX_EMAIL_LENGTH];
+        fold_key(query, strlen(query), temp_search);
+        found = collect_partial_matches(temp_search, &matches);
+    }
+    if (found < 0)
+        return; // Out-of-memory already reported
+
+    // Print search results header
+    printf("\n📞 Search Results:\n");
+    printf("---------------------------------------------------------------\n");
+    printf("%-3s %-15s %-15s %-25s\n", "#", "Name", "Phone", "Email");
+    printf("---------------------------------------------------------------\n");
+
+    RowSource rows = {matches, 0, (size_t) found, render_search_row};
+    page_rows(&rows);
+    if (matches != fuzzy)
+        free(matches);
+
+    printf(
+        "---------------------------------------------------------------\n"); // Print table footer
+    if (found == 0)
+    {
+        printf("Contact not found :(\n"); // Handle no matches
+    }
+    else
+    {
+        printf("Found %ld contact(s).\n", found); // Report number of matches
+    }
+}
+
+// ----------------- Sort contacts -----------------
+
+#define SORT_INSERTION_CUTOFF 16 // Ranges this small are insertion-sorted
+#define SORT_PARALLEL_CUTOFF (1u << 16) // Smallest range sorted or merged by its own thread
+
+static const char *const sort_key_names[SORT_FIELD_COUNT] = {"name", "phone", "email", "domain",
+                                                             "country"};
+// Field each sort key is read from
+static const ContactField sort_key_source[SORT_FIELD_COUNT] = {FIELD_NAME, FIELD_PHONE,
+                                                               FIELD_EMAIL, FIELD_EMAIL,
+                                                               FIELD_PHONE};
+
+// Returns the E.164 country code of a phone number (1-3 digits), or 0 if it has none
+static unsigned phone_country_code(const char *phone, size_t len)
+{
+    // Two-digit codes; other codes starting with 2-9 have three digits ('1' and '7' have one)
+    static const unsigned char two_digit[] = {20, 27, 30, 31, 32, 33, 34, 36, 39, 40, 41,
+                                              43, 44, 45, 46, 47, 48, 49, 51, 52, 53, 54,
+                                              55, 56, 57, 58, 60, 61, 62, 63, 64, 65, 66,
+                                              81, 82, 84, 86, 90, 91, 92, 93, 94, 95, 98};
+    char key[MAX_PHONE_LENGTH + 4];
+    size_t n = phone_key(phone, len, key);
+    if (n < 2 || key[0] != '+' || !isdigit((unsigned char) key[1]))
+        return 0;
+    if (key[1] == '1' || key[1] == '7')
+        return (unsigned) (key[1] - '0');
+    if (n < 3 || !isdigit((unsigned char) key[2]))
+        return 0;
+
+    unsigned code = (unsigned) (key[1] - '0') * 10u + (unsigned) (key[2] - '0');
+    for (size_t i = 0; i < sizeof(two_digit); i++)
+        if (two_digit[i] == code)
+            return code;
+    return n >= 4 && isdigit((unsigned char) key[3]) ? code * 10u + (unsigned) (key[3] - '0') : 0;
+}
+
+// Returns the text a string sort key of the contact at 'pos' compares and its length (see
+// scan_value(): names and emails come lowercased once the columns are built)
+static const char *sort_field_text(uint32_t pos, SortField field, size_t *len)
+{
+    const char *text = scan_value(pos, sort_key_source[field], len);
+    if (field == SORT_BY_DOMAIN)
+    {
+        const char *at = memchr(text, '@', *len);
+        const char *domain = at ? at + 1 : text + *len; // No '@': empty
+        *len -= (size_t) (domain - text);
+        return domain;
+    }
+    return text;
+}
+
+// Orders two byte strings like strcmp() orders them as C strings
+static int bytes_cmp(const char *a, size_t la, const char *b, size_t lb)
+{
+    int cmp = memcmp(a, b, la < lb ? la : lb);
+    return cmp ? cmp : (la > lb) - (la < lb);
+}
+
+// Compares one sort key of the contacts at positions 'a' and 'b', skipping the first 'skip'
+// bytes of string keys. Same order as strcasecmp() on names, emails and domains, strcmp()
+// on phones, and numeric order on country codes.
+static int sort_field_cmp(uint32_t a, uint32_t b, SortField field, size_t skip)
+{
+    size_t la, lb;
+    const char *ta = sort_field_text(a, field, &la), *tb = sort_field_text(b, field, &lb);
+    if (field == SORT_BY_COUNTRY)
+    {
+        unsigned ca = phone_country_code(ta, la), cb = phone_country_code(tb, lb);
+        return ca == cb ? 0 : ca < cb ? -1 : 1;
+    }
+
+    la = la > skip ? la - skip : 0;
+    lb = lb > skip ? lb - skip : 0;
+    if (field == SORT_BY_PHONE || cur_store()->columns.active)
+        return bytes_cmp(ta + skip, la, tb + skip, lb); // Nothing left to fold
+    return ascii_casecmp(ta + skip, la, tb + skip, lb);
+}
+
+// Compares the contacts at positions 'a' and 'b' on every key of 'spec', starting at key
+// 'first'
+static int sort_contact_cmp(uint32_t a, uint32_t b, const SortSpec *spec, size_t first)
+{
+    for (size_t k = first; k < spec->count; k++)
+    {
+        int cmp = sort_field_cmp(a, b, (SortField) spec->keys[k], 0);
+        if (cmp != 0)
+            return cmp;
+    }
+    return 0;
+}
+
+// Returns 1 if any key of 'spec' is read from 'field'
+static int sort_spec_uses(const SortSpec *spec, ContactField field)
+{
+    for (size_t k = 0; k < spec->count; k++)
+        if (sort_key_source[spec->keys[k]] == field)
+            return 1;
+    return 0;
+}
+
+// Returns 1 if 'spec' has 1 to SORT_SPEC_MAX_KEYS keys and each is a SortField
+static int sort_spec_valid(const SortSpec *spec)
+{
+    if (spec->count == 0 || spec->count > SORT_SPEC_MAX_KEYS)
+        return 0;
+    for (size_t k = 0; k < spec->count; k++)
+        if (spec->keys[k] >= SORT_FIELD_COUNT)
+            return 0;
+    return 1;
+}
+
+// Returns the name 'key' has in sort specifications
+const char *sort_key_name(SortField key)
+{
+    return sort_key_names[key];
+}
+
+// Parses a comma-separated list of up to SORT_SPEC_MAX_KEYS key names ("domain,name")
+// Returns 0 on success, -1 if a name is unknown or there are too many keys
+int sort_spec_parse(const char *text, SortSpec *spec)
+{
+    spec->count = 0;
+    while (*text)
+    {
+        size_t n = strcspn(text, ",");
+        int key = -1;
+        for (int f = 0; f < SORT_FIELD_COUNT; f++)
+            if (strlen(sort_key_names[f]) == n && strncmp(text, sort_key_names[f], n) == 0)
+                key = f;
+        if (key < 0 || spec->count == SORT_SPEC_MAX_KEYS)
+            return -1;
+        spec->keys[spec->count++] = (uint8_t) key;
+        text += n + (text[n] == ',');
+    }
+    return spec->count ? 0 : -1;
+}
+
+// Packs the first 8 bytes of a key into an integer that orders like the string, folding
+// case where the comparison ignores it. Short keys are zero-padded, which sorts them
+// before their extensions just as '\0' does in strcmp().
+static uint64_t sort_prefix(const char *s, size_t len, int fold)
+{
+    unsigned char bytes[8] = {0};
+    memcpy(bytes, s, len < 8 ? len : 8);
+    if (fold)
+        ascii_lower((const char *) bytes, 8, (char *) bytes); // One word fold
+    uint64_t prefix = 0;
+    for (size_t i = 0; i < 8; i++)
+        prefix = (prefix << 8) | bytes[i];
+    return prefix;
+}
+
+// Fills a sort entry for the contact at 'pos' from the first key of 'spec'
+static void sort_key_init(SortKey *key, uint32_t pos, const SortSpec *spec)
+{
+    SortField field = (SortField) spec->keys[0];
+    size_t len;
+    const char *text = sort_field_text(pos, field, &len);
+    key->pos = pos;
+    if (field == SORT_BY_COUNTRY)
+    {
+        key->prefix = phone_country_code(text, len);
+        key->len = 0; // The whole key is in the prefix
+        return;
+    }
+
+    key->prefix = sort_prefix(text, len, field != SORT_BY_PHONE && !cur_store()->columns.active);
+    key->len = (uint8_t) len;
+}
+
+// Orders two sort keys: by prefix, then by the rest of the first key only when the prefixes
+// tie, then by the remaining keys of the spec
+static int sort_key_cmp(const SortKey *a, const SortKey *b, const SortSpec *spec)
+{
+    if (a->prefix != b->prefix)
+        return a->prefix < b->prefix ? -1 : 1;
+
+    if (a->len > 8 || b->len > 8)
+    {
+        int cmp = sort_field_cmp(a->pos, b->pos, (SortField) spec->keys[0], 8);
+        if (cmp != 0)
+            return cmp;
+    }
+    return spec->count > 1 ? sort_contact_cmp(a->pos, b->pos, spec, 1) : 0;
+}
+
+// Merges the sorted runs keys[0, mid) and keys[mid, n) through the scratch buffer.
+// Ties take from the left run, which keeps the sort stable.
+void merge(SortKey *keys, SortKey *scratch, size_t mid, size_t n, const SortSpec *spec)
+{
+    memcpy(scratch, keys, mid * sizeof(SortKey)); // Only the left run needs moving out
+
+    size_t i = 0, j = mid, k = 0; // Indices for merging
+    while (i < mid && j < n)
+    {
+        if (sort_key_cmp(&scratch[i], &keys[j], spec) <= 0)
+            keys[k++] = scratch[i++]; // Copy from left run
+        else
+            keys[k++] = keys[j++]; // Copy from right run
+    }
+
+    // Copy remaining elements from the left run (the right run is already in place)
+    while (i < mid)
+        keys[k++] = scratch[i++];
+}
+
+// Sorts n keys (stable); 'scratch' must hold n / 2 + 1 keys
+void merge_sort(SortKey *keys, SortKey *scratch, size_t n, const SortSpec *spec)
+{
+    if (n <= SORT_INSERTION_CUTOFF)
+    {
+        for (size_t i = 1; i < n; i++)
+        {
+            SortKey key = keys[i];
+            size_t j = i;
+            while (j > 0 && sort_key_cmp(&keys[j - 1], &key, spec) > 0)
+            {
+                keys[j] = keys[j - 1];
+                j--;
+            }
+            keys[j] = key;
+        }
+        return;
+    }
+
+    size_t mid = n / 2;                                 // Calculate middle index
+    merge_sort(keys, scratch, mid, spec);               // Sort left half
+    merge_sort(keys + mid, scratch, n - mid, spec);     // Sort right half
+    if (sort_key_cmp(&keys[mid - 1], &keys[mid], spec) > 0)
+        merge(keys, scratch, mid, n, spec); // Merge sorted halves unless already in order
+}
+
+#ifndef _WIN32
+// A half of a parallel sort, run on its own thread
+typedef struct
+{
+    SortKey *keys, *scratch; // Range to sort and its n-key scratch buffer
+    size_t n;                // Keys in the range
+    const SortSpec *spec;    // Order
+    int threads;             // Threads this range may use
+    ContactStore *owner;     // Store the keys refer to (the starting thread's)
+} SortTask;
+
+// One slice of a parallel merge: merges left[0, nl) and right[0, nr) into out
+typedef struct
+{
+    const SortKey *left, *right; // Input runs
+    size_t nl, nr;               // Keys in each run
+    SortKey *out;                // Output (nl + nr keys)
+    const SortSpec *spec;        // Order
+    ContactStore *owner;         // Store the keys refer to (the starting thread's)
+} MergePart;
+
+// Stable out-of-place merge of two sorted runs (ties take from the left run)
+static void merge_runs(MergePart *m)
+{
+    size_t i = 0, j = 0, k = 0;
+    while (i < m->nl && j < m->nr)
+    {
+        if (sort_key_cmp(&m->left[i], &m->right[j], m->spec) <= 0)
+            m->out[k++] = m->left[i++];
+        else
+            m->out[k++] = m->right[j++];
+    }
+    while (i < m->nl)
+        m->out[k++] = m->left[i++];
+    while (j < m->nr)
+        m->out[k++] = m->right[j++];
+}
+
+static void *merge_part_worker(void *arg)
+{
+    MergePart *m = arg;
+    store_current = m->owner;
+    merge_runs(m);
+    return NULL;
+}
+
+// Returns how many of the first k merged keys come from the left run, under the same
+// tie rule as merge(): a left key goes first unless the right key is strictly smaller
+static size_t merge_split(const SortKey *left, size_t nl, const SortKey *right, size_t nr,
+                          size_t k, const SortSpec *spec)
+{
+    size_t lo = k > nr ? k - nr : 0, hi = k < nl ? k : nl;
+    while (lo < hi)
+    {
+        size_t i = lo + (hi - lo) / 2;
+        if (sort_key_cmp(&left[i], &right[k - i - 1], spec) <= 0)
+            lo = i + 1; // left[i] is output before right[k - i - 1]
+        else
+            hi = i;
+    }
+    return lo;
+}
+
+// Merges the sorted runs keys[0, mid) and keys[mid, n) on up to 'threads' threads: both
+// runs move to 'scratch' (n keys) and each thread fills its own slice of the output
+static void merge_parallel(SortKey *keys, SortKey *scratch, size_t mid, size_t n,
+                           const SortSpec *spec, int threads)
+{
+    memcpy(scratch, keys, n * sizeof(SortKey));
+    const SortKey *left = scratch, *right = scratch + mid;
+    size_t nl = mid, nr = n - mid;
+
+    int parts = threads;
+    if ((size_t) parts > n / SORT_PARALLEL_CUTOFF)
+        parts = (int) (n / SORT_PARALLEL_CUTOFF);
+    if (parts < 1)
+        parts = 1;
+
+    MergePart part[MAX_WORKER_THREADS];
+    size_t i0 = 0, k0 = 0;
+    for (int t = 0; t < parts; t++)
+    {
+        size_t k1 = t == parts - 1 ? n : n / (size_t) parts * (size_t) (t + 1);
+        size_t i1 = merge_split(left, nl, right, nr, k1, spec);
+        part[t] = (MergePart) {left + i0, right + (k0 - i0), i1 - i0, (k1 - i1) - (k0 - i0),
+                               keys + k0, spec, store_current};
+        i0 = i1;
+        k0 = k1;
+    }
+
+    pthread_t tids[MAX_WORKER_THREADS];
+    int started[MAX_WORKER_THREADS] = {0};
+    for (int t = 1; t < parts; t++)
+        started[t] = pthread_create(&tids[t], NULL, merge_part_worker, &part[t]) == 0;
+    merge_runs(&part[0]); // The calling thread takes the first slice
+    for (int t = 1; t < parts; t++)
+    {
+        if (started[t])
+            pthread_join(tids[t], NULL);
+        else
+            merge_runs(&part[t]); // Could not start a thread: merge inline
+    }
+}
+
+static void *sort_task_worker(void *arg)
+{
+    SortTask *task = arg;
+    store_current = task->owner;
+    merge_sort_parallel(task->keys, task->scratch, task->n, task->spec, task->threads);
+    return NULL;
+}
+#endif
+
+// Stable merge sort on up to 'threads' threads, with the same result as merge_sort():
+// the halves are sorted by separate threads until a range drops below SORT_PARALLEL_CUTOFF,
+// and the merges above that are split between threads. 'scratch' must hold n keys.
+void merge_sort_parallel(SortKey *keys, SortKey *scratch, size_t n, const SortSpec *spec,
+                         int threads)
+{
+#ifndef _WIN32
+    if (threads > 1 && n >= 2 * (size_t) SORT_PARALLEL_CUTOFF)
+    {
+        size_t mid = n / 2;
+        SortTask left = {keys, scratch, mid, spec, threads / 2, store_current};
+        pthread_t tid;
+        int started = pthread_create(&tid, NULL, sort_task_worker, &left) == 0;
+        if (!started)
+            sort_task_worker(&left); // Could not start a thread: sort inline
+        merge_sort_parallel(keys + mid, scratch + mid, n - mid, spec, threads - threads / 2);
+        if (started)
+            pthread_join(tid, NULL);
+
+        if (sort_key_cmp(&keys[mid - 1], &keys[mid], spec) > 0)
+            merge_parallel(keys, scratch, mid, n, spec, threads); // Unless already in order
+        return;
+    }
+#else
+    (void) threads;
+#endif
+    merge_sort(keys, scratch, n, spec);
+}
+
+// ----------------- Sorted view -----------------
+
+// Orders two contact positions by the view's spec, then by position (a total order)
+static int sorted_view_cmp(uint32_t a, uint32_t b)
+{
+    int cmp = sort_contact_cmp(a, b, &cur_store()->view.spec, 0);
+    if (cmp != 0)
+        return cmp;
+    return a == b ? 0 : a < b ? -1 : 1;
+}
+
+// Returns the first rank in order[0, n) whose position sorts after 'pos' ('pos' excluded)
+static size_t sorted_view_upper(size_t n, uint32_t pos)
 {
-    printf("//--------Menu---------//\n");   // Menu header
-    printf("1. Add Contact\n");              // Option 1
-    printf("2. View Contacts\n");            // Option 2
-    printf("3. Search Contacts\n");          // Option 3
-    printf("4. Delete Contacts\n");          // Option 4
-    printf("5. Update Contact\n");           // Option 5
-    printf("6. Sort Contacts\n");            // Option 6
-    printf("7. Export Contacts as VCF\n");   // Option 7
-    printf("8. Import Contacts from VCF\n"); // Option 8
-    printf("9. Exit\n");                     // Option 9
+    const uint32_t *order = cur_store()->view.order;
+    size_t lo = 0, hi = n;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (sorted_view_cmp(order[mid], pos) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
 }
 
-// Gets and validates user menu choice
-int get_menu_choice(void)
+// Removes the contact at 'pos' from the view; call before the contact changes or moves.
+// Contacts not merged in yet are not in 'order' and need nothing.
+static void sorted_view_erase(uint32_t pos)
 {
-    int choice;
-    char buffer[50]; // Buffer for input
+    SortedView *v = &cur_store()->view;
+    if (pos >= v->count)
+        return;
+    size_t rank = sorted_view_upper(v->count, pos) - 1; // 'pos' is the last rank not after it
+    memmove(&v->order[rank], &v->order[rank + 1], (v->count - rank - 1) * sizeof(uint32_t));
+    v->count--;
+}
 
-    while (1) // Loop until valid input
+// Puts a contact erased by sorted_view_erase() back at its rank under its new values
+static void sorted_view_insert(uint32_t pos)
+{
+    SortedView *v = &cur_store()->view;
+    size_t rank = sorted_view_upper(v->count, pos);
+    memmove(&v->order[rank + 1], &v->order[rank], (v->count - rank) * sizeof(uint32_t));
+    v->order[rank] = pos;
+    v->count++;
+}
+
+// Drops deleted contacts from the view and moves the others to map[position] after a purge.
+// The map keeps order, so the positions left in 'order' are again [0, count).
+static void sorted_view_renumber(const uint32_t *map)
+{
+    SortedView *v = &cur_store()->view;
+    size_t n = 0;
+    for (size_t i = 0; i < v->count; i++)
+        if (map[v->order[i]] != UINT32_MAX)
+            v->order[n++] = map[v->order[i]];
+    v->count = n;
+}
+
+// Releases the view; the store keeps no order until the next sort
+static void sorted_view_free(SortedView *v)
+{
+    free(v->order);
+    memset(v, 0, sizeof(*v));
+}
+
+// Grows the view so it can hold every contact; on failure the view is dropped (0 = ok)
+static int sorted_view_reserve(void)
+{
+    SortedView *v = &cur_store()->view;
+    if (cur_store()->count <= v->capacity)
+        return 0;
+
+    uint32_t *order = realloc(v->order, cur_store()->count * sizeof(uint32_t));
+    if (!order)
     {
-        printf("Enter your choice: "); // Prompt for input
+        printf("❌ Out of memory: cannot keep the sort order of %zu contacts.\n",
+               cur_store()->count);
+        sorted_view_free(v);
+        return -1;
+    }
+    v->order = order;
+    v->capacity = cur_store()->count;
+    return 0;
+}
 
-        if (fgets(buffer, sizeof(buffer), stdin) != NULL)
-        {
-            // Remove trailing newline
-            buffer[strcspn(buffer, "\n")] = '\0';
+// Brings the view up to date with contacts appended since the last sync: they are sorted
+// among themselves, then merged in from the back, moving every existing entry at most once.
+// Returns 0 on success, -1 on out-of-memory (view dropped) or if no order is kept.
+int sorted_view_sync(void)
+{
+    SortedView *v = &cur_store()->view;
+    if (!v->active)
+        return -1;
+    size_t k = cur_store()->count - v->count;
+    if (k == 0)
+        return 0;
 
-            // Check for empty input
-            if (strlen(buffer) == 0)
-            {
-                printf("Input cannot be empty. Please try again.\n"); // Handle empty input
-                continue;
-            }
+    int threads = k >= 2 * (size_t) SORT_PARALLEL_CUTOFF ? worker_count() : 1;
+    SortKey *keys = malloc((k + (threads > 1 ? k : k / 2 + 1)) * sizeof(SortKey));
+    if (!keys || sorted_view_reserve() != 0)
+    {
+        if (!keys)
+            printf("❌ Out of memory: cannot keep the sort order of %zu contacts.\n",
+                   cur_store()->count);
+        free(keys);
+        sorted_view_free(v);
+        return -1;
+    }
+    for (size_t j = 0; j < k; j++)
+        sort_key_init(&keys[j], (uint32_t) (v->count + j), &v->spec);
+    merge_sort_parallel(keys, keys + k, k, &v->spec, threads);
 
-            // Convert input to number
-            char *endptr;
-            choice = strtol(buffer, &endptr, 10);
-            if (*endptr != '\0')
-            {
-                printf("Invalid input. Please enter a number.\n"); // Handle non-numeric input
-                continue;
-            }
+    size_t settled = v->count, out = cur_store()->count; // Next free slot from the back is out - 1
+    for (size_t j = k; j-- > 0;)
+    {
+        size_t rank = sorted_view_upper(settled, keys[j].pos); // Entries at or after move
+        size_t moved = settled - rank;
+        memmove(&v->order[out - moved], &v->order[rank], moved * sizeof(uint32_t));
+        out -= moved;
+        v->order[--out] = keys[j].pos;
+        settled = rank;
+    }
+    v->count = cur_store()->count;
+    free(keys);
+    return 0;
+}
 
-            // Check range
-            if (choice < 1 || choice > 9)
-            {
-                printf("Choice out of range. Please enter 1-9.\n"); // Handle out-of-range input
-                continue;
-            }
+// Keeps the store's order by 'spec' from now on without moving records, e.g. for contacts
+// loaded from a file saved with that order. Returns 0, or -1 on out-of-memory (no order).
+int sorted_view_restore(const SortSpec *spec)
+{
+    SortedView *v = &cur_store()->view;
+    v->spec = *spec;
+    v->active = 1;
+    v->count = 0; // Every contact is merged in as new
+    return sorted_view_sync();
+}
 
-            return choice; // Return valid choice
+// Sorts the store by 'spec' (stable): sorts compact keys, then moves each record once along
+// the permutation's cycles. The order is then kept as the store's sorted view, which later
+// adds, updates and deletes maintain. Returns 0 on success, -1 on out-of-memory (unchanged).
+int store_sort(const SortSpec *spec)
+{
+    uint64_t started = stats_start();
+    store_purge(); // Only live records take part
+    size_t n = cur_store()->count;
+    if (n > 1)
+    {
+        // One allocation: n keys followed by the scratch used by merge() (the top-level
+        // parallel merges need room for both runs)
+        int threads = n >= 2 * (size_t) SORT_PARALLEL_CUTOFF ? worker_count() : 1;
+        size_t scratch = threads > 1 ? n : n / 2 + 1;
+        SortKey *keys = malloc((n + scratch) * sizeof(SortKey));
+        if (!keys)
+        {
+            printf("❌ Out of memory: cannot sort %zu contacts.\n", n);
+            stats_stop(STAT_SORT, started);
+            return -1;
         }
-        else
+
+        for (size_t i = 0; i < n; i++)
+            sort_key_init(&keys[i], (uint32_t) i, spec);
+        merge_sort_parallel(keys, keys + n, n, spec, threads);
+
+        // keys[i].pos is the record that belongs in slot i; follow each cycle once
+        for (size_t i = 0; i < n; i++)
         {
-            printf("Error reading input. Please try again.\n"); // Handle input error
-            clearerr(stdin);                                    // Clear input error state
+            if (keys[i].pos == i)
+                continue;
+            Contact moved = cur_store()->items[i];
+            size_t j = i;
+            while (keys[j].pos != i)
+            {
+                size_t from = keys[j].pos;
+                cur_store()->items[j] = cur_store()->items[from];
+                keys[j].pos = (uint32_t) j; // Slot filled
+                j = from;
+            }
+            cur_store()->items[j] = moved;
+            keys[j].pos = (uint32_t) j;
         }
+        free(keys);
+        store_repack(arena_live_bytes(cur_store()->items, n)); // Strings follow the records
     }
-}
 
-// ----------------- Helper input functions -----------------
+    indexes_rebuild(); // Positions changed
 
-// Safe line input (fgets + trim newline)
-void get_input(const char *prompt, char *buffer, size_t size)
-{
-    // Prompt
-    printf("%s", prompt);
+    // The records are now in view order, so the view is the identity permutation
+    SortedView *v = &cur_store()->view;
+    v->spec = *spec;
+    v->active = 1;
+    v->count = 0;
+    if (sorted_view_reserve() == 0)
+    {
+        for (size_t i = 0; i < n; i++)
+            v->order[i] = (uint32_t) i;
+        v->count = n;
+    }
 
-    // Use fgets to allow spaces
-    if (fgets(buffer, (int) size, stdin) == NULL)
+    cur_store()->dirty = 1;
+    journal_sort(spec);
+    stats_stop(STAT_SORT, started);
+    return 0;
+}
+
+// Sorts contacts based on user-selected field
+void sort_contacts(void)
+{
+    if (cur_store()->count == cur_store()->deleted)
     {
-        // if EOF or error, ensure buffer is empty string
-        buffer[0] = '\0';
+        printf("No contacts to sort.\n"); // Handle empty contact list
         return;
     }
 
-    // If input didn’t fit into buffer completely, flush leftover
-    if (strchr(buffer, '\n') == NULL)
+    // Display sort options
+    printf("Sort by:\n");
+    printf("1. Name\n");
+    printf("2. Phone\n");
+    printf("3. Email\n");
+    printf("4. Email domain, then name\n");
+    printf("5. Phone country code, then name\n");
+    printf("6. Custom keys\n");
+
+    char choice_str[3]; // Buffer for sort choice
+    get_valid_input("Enter choice (1-6): ", choice_str, sizeof(choice_str),
+                    SORT_CHOICE_REGEX); // Get sort choice
+
+    int choice = choice_str[0] - '0'; // Convert char to int
+
+    SortSpec spec = {.count = 1};
+    switch (choice)
     {
-        int ch;
-        while ((ch = getchar()) != '\n' && ch != EOF)
-            ; // flush until newline
+        case 1:
+            spec.keys[0] = SORT_BY_NAME;
+            break; // Set sort by name
+        case 2:
+            spec.keys[0] = SORT_BY_PHONE;
+            break; // Set sort by phone
+        case 3:
+            spec.keys[0] = SORT_BY_EMAIL;
+            break; // Set sort by email
+        case 4:
+            spec = (SortSpec) {{SORT_BY_DOMAIN, SORT_BY_NAME}, 2};
+            break; // Set sort by domain, then name
+        case 5:
+            spec = (SortSpec) {{SORT_BY_COUNTRY, SORT_BY_NAME}, 2};
+            break; // Set sort by country code, then name
+        case 6:
+        {
+            char keys[64]; // Buffer for the key list
+            get_valid_input("Keys (name, phone, email, domain, country; e.g. domain,name): ",
+                            keys, sizeof(keys), SORT_SPEC_REGEX);
+            if (sort_spec_parse(keys, &spec) != 0)
+            {
+                printf("❌ Unknown sort key in \"%s\".\n", keys);
+                return;
+            }
+            break;
+        }
+        default:
+            printf("Invalid choice.\n"); // Handle invalid choice (shouldn't occur due to regex)
+            return;
     }
 
-    // Trim trailing newline if present
-    buffer[strcspn(buffer, "\n")] = '\0';
+    if (store_sort(&spec) == 0)                    // Sort contacts
+        printf("Contacts sorted successfully!\n"); // Confirm sort
+}
 
-    trim_whitespace(buffer);
+// ----------------- Command line -----------------
+
+#define CLI_MAX_FIELDS 8     // Fields in one operation, verb included
+#define CLI_LINE_LENGTH 1024 // Longest operation line in a batch file
+
+// State of a non-interactive run. Results are written for other programs as tab-separated
+// lines, one status line per operation ("<op>\tok\t<count>" or "<op>\terror\t<message>"),
+// each preceded by the contacts it returns ("<op>\tcontact\t<name>\t<phone>\t<email>\t<id>").
+// Operations name a contact by its name or by "#<id>".
+typedef struct
+{
+    OutBuf out;    // Result lines (the real standard output)
+    size_t op;     // Number of the operation being run: its batch file line, or 1
+    size_t failed; // Operations that failed
+    int changed;   // 1 once an operation has changed the store
+    int remote;    // 1 for a server connection: no standard input or output ("-")
+} CliRun;
+
+// Starts a result line for the current operation: "<op>\t<kind>"
+static void cli_line(CliRun *r, const char *kind)
+{
+    outbuf_rank(&r->out, r->op, 0);
+    outbuf_puts(&r->out, "\t");
+    outbuf_put(&r->out, kind, strlen(kind));
 }
 
-// Core function for validated input
-// allow_empty = 0 → empty input is rejected
-// allow_empty = 1 → empty input is accepted
-// Validate input with regex, optionally allow empty input
-void get_validated_input(const char *prompt, char *buffer, size_t size, const char *pattern,
-                         int allow_empty)
+// Reports success, with the number of contacts the operation returned or changed
+static int cli_ok(CliRun *r, size_t count)
 {
-    while (1)
+    cli_line(r, "ok");
+    outbuf_puts(&r->out, "\t");
+    outbuf_rank(&r->out, count, 0);
+    outbuf_puts(&r->out, "\n");
+    return 0;
+}
+
+// Reports a failed operation; 'detail' (may be NULL) is appended to the message
+static int cli_error(CliRun *r, const char *message, const char *detail)
+{
+    cli_line(r, "error");
+    outbuf_puts(&r->out, "\t");
+    outbuf_put(&r->out, message, strlen(message));
+    if (detail)
+        outbuf_put(&r->out, detail, strlen(detail));
+    outbuf_puts(&r->out, "\n");
+    r->failed++;
+    return -1;
+}
+
+// Writes one contact returned by the current operation
+static void cli_contact(CliRun *r, const Contact *c)
+{
+    cli_line(r, "contact");
+    for (int f = 0; f < FIELD_COUNT; f++)
     {
-        get_input(prompt, buffer, size);
+        outbuf_puts(&r->out, "\t");
+        outbuf_put(&r->out, contact_field(c, (ContactField) f), c->len[f]);
+    }
+    outbuf_puts(&r->out, "\t");
+    outbuf_u64(&r->out, c->id);
+    outbuf_puts(&r->out, "\n");
+}
 
-        // Empty input handling
-        if (buffer[0] == '\0')
+// Position of the contact an operation refers to: "#<id>" by ID, anything else by name
+// (names start with a letter). Returns -1 if there is no such contact.
+static long cli_find(const char *ref)
+{
+    uint64_t id;
+    if (ref[0] != '#')
+        return store_find_name(ref);
+    if (!ref[1] || parse_contact_id(ref + 1, ref + strlen(ref), &id) != 0)
+        return -1;
+    return store_find_id(id);
+}
+
+// 1 if 'value' is a valid, non-empty value for 'field', checked like a bulk load
+static int cli_valid(ContactField field, const char *value)
+{
+    static const size_t max_len[FIELD_COUNT] = {MAX_NAME_LENGTH - 1, MAX_PHONE_LENGTH - 1,
+                                                MAX_EMAIL_LENGTH - 1};
+    size_t len = strlen(value);
+    return len > 0 && len <= max_len[field] && validate_field(field, value, len);
+}
+
+// Field named 'text' ("name", "phone" or "email"), or -1
+static int cli_field(const char *text)
+{
+    static const char *const names[FIELD_COUNT] = {"name", "phone", "email"};
+    for (int f = 0; f < FIELD_COUNT; f++)
+        if (strcmp(text, names[f]) == 0)
+            return f;
+    return -1;
+}
+
+// Runs one operation: 'argv' holds the verb and its arguments, already trimmed.
+// Returns 0, or -1 after reporting an error
+static int cli_apply(CliRun *r, int argc, char *argv[])
+{
+    static const char *const field_errors[FIELD_COUNT] = {"invalid name: ", "invalid phone: ",
+                                                          "invalid email: "};
+    const char *verb = argv[0];
+    if (strcmp(verb, "add") == 0 && argc == 4)
+    {
+        for (int f = 0; f < FIELD_COUNT; f++)
+            if (!cli_valid((ContactField) f, argv[1 + f]))
+                return cli_error(r, field_errors[f], argv[1 + f]);
+        if (store_find_name(argv[1]) >= 0)
+            return cli_error(r, "name already exists: ", argv[1]);
+        if (!store_add(argv[1], argv[2], argv[3]))
+            return cli_error(r, "out of memory", NULL);
+        r->changed = 1;
+        return cli_ok(r, 1);
+    }
+    if ((strcmp(verb, "get") == 0 || strcmp(verb, "delete") == 0) && argc == 2)
+    {
+        long i = cli_find(argv[1]);
+        if (i < 0)
+            return cli_error(r, "not found: ", argv[1]);
+        if (verb[0] == 'g')
+            cli_contact(r, &cur_store()->items[i]);
+        else
         {
-            if (allow_empty)
-                return; // accept empty if allowed
-            printf("❌ Input cannot be empty. Please try again.\n");
-            continue;
+            store_remove((size_t) i);
+            r->changed = 1;
         }
-
-        // Length check
-        if (strlen(buffer) >= size)
+        return cli_ok(r, 1);
+    }
+    if (strcmp(verb, "delete-domain") == 0 && argc == 2)
+    {
+        const char *domain = argv[1][0] == '@' ? argv[1] + 1 : argv[1];
+        if (!domain[0] || strchr(domain, '@'))
+            return cli_error(r, "invalid domain: ", argv[1]);
+        size_t removed = store_remove_matching(contact_in_domain, domain);
+        r->changed |= removed > 0;
+        return cli_ok(r, removed);
+    }
+    if (strcmp(verb, "update") == 0 && argc == 4)
+    {
+        int field = cli_field(argv[2]);
+        long i = cli_find(argv[1]);
+        if (i < 0)
+            return cli_error(r, "not found: ", argv[1]);
+        if (field < 0)
+            return cli_error(r, "unknown field: ", argv[2]);
+        if (!cli_valid((ContactField) field, argv[3]))
+            return cli_error(r, field_errors[field], argv[3]);
+        if (field == FIELD_NAME && store_name_taken(argv[3], i))
+            return cli_error(r, "name already exists: ", argv[3]);
+        if (store_set_field(&cur_store()->items[i], (ContactField) field, argv[3]) != 0)
+            return cli_error(r, "out of memory", NULL);
+        r->changed = 1;
+        return cli_ok(r, 1);
+    }
+    if (strcmp(verb, "search") == 0 && argc == 3)
+    {
+        static const char *const types[] = {"exact", "partial", "phone", "email", "fuzzy"};
+        int type = 0;
+        while (type < 5 && strcmp(argv[1], types[type]) != 0)
+            type++;
+        if (type == 5)
+            return cli_error(r, "unknown search type: ", argv[1]);
+
+        const char *query = argv[2];
+        char lower[MAX_EMAIL_LENGTH];
+        if (strlen(query) >= sizeof(lower) ||
+            (type == 2 && !validate_with_regex(PHONE_QUERY_REGEX, query)))
+            return cli_error(r, "invalid query: ", query);
+
+        uint32_t fuzzy[FUZZY_TOP_K];
+        uint32_t *matches = fuzzy;
+        long found;
+        if (type == 4)
+            found = collect_fuzzy_matches(query, fuzzy);
+        else if (type == 1)
         {
-            printf("❌ Input too long. Maximum length is %zu characters.\n", size - 1);
-            continue;
+            fold_key(query, strlen(query), lower);
+            found = collect_partial_matches(lower, &matches);
         }
-
-        // Validate regex if provided
-        if (pattern == NULL || validate_with_regex(pattern, buffer))
+        else
         {
-            return; // ✅ Valid input
+            HashIndex *ix = store_index(type == 2   ? FIELD_PHONE
+                                        : type == 3 ? FIELD_EMAIL
+                                                    : FIELD_NAME);
+            found = ix ? collect_index_matches(ix, query, &matches) : -1;
+        }
+        if (found < 0)
+            return cli_error(r, "out of memory", NULL);
+        for (long k = 0; k < found; k++)
+            cli_contact(r, &cur_store()->items[matches[k]]);
+        if (matches != fuzzy)
+            free(matches);
+        return cli_ok(r, (size_t) found);
+    }
+    if (strcmp(verb, "import") == 0 && (argc == 2 || argc == 3))
+    {
+        static const char *const policies[] = {"skip", "overwrite", "newest", "merge"};
+        int policy = 0;
+        while (argc == 3 && policy < 4 && strcmp(argv[2], policies[policy]) != 0)
+            policy++;
+        if (policy == 4)
+            return cli_error(r, "unknown duplicate policy: ", argv[2]);
+        if (r->remote && strcmp(argv[1], "-") == 0)
+            return cli_error(r, "standard input is not available to clients", NULL);
+        long n = import_from_vcf(argv[1], (ImportPolicy) policy);
+        r->changed = 1; // Even a failed import keeps what it merged
+        if (n < 0)
+            return cli_error(r, "import failed: ", argv[1]);
+        return cli_ok(r, (size_t) n);
+    }
+    if (strcmp(verb, "export") == 0 && argc == 2)
+    {
+        int to_stdout = strcmp(argv[1], "-") == 0;
+        if (r->remote && to_stdout)
+            return cli_error(r, "standard output is not available to clients", NULL);
+        if (to_stdout)
+            outbuf_finish(&r->out); // Results so far go out before the cards
+        int failed = export_to_vcf(argv[1]);
+        if (to_stdout)
+            outbuf_init(&r->out, result_stream, 0);
+        if (failed)
+            return cli_error(r, "export failed: ", argv[1]);
+        return cli_ok(r, cur_store()->count);
+    }
+    if (strcmp(verb, "sort") == 0 && argc >= 2 && argc <= 1 + SORT_SPEC_MAX_KEYS)
+    {
+        char keys[64] = ""; // Keys given one per field or comma-separated in one
+        for (int k = 1; k < argc; k++)
+        {
+            size_t used = strlen(keys);
+            snprintf(keys + used, sizeof(keys) - used, "%s%s", k > 1 ? "," : "", argv[k]);
+        }
+        SortSpec spec;
+        if (!validate_with_regex(SORT_SPEC_REGEX, keys) || sort_spec_parse(keys, &spec) != 0)
+            return cli_error(r, "unknown sort keys: ", keys);
+        if (store_sort(&spec) != 0)
+            return cli_error(r, "out of memory", NULL);
+        r->changed = 1;
+        return cli_ok(r, cur_store()->count);
+    }
+    if (strcmp(verb, "stats") == 0 && argc == 1)
+    {
+        StatRow rows[STAT_ROWS_MAX];
+        size_t n = stats_rows(rows);
+        if (n == 0)
+            return cli_error(r, "statistics not compiled in (build with -DCMS_STATS)", NULL);
+        for (size_t i = 0; i < n; i++)
+        {
+            cli_line(r, rows[i].kind);
+            outbuf_puts(&r->out, "\t");
+            outbuf_put(&r->out, rows[i].name, strlen(rows[i].name));
+            int values = rows[i].kind[0] == 't' ? 3 : rows[i].kind[0] == 'r' ? 2 : 1;
+            for (int k = 0; k < values; k++)
+            {
+                outbuf_puts(&r->out, "\t");
+                outbuf_u64(&r->out, rows[i].value[k]);
+            }
+            outbuf_puts(&r->out, "\n");
         }
+        return cli_ok(r, n);
+    }
+    return cli_error(r, "unknown operation or wrong number of arguments: ", verb);
+}
 
-        // Give user an idea of expected format
-        const char *format_msg;
-        if (strcmp(pattern, NAME_REGEX) == 0)
+// Runs the operation on one line of the batch syntax ("verb, arg, ..."), modifying 'line';
+// blank lines and comments ('#') are skipped
+static void cli_line_apply(CliRun *r, char *line)
+{
+    line[strcspn(line, "\r\n")] = '\0';
+    trim_whitespace(line);
+    if (line[0] == '\0' || line[0] == '#')
+        return;
+
+    char *fields[CLI_MAX_FIELDS];
+    int n = 0;
+    for (char *p = line; p && n < CLI_MAX_FIELDS; n++)
+    {
+        fields[n] = p;
+        p = strchr(p, ',');
+        if (p)
+            *p++ = '\0';
+        trim_whitespace(fields[n]);
+    }
+    cli_apply(r, n, fields);
+}
+
+// Applies every operation in 'path' ("-" = standard input), one per line, fields separated
+// by commas as in contacts.txt: "add, Jane Doe, +14155552671, jane@example.com". Blank
+// lines and lines starting with '#' are skipped. Returns -1 if the file cannot be read.
+static int cli_batch(CliRun *r, const char *path)
+{
+    int from_stdin = strcmp(path, "-") == 0;
+    FILE *fp = from_stdin ? stdin : fopen(path, "r");
+    if (!fp)
+    {
+        printf("❌ Could not open %s for reading.\n", path);
+        return -1;
+    }
+
+    char line[CLI_LINE_LENGTH];
+    for (r->op = 1; fgets(line, sizeof(line), fp); r->op++)
+    {
+        if (!strchr(line, '\n') && !feof(fp))
         {
-            format_msg = "Letters, spaces, hyphens, or apostrophes (1-49 chars)";
+            int ch;
+            while ((ch = fgetc(fp)) != '\n' && ch != EOF)
+                ; // Skip the rest of the line
+            cli_error(r, "line too long", NULL);
+            continue;
         }
-        else if (strcmp(pattern, PHONE_REGEX) == 0)
+        cli_line_apply(r, line);
+    }
+    int failed = ferror(fp);
+    if (!from_stdin)
+        fclose(fp);
+    if (failed)
+    {
+        printf("❌ Error while reading %s.\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// ----------------- Server -----------------
+
+#define SERVER_BACKLOG 128             // Connections the listening socket queues
+#define SERVER_READ_SIZE (64u << 10)   // Bytes read from a client at a time
+#define SERVER_MAX_EVENTS 256          // Readiness events taken per wait (epoll)
+#define SERVER_OUT_LIMIT (4u << 20)    // Unsent response bytes at which a client is not read
+#define SERVER_ACCEPT_RETRY_MS 1000    // Wait before accepting again after running out of fds
+
+#ifndef _WIN32
+// Results of one request that changed the store in the current round. They are sent only
+// once the round's journal sync succeeded, and are replaced by an error line if it failed.
+typedef struct
+{
+    size_t start, end; // Bytes of the request's result lines in ServerConn.run.out
+    size_t op;         // The request's number on the connection
+} ServerWrite;
+
+// One client. Requests are lines in the batch file syntax, answered in order with the same
+// result lines as the command line, numbered by the request's line on the connection.
+typedef struct
+{
+    int fd;                   // Socket
+    size_t slot;              // Position in Server.conns
+    CliRun run;               // Responses waiting to be sent (in memory) and numbering
+    ServerWrite *writes;      // Requests of this round that changed the store
+    size_t write_count;       // Entries in 'writes'
+    size_t write_capacity;    // Entries allocated in 'writes'
+    OutBuf requests;          // Bytes received in this round, answered after reading
+    size_t in_len;            // Bytes of an unfinished request line in 'in'
+    int discarding;           // 1 while skipping the rest of an over-long line
+    int closing;              // 1 once the client hung up or sent "quit"
+    int ready;                // 1 if the socket was reported ready in this round
+    int reader;               // 1 if a reader thread answers this round's requests
+    int events;               // Readiness the loop waits for (SERVER_READ / SERVER_WRITE)
+    char in[CLI_LINE_LENGTH]; // Start of the next request line
+} ServerConn;
+
+#define SERVER_READ 1  // Wait for requests
+#define SERVER_WRITE 2 // Wait for room to send responses
+
+// Listening socket and clients
+typedef struct
+{
+    int listen_fd;     // Accepts connections
+    int epoll_fd;      // Readiness of every socket (-1 = poll() each round)
+    int accept_paused; // 1 while the listening socket is out of the wait set (no fds left)
+    ServerConn **conns; // Connected clients
+    size_t count;      // Clients in 'conns'
+    size_t capacity;   // Entries allocated in 'conns'
+} Server;
+
+static volatile sig_atomic_t server_stop = 0; // Set by SIGINT or SIGTERM
+static int server_read_only = 0; // Set once the journal could not be synced: writes refused
+static int server_line_reads(const char *p, size_t n, int cut); // 1 for a read-only request
+
+static void server_signal(int sig)
+{
+    (void) sig;
+    server_stop = 1;
+}
+
+// Opens the listening socket for "unix:PATH" or "[HOST]:PORT" (HOST defaults to loopback)
+// Returns the socket, or -1 after printing why it failed
+static int server_listen(const char *address)
+{
+    int fd = -1;
+    if (strncmp(address, "unix:", 5) == 0)
+    {
+        struct sockaddr_un sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sun_family = AF_UNIX;
+        if (strlen(address + 5) >= sizeof(sa.sun_path))
         {
-            format_msg = "10-15 digits, optional + e.g., (International: +14155552671), (Indian: "
-                         "+919876543210 or 9876543210)";
+            printf("❌ Socket path too long: %s\n", address + 5);
+            return -1;
         }
-        else if (strcmp(pattern, CONFIRM_REGEX) == 0)
+        strcpy(sa.sun_path, address + 5);
+
+        struct stat st;
+        if (stat(sa.sun_path, &st) == 0 && S_ISSOCK(st.st_mode))
+            unlink(sa.sun_path); // Left behind by a previous server
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr *) &sa, sizeof(sa)) != 0 ||
+            listen(fd, SERVER_BACKLOG) != 0)
         {
-            format_msg = "Single character: 'y' or 'n'";
+            printf("❌ Cannot listen on %s.\n", address);
+            if (fd >= 0)
+                close(fd);
+            return -1;
         }
-        else if (strcmp(pattern, "^[1-2]$") == 0)
+    }
+    else
+    {
+        const char *colon = strrchr(address, ':');
+        if (!colon || !colon[1])
         {
-            format_msg = "1 or 2";
+            printf("❌ Expected unix:PATH or HOST:PORT, got '%s'.\n", address);
+            return -1;
         }
-        else if (strcmp(pattern, SORT_CHOICE_REGEX) == 0)
+        char host[256];
+        size_t host_len = (size_t) (colon - address);
+        if (host_len >= sizeof(host))
+            host_len = sizeof(host) - 1;
+        memcpy(host, address, host_len);
+        host[host_len] = '\0';
+
+        struct addrinfo hints, *list = NULL;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        if (getaddrinfo(host[0] ? host : "127.0.0.1", colon + 1, &hints, &list) != 0)
         {
-            if (!validate_with_regex("^[0-9]+$", buffer))
-            {
-                format_msg = "❌ Invalid input. Enter a number (1-3).";
-            }
-            else
+            printf("❌ Cannot resolve %s.\n", address);
+            return -1;
+        }
+        for (struct addrinfo *ai = list; ai && fd < 0; ai = ai->ai_next)
+        {
+            fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            int on = 1;
+            if (fd >= 0 && (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+                            bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 ||
+                            listen(fd, SERVER_BACKLOG) != 0))
             {
-                format_msg = "❌ Choice out of range. Enter between 1 and 3.";
+                close(fd);
+                fd = -1;
             }
         }
-        else
+        freeaddrinfo(list);
+        if (fd < 0)
         {
-            format_msg = "Valid email (e.g., user@domain.com)";
+            printf("❌ Cannot listen on %s.\n", address);
+            return -1;
         }
-        printf("Expected format: %s\n", format_msg);
     }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
 }
 
-// Strict input validation (no empty input allowed)
-void get_valid_input(const char *prompt, char *buffer, size_t size, const char *pattern)
-{
-    get_validated_input(prompt, buffer, size, pattern,
-                        0); // Call validated input with no empty allowed
-}
-
-// Optional input validation (empty input allowed)
-void get_optional_valid_input(const char *prompt, char *buffer, size_t size, const char *pattern)
+// Updates what the loop waits for on a client: requests while its unsent responses are
+// below SERVER_OUT_LIMIT, room to send while any are left
+static void server_watch(Server *s, ServerConn *k)
 {
-    get_validated_input(prompt, buffer, size, pattern,
-                        1); // Call validated input with empty allowed
+    int events = (!k->closing && k->run.out.len < SERVER_OUT_LIMIT ? SERVER_READ : 0) |
+                 (k->run.out.len ? SERVER_WRITE : 0);
+    if (events == k->events)
+        return;
+    k->events = events;
+#ifdef __linux__
+    if (s->epoll_fd >= 0)
+    {
+        struct epoll_event ev = {0};
+        ev.events = (events & SERVER_READ ? EPOLLIN : 0) | (events & SERVER_WRITE ? EPOLLOUT : 0);
+        ev.data.ptr = k;
+        epoll_ctl(s->epoll_fd, EPOLL_CTL_MOD, k->fd, &ev);
+    }
+#else
+    (void) s;
+#endif
 }
 
-// ----------------- Add contact -----------------
-
-// Adds a new contact to the contacts array
-void add_contacts(void)
+// Puts the listening socket in the wait set, or takes it out while no descriptor is left
+// for a new client: a pending connection keeps it readable, so every wait would return
+static void server_listening(Server *s, int on)
 {
-    if (contact_count >= MAX_CONTACTS)
+    s->accept_paused = !on;
+#ifdef __linux__
+    if (s->epoll_fd >= 0)
     {
-        printf("Contact list is full. Cannot add more contacts\n"); // Handle full contact list
-        return;
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL; // The listening socket
+        epoll_ctl(s->epoll_fd, on ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, s->listen_fd, &ev);
     }
-
-    // Get and validate contact details
-    get_valid_input("Enter name (1-49 chars): ", contacts[contact_count].name, MAX_NAME_LENGTH,
-                    NAME_REGEX); // Get name
-    get_valid_input(
-        "Enter phone e.g., (International: +14155552671), (Indian: +919876543210 or 9876543210): ",
-        contacts[contact_count].phone, MAX_PHONE_LENGTH, PHONE_REGEX); // Get phone
-    get_valid_input("Enter email (e.g., user@domain.com): ", contacts[contact_count].email,
-                    MAX_EMAIL_LENGTH, EMAIL_REGEX); // Get email
-
-    contact_count++; // Increment contact count
-
-    // Display added contact
-    printf("\nContact added:\n");
-    printf("%s\n", contacts[contact_count - 1].name);  // Show name
-    printf("%s\n", contacts[contact_count - 1].phone); // Show phone
-    printf("%s\n", contacts[contact_count - 1].email); // Show email
+#endif
 }
 
-// ----------------- View contacts -----------------
-
-// Displays all contacts in a formatted table
-void view_contacts(void)
+// Accepts every pending connection. Out of descriptors, the rest wait in the backlog until
+// a client disconnects or SERVER_ACCEPT_RETRY_MS has passed.
+static void server_accept(Server *s)
 {
-    if (contact_count == 0)
+    int fd;
+    while ((fd = accept(s->listen_fd, NULL, NULL)) >= 0)
     {
-        printf("No contacts in Contact manager, add yours :)\n"); // Handle empty contact list
-        return;
-    }
-
-    // Print table header
-    printf("\n📒 Contact List (%d):\n", contact_count);
-    printf("-------------------------------------------------------------------------\n");
-    printf("%-3s %-30s %-16s %-25s\n", "#", "Name", "Phone", "Email");
-    printf("-------------------------------------------------------------------------\n");
+        ServerConn *k = malloc(sizeof(ServerConn));
+        if (s->count == s->capacity)
+        {
+            size_t capacity = s->capacity ? s->capacity * 2 : 16;
+            ServerConn **conns = realloc(s->conns, capacity * sizeof(ServerConn *));
+            if (conns)
+            {
+                s->conns = conns;
+                s->capacity = capacity;
+            }
+        }
+        if (!k || s->count == s->capacity)
+        {
+            printf("❌ Out of memory: connection refused.\n");
+            free(k);
+            close(fd);
+            continue;
+        }
 
-    // Print each contact
-    for (int i = 0; i < contact_count; i++)
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // Fails harmlessly on Unix
+                                                                     // sockets
+        memset(k, 0, sizeof(*k));
+        k->fd = fd;
+        k->slot = s->count;
+        k->run.remote = 1;
+        k->events = SERVER_READ;
+        outbuf_init(&k->run.out, NULL, 0);
+        outbuf_init(&k->requests, NULL, 0);
+        s->conns[s->count++] = k;
+#ifdef __linux__
+        if (s->epoll_fd >= 0)
+        {
+            struct epoll_event ev = {0};
+            ev.events = EPOLLIN;
+            ev.data.ptr = k;
+            epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+        }
+#endif
+    }
+    if (errno == EMFILE || errno == ENFILE)
     {
-        printf("%-3d %-30.30s %-16.16s %-25.25s\n", i + 1, contacts[i].name, contacts[i].phone,
-               contacts[i].email);
+        printf("⚠️ Not accepting connections: out of file descriptors with %zu client(s).\n",
+               s->count);
+        server_listening(s, 0);
     }
-    printf("-------------------------------------------------------------------------\n"); // Print
-                                                                                           // table
-                                                                                           // footer
 }
 
-// ----------------- Update contact -----------------
-
-// Updates an existing contact's details
-void update_contact(void)
+// Answers the request line in k->in, noting where its results are if it changed the store
+static void server_apply(ServerConn *k)
 {
-    if (contact_count == 0)
+    if (server_line_reads(k->in, strlen(k->in), 0))
     {
-        printf("No contacts in Contact manager, add yours :)\n"); // Handle empty contact list
+        cli_line_apply(&k->run, k->in);
         return;
     }
-
-    char name[MAX_NAME_LENGTH];
-    get_valid_input("Enter name to update: ", name, MAX_NAME_LENGTH,
-                    NAME_REGEX); // Get name to update
-
-    int found = 0;
-    for (int i = 0; i < contact_count; i++)
+    if (server_read_only)
+    {
+        cli_error(&k->run, "writes are refused: could not sync " JOURNAL_PATH, NULL);
+        return;
+    }
+    if (k->write_count == k->write_capacity)
     {
-        if (strcasecmp(contacts[i].name, name) == 0) // Case-insensitive name match
+        size_t capacity = k->write_capacity ? k->write_capacity * 2 : 16;
+        ServerWrite *writes = realloc(k->writes, capacity * sizeof(ServerWrite));
+        if (!writes)
         {
-            found = 1;                       // Mark contact as found
-            printf("\n📞 Contact Found:\n"); // Display found contact
-            printf("Name: %s\n", contacts[i].name);
-            printf("Phone: %s\n", contacts[i].phone);
-            printf("Email: %s\n\n", contacts[i].email);
-
-            printf("Enter new details (press Enter to keep existing value)\n"); // Prompt for new
-                                                                                // details
+            cli_error(&k->run, "out of memory", NULL);
+            return;
+        }
+        k->writes = writes;
+        k->write_capacity = capacity;
+    }
 
-            char new_name[MAX_NAME_LENGTH];
-            char new_email[MAX_EMAIL_LENGTH];
-            char new_phone[MAX_PHONE_LENGTH];
-            int updated = 0; // Track if updates were made
+    size_t start = k->run.out.len;
+    k->run.changed = 0;
+    cli_line_apply(&k->run, k->in);
+    if (k->run.changed)
+        k->writes[k->write_count++] = (ServerWrite) {start, k->run.out.len, k->run.op};
+}
 
-            // Update name
-            get_optional_valid_input("Enter new name (1-49 chars): ", new_name, MAX_NAME_LENGTH,
-                                     NAME_REGEX);
-            if (new_name[0] != '\0' && strcmp(new_name, contacts[i].name) != 0)
+// Splits received bytes into request lines and answers each complete one
+static void server_take(ServerConn *k, const char *p, size_t n)
+{
+    while (n)
+    {
+        const char *nl = memchr(p, '\n', n);
+        size_t len = nl ? (size_t) (nl - p) : n;
+        if (k->discarding)
+            k->discarding = !nl; // Up to the end of the over-long line
+        else if (k->in_len + len >= sizeof(k->in))
+        {
+            k->run.op++;
+            cli_error(&k->run, "line too long", NULL);
+            k->in_len = 0;
+            k->discarding = !nl;
+        }
+        else
+        {
+            memcpy(k->in + k->in_len, p, len);
+            k->in_len += len;
+            if (nl)
             {
-                // Check for duplicate name
-                for (int j = 0; j < contact_count; j++)
+                k->in[k->in_len] = '\0';
+                k->in_len = 0;
+                k->run.op++;
+                trim_whitespace(k->in); // Also drops the '\r' of CRLF clients
+                if (strcmp(k->in, "quit") == 0)
                 {
-                    if (j != i && strcasecmp(contacts[j].name, new_name) == 0)
-                    {
-                        printf("Cannot update: Name '%s' already exists.\n",
-                               new_name); // Handle duplicate name
-                        return;
-                    }
+                    k->closing = 1;
+                    return; // Later requests are not answered
                 }
-                printf("Name: '%s' → '%s'\n", contacts[i].name, new_name); // Show name change
-                snprintf(contacts[i].name, sizeof(contacts[i].name), "%s", new_name); // Update name
-                updated = 1;
+                server_apply(k);
             }
-
-            // Update phone
-            get_optional_valid_input("Enter new phone e.g., (International: +14155552671), "
-                                     "(Indian: +919876543210 or 9876543210): ",
-                                     new_phone, MAX_PHONE_LENGTH, PHONE_REGEX);
-            if (new_phone[0] != '\0' && strcmp(new_phone, contacts[i].phone) != 0)
-            {
-                printf("Phone: '%s' → '%s'\n", contacts[i].phone, new_phone); // Show phone change
-                snprintf(contacts[i].phone, sizeof(contacts[i].phone), "%s",
-                         new_phone); // Update phone
-                updated = 1;
-            }
-
-            // Update email
-            get_optional_valid_input("Enter new email (e.g., user@domain.com): ", new_email,
-                                     MAX_EMAIL_LENGTH, EMAIL_REGEX);
-            if (new_email[0] != '\0' && strcmp(new_email, contacts[i].email) != 0)
-            {
-                printf("Email: '%s' → '%s'\n", contacts[i].email, new_email); // Show email change
-                snprintf(contacts[i].email, sizeof(contacts[i].email), "%s",
-                         new_email); // Update email
-                updated = 1;
-            }
-
-            if (updated)
-                printf("\n✅ Contact updated successfully!\n\n"); // Confirm update
-            else
-            {
-                printf("\nℹ️ No changes were made to the contact.\n"); // No changes made
-                printf("Name: %s\n", contacts[i].name);
-                printf("Phone: %s\n", contacts[i].phone);
-                printf("Email: %s\n\n", contacts[i].email);
-            }
-            break; // Exit loop after updating
         }
+        if (!nl)
+            return;
+        p = nl + 1;
+        n -= len + 1;
     }
+}
 
-    if (!found)
+// Receives what the client has sent, up to SERVER_READ_SIZE bytes a round and none once
+// enough responses are waiting; the rest is read in later rounds
+static void server_read(ServerConn *k)
+{
+    static char chunk[SERVER_READ_SIZE];
+    while (!k->closing && k->run.out.len < SERVER_OUT_LIMIT &&
+           k->requests.len < SERVER_READ_SIZE)
     {
-        printf("Contact '%s' not found.\n", name); // Handle contact not found
+        ssize_t n = recv(k->fd, chunk, sizeof(chunk) - k->requests.len, 0);
+        if (n > 0)
+            outbuf_put(&k->requests, chunk, (size_t) n);
+        else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            k->closing = 1; // Hung up: answer what it sent, then close
+        else if (errno != EINTR)
+            break; // Nothing more for now
     }
 }
 
-// ----------------- Delete contacts -----------------
-
-// Deletes a contact by name
-void delete_contacts(void)
+// Answers the requests received in this round; the responses go out together in
+// server_settle()
+static void server_answer(ServerConn *k)
 {
-    if (contact_count == 0)
+    if (k->requests.failed)
     {
-        printf("No contacts to delete.\n"); // Handle empty contact list
-        return;
+        k->run.op++;
+        cli_error(&k->run, "out of memory", NULL);
+        k->closing = 1; // Requests were lost: the numbering cannot be trusted any more
     }
+    else
+        server_take(k, k->requests.data, k->requests.len);
+    outbuf_consume(&k->requests, k->requests.len);
+}
 
-    char name[MAX_NAME_LENGTH];
-    get_valid_input("Enter name to delete: ", name, MAX_NAME_LENGTH,
-                    NAME_REGEX); // Get name to delete
-
-    int found = 0;
-
-    for (int i = 0; i < contact_count; i++)
+// 1 if a request line (its first 'n' bytes; 'cut' if it goes on) only reads the store:
+// get, search, quit, a comment or nothing
+static int server_line_reads(const char *p, size_t n, int cut)
+{
+    static const char *const verbs[] = {"get", "search", "stats", "quit"};
+    while (n && isspace((unsigned char) *p))
     {
-        if (strcasecmp(contacts[i].name, name) == 0) // Case-insensitive name match
-        {
-            found = 1; // Mark contact as found
-
-            printf("\n📞 Contact Found:\n"); // Display found contact
-            printf("Name: %s\n", contacts[i].name);
-            printf("Phone: %s\n", contacts[i].phone);
-            printf("Email: %s\n", contacts[i].email);
-
-            char confirm[2];
-            get_valid_input("Are you sure you want to delete this contact? [y/n]: ", confirm,
-                            sizeof(confirm), CONFIRM_REGEX); // Get confirmation
-
-            if (confirm[0] == 'y' || confirm[0] == 'Y')
-            {
-                // Shift contacts left to remove the contact
-                for (int j = i; j < contact_count - 1; j++)
-                {
-                    contacts[j] = contacts[j + 1];
-                }
-
-                // Clear the last contact slot
-                memset(&contacts[contact_count - 1], 0, sizeof(Contact));
-
-                contact_count--;                                           // Decrease contact count
-                printf("✅ Contact '%s' deleted successfully.\n\n", name); // Confirm deletion
-            }
-            else
-            {
-                printf("❌ Deletion cancelled.\n\n"); // Cancellation message
-            }
+        p++;
+        n--;
+    }
+    if (n == 0 || *p == '#')
+        return n || !cut;
+    for (size_t v = 0; v < sizeof(verbs) / sizeof(verbs[0]); v++)
+    {
+        size_t len = strlen(verbs[v]);
+        if (n >= len && memcmp(p, verbs[v], len) == 0 &&
+            (n > len ? p[len] == ',' || isspace((unsigned char) p[len]) : !cut))
+            return 1;
+    }
+    return 0;
+}
 
-            break; // Exit loop after handling contact
-        }
+// 1 if every request line completed in this round only reads the store, so a reader
+// thread can answer the client from the published copy
+static int server_reads_only(const ServerConn *k)
+{
+    const char *p = k->requests.data, *end = p + k->requests.len;
+    if (k->requests.failed)
+        return 0;
+    if (k->discarding || k->in_len)
+    { // The first line began in an earlier round
+        const char *nl = memchr(p, '\n', (size_t) (end - p));
+        if (!nl)
+            return 1; // Nothing is answered yet
+        char head[32];
+        size_t n = k->in_len < sizeof(head) ? k->in_len : sizeof(head);
+        size_t rest = (size_t) (nl - p), more = rest < sizeof(head) - n ? rest : sizeof(head) - n;
+        memcpy(head, k->in, n);
+        memcpy(head + n, p, more);
+        if (!k->discarding && !server_line_reads(head, n + more, k->in_len + rest > n + more))
+            return 0;
+        p = nl + 1;
     }
+    for (const char *nl; p < end && (nl = memchr(p, '\n', (size_t) (end - p))) != NULL;
+         p = nl + 1)
+        if (!server_line_reads(p, (size_t) (nl - p), 0))
+            return 0;
+    return 1; // A line left unfinished is looked at in the round that completes it
+}
 
-    if (!found)
+// Threads answering read-only clients. Each round hands them the clients whose requests
+// only read; they answer from the published copy while the event loop thread applies the
+// other clients' changes to its own copy. The round ends once every job is done, so no
+// reader is left on the old copy when the changes are published.
+typedef struct
+{
+    pthread_t threads[MAX_WORKER_THREADS]; // Running reader threads
+    int count;                             // Threads in 'threads' (0 = none)
+    pthread_mutex_t lock;                  // Guards the fields below
+    pthread_cond_t wake;                   // Signals new jobs or 'stop'
+    pthread_cond_t idle;                   // Signals that every job has been answered
+    ServerConn **jobs;                     // Read-only clients of this round
+    size_t job_count;                      // Entries in 'jobs'
+    size_t job_capacity;                   // Entries allocated in 'jobs'
+    size_t next;                           // Next job to hand out
+    size_t busy;                           // Jobs handed out but not answered yet
+    int stop;                              // 1 once the threads should exit
+} ServerReaders;
+
+static ServerReaders server_readers = {.lock = PTHREAD_MUTEX_INITIALIZER,
+                                       .wake = PTHREAD_COND_INITIALIZER,
+                                       .idle = PTHREAD_COND_INITIALIZER};
+
+// Answers jobs until none are left; called with the lock held, returns with it held
+static void server_readers_drain(ServerReaders *r)
+{
+    ContactStore *own = store_current;
+    while (r->next < r->job_count)
     {
-        printf("Contact '%s' not found.\n", name); // Handle contact not found
+        ServerConn *k = r->jobs[r->next++];
+        r->busy++;
+        pthread_mutex_unlock(&r->lock);
+        store_current = versions.published;
+        server_answer(k);
+        store_current = own;
+        pthread_mutex_lock(&r->lock);
+        if (--r->busy == 0 && r->next == r->job_count)
+            pthread_cond_signal(&r->idle);
     }
 }
 
-// ----------------- Search contacts -----------------
-
-// Searches for contacts by name (exact or partial match)
-void search_contact(void)
+static void *server_reader(void *arg)
 {
-    if (contact_count == 0)
+    ServerReaders *r = arg;
+    pthread_mutex_lock(&r->lock);
+    while (!r->stop)
     {
-        printf("No contacts in Contact manager, add yours :)\n"); // Handle empty contact list
-        return;
+        server_readers_drain(r);
+        if (!r->stop)
+            pthread_cond_wait(&r->wake, &r->lock);
     }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
 
-    // Prompt for search type
-    char choice_str[2];
-    get_valid_input("Search type (1 = Exact, 2 = Partial): ", choice_str, sizeof(choice_str),
-                    "^[1-2]$");            // Get search type
-    int search_type = choice_str[0] - '0'; // Convert char to int (1 or 2)
+// Stops the reader threads and keeps the writer's copy of the store as store_primary
+static void server_readers_stop(void)
+{
+    ServerReaders *r = &server_readers;
+    pthread_mutex_lock(&r->lock);
+    r->stop = 1;
+    pthread_cond_broadcast(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+    for (int t = 0; t < r->count; t++)
+        pthread_join(r->threads[t], NULL);
+    r->count = 0;
+    free(r->jobs);
+    r->jobs = NULL;
+    r->job_capacity = 0;
+
+    if (store_current != &store_primary)
+    { // The writer ended on the spare: swap the contents so the primary holds its copy
+        ContactStore own = *store_current;
+        *store_current = store_primary;
+        store_primary = own;
+        store_current = &store_primary;
+    }
+    store_release(&versions.spare);
+    outbuf_finish(&versions.log);
+    versions.published = NULL;
+}
 
-    // Get search name
-    char name[MAX_NAME_LENGTH];
-    get_valid_input("Enter name to search: ", name, MAX_NAME_LENGTH,
-                    NAME_REGEX); // Get name to search
+// Builds every lazily built index of the writer's copy that is not built (never built, or
+// dropped after running out of memory), so readers never build one on the copy they share
+// Returns 0, or -1 on out-of-memory
+static int server_prebuild(void)
+{
+    return store_index(FIELD_PHONE) && store_index(FIELD_EMAIL) && store_phonetic() &&
+                   store_ids() && store_trigrams() && store_columns()
+               ? 0
+               : -1;
+}
 
-    // Convert search name to lowercase for case-insensitive comparison
-    char temp_search[MAX_NAME_LENGTH];
-    strcpy(temp_search, name);
-    for (int j = 0; temp_search[j]; j++)
+// Prepares the second copy of the store and starts 'count' reader threads. The lazily
+// built indexes are built first so readers never change the copy they share.
+// Returns the threads started (0 = every request is answered by the event loop thread)
+static int server_readers_start(int count)
+{
+    if (count <= 0)
+        return 0;
+    if (server_prebuild() != 0 || store_duplicate(&store_primary, &versions.spare) != 0)
     {
-        temp_search[j] = tolower((unsigned char) temp_search[j]);
+        printf("⚠️ Out of memory for a second copy of the store; serving without reader "
+               "threads.\n");
+        return 0;
     }
+    outbuf_init(&versions.log, NULL, 0);
+    versions.published = &versions.spare;
+    ServerReaders *r = &server_readers;
+    while (r->count < count &&
+           pthread_create(&r->threads[r->count], NULL, server_reader, r) == 0)
+        r->count++;
+    if (r->count == 0)
+        server_readers_stop(); // Drops the copy again
+    return r->count;
+}
 
-    int found = 0;
-    // Print search results header
-    printf("\n📞 Search Results:\n");
-    printf("---------------------------------------------------------------\n");
-    printf("%-3s %-15s %-15s %-25s\n", "#", "Name", "Phone", "Email");
-    printf("---------------------------------------------------------------\n");
-
-    for (int i = 0; i < contact_count; i++)
+// Makes this round's changes visible to readers: the writer's copy is published and the
+// copy readers used until now is brought up to date from the log and written next.
+// A change may have dropped a lazily built index, so they are rebuilt before publishing;
+// if that or replaying the log fails, the up-to-date copy stays with the writer and
+// readers stop.
+static void server_publish(void)
+{
+    if (!versions.published || (versions.log.len == 0 && !versions.log.failed))
+        return;
+    if (server_prebuild() != 0)
+    {
+        printf("⚠️ Out of memory while publishing changes; reader threads stopped.\n");
+        server_readers_stop(); // The writer's copy becomes the only one
+        return;
+    }
+    ContactStore *old = versions.published;
+    versions.published = store_current;
+    store_current = old;
+
+    int failed = versions.log.failed;
+    const char *p = versions.log.data, *end = p + versions.log.len;
+    uint64_t seq;
+    size_t n;
+    versions.replaying = 1;
+    while (!failed && p < end)
+    {
+        n = journal_entry(p, end, &seq);
+        failed = n == 0 || journal_apply(p + 8, n - 8) != 0;
+        p += n;
+    }
+    versions.replaying = 0;
+    outbuf_consume(&versions.log, versions.log.len);
+    versions.log.failed = 0;
+    if (failed)
     {
-        // Convert contact name to lowercase for comparison
-        char temp_name[MAX_NAME_LENGTH];
-        strcpy(temp_name, contacts[i].name);
-        for (int j = 0; temp_name[j]; j++)
+        store_release(old);
+        if (store_duplicate(versions.published, old) != 0)
         {
-            temp_name[j] = tolower((unsigned char) temp_name[j]);
-        }
-
-        int match = 0;
-        if (search_type == 1)
-        { // Exact match
-            match = (strcasecmp(temp_name, temp_search) == 0);
-        }
-        else
-        { // Partial match
-            match = (strstr(temp_name, temp_search) != NULL);
+            printf("⚠️ Out of memory while publishing changes; reader threads stopped.\n");
+            store_current = versions.published;
+            versions.published = NULL; // Reads are answered by the writer from now on
         }
+    }
+}
 
-        if (match)
+// Answers every client that sent requests in this round: read-only clients on the reader
+// threads (and this one, once its own work is done), the others here in order, then
+// publishes the changes
+static void server_answer_round(Server *s)
+{
+    ServerReaders *r = &server_readers;
+    if (r->count && r->job_capacity < s->count)
+    {
+        ServerConn **jobs = realloc(r->jobs, s->capacity * sizeof(ServerConn *));
+        if (jobs)
         {
-            // Print matching contact
-            printf("%-3d %-15s %-15s %-25s\n", found + 1, contacts[i].name, contacts[i].phone,
-                   contacts[i].email);
-            found++;
+            r->jobs = jobs;
+            r->job_capacity = s->capacity;
         }
     }
 
-    printf(
-        "---------------------------------------------------------------\n"); // Print table footer
-    if (found == 0)
+    pthread_mutex_lock(&r->lock);
+    for (size_t i = 0; i < s->count; i++)
     {
-        printf("Contact not found :(\n"); // Handle no matches
+        ServerConn *k = s->conns[i];
+        k->reader = versions.published && k->ready && k->requests.len &&
+                    r->job_count < r->job_capacity && server_reads_only(k);
+        if (k->reader)
+            r->jobs[r->job_count++] = k;
     }
-    else
+    if (r->job_count)
+        pthread_cond_broadcast(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+
+    for (size_t i = 0; i < s->count; i++)
     {
-        printf("Found %d contact(s).\n", found); // Report number of matches
+        ServerConn *k = s->conns[i];
+        if (k->ready && !k->reader && (k->requests.len || k->requests.failed))
+            server_answer(k);
     }
-}
 
-// ----------------- Sort contacts -----------------
+    pthread_mutex_lock(&r->lock);
+    server_readers_drain(r); // Help with what the readers have not taken yet
+    while (r->busy)
+        pthread_cond_wait(&r->idle, &r->lock);
+    r->job_count = r->next = 0;
+    pthread_mutex_unlock(&r->lock);
+    server_publish();
+}
 
-// Merges two sorted subarrays based on the specified field
-void merge(Contact arr[], int left, int mid, int right, SortField field)
+// Called when this round's changes could not be made durable: each of them is answered
+// with an error line instead of its results, and later writes are refused. The changes
+// stay in the store and are saved when the server stops, but were never acknowledged.
+static void server_refuse_round(Server *s)
 {
-    int n1 = mid - left + 1; // Size of left subarray
-    int n2 = right - mid;    // Size of right subarray
-
-    // Allocate temporary arrays
-    Contact *L = malloc(n1 * sizeof(Contact));
-    Contact *R = malloc(n2 * sizeof(Contact));
-
-    // Check for allocation failure
-    if (!L || !R)
+    if (!server_read_only)
+        printf("❌ Could not sync %s; refusing writes from now on.\n", JOURNAL_PATH);
+    server_read_only = 1;
+    for (size_t i = 0; i < s->count; i++)
     {
-        free(L);                                                 // Free if allocated
-        free(R);                                                 // Free if allocated
-        fprintf(stderr, "Memory allocation failed in merge.\n"); // Report error
-        exit(EXIT_FAILURE);
-    }
+        ServerConn *k = s->conns[i];
+        if (k->write_count == 0)
+            continue;
+        size_t from = k->writes[0].start, len = k->run.out.len - from;
+        char *results = malloc(len ? len : 1);
+        if (!results)
+        {
+            k->run.out.len = from; // Nothing of this round goes out
+            k->closing = 1;
+            continue;
+        }
+        memcpy(results, k->run.out.data + from, len);
+        k->run.out.len = from;
 
-    // Copy data to temporary arrays
-    for (int i = 0; i < n1; i++)
-        L[i] = arr[left + i];
-    for (int j = 0; j < n2; j++)
-        R[j] = arr[mid + 1 + j];
+        size_t op = k->run.op, at = from; // 'at': next byte of 'results' to copy back
+        for (size_t w = 0; w < k->write_count; w++)
+        {
+            const ServerWrite *write = &k->writes[w];
+            outbuf_put(&k->run.out, results + (at - from), write->start - at);
+            k->run.op = write->op;
+            cli_error(&k->run, "not durable: could not sync " JOURNAL_PATH, NULL);
+            at = write->end;
+        }
+        outbuf_put(&k->run.out, results + (at - from), from + len - at);
+        k->run.op = op;
+        free(results);
+    }
+}
 
-    int i = 0, j = 0, k = left; // Indices for merging
+// Disconnects a client
+static void server_close(Server *s, ServerConn *k)
+{
+    close(k->fd); // Also leaves the epoll set
+    outbuf_finish(&k->run.out);
+    outbuf_finish(&k->requests);
+    free(k->writes);
+    s->conns[k->slot] = s->conns[--s->count];
+    s->conns[k->slot]->slot = k->slot;
+    free(k);
+    if (s->accept_paused)
+        server_listening(s, 1); // Its descriptor is free for a waiting connection
+}
 
-    // Merge arrays based on field
-    while (i < n1 && j < n2)
+// Sends what the client's requests produced, then closes it or updates what to wait for
+static void server_settle(Server *s, ServerConn *k)
+{
+    while (k->run.out.len && !k->run.out.failed)
     {
-        int cmp;
-        if (field == SORT_BY_NAME)
-            cmp = strcasecmp(L[i].name, R[j].name); // Compare names
-        else if (field == SORT_BY_PHONE)
-            cmp = strcmp(L[i].phone, R[j].phone); // Compare phone numbers
+#ifdef MSG_NOSIGNAL
+        ssize_t n = send(k->fd, k->run.out.data, k->run.out.len, MSG_NOSIGNAL);
+#else
+        ssize_t n = send(k->fd, k->run.out.data, k->run.out.len, 0);
+#endif
+        if (n > 0)
+            outbuf_consume(&k->run.out, (size_t) n);
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break; // Rest goes out when the socket has room
         else
-            cmp = strcasecmp(L[i].email, R[j].email); // Compare emails
+        {
+            k->run.out.failed = 1; // Client gone
+            break;
+        }
+    }
+    if (k->run.out.failed || (k->closing && k->run.out.len == 0))
+        server_close(s, k);
+    else
+        server_watch(s, k);
+}
 
-        if (cmp <= 0)
-            arr[k++] = L[i++]; // Copy from left subarray
+#ifdef __linux__
+// Waits for readiness with epoll, marks the ready clients and reads their requests
+// Returns -1 if waiting failed
+static int server_epoll_round(Server *s)
+{
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    int n = epoll_wait(s->epoll_fd, events, SERVER_MAX_EVENTS,
+                       s->accept_paused ? SERVER_ACCEPT_RETRY_MS : -1);
+    if (n == 0 && s->accept_paused)
+        server_listening(s, 1); // Try again: descriptors may have been freed elsewhere
+    for (int i = 0; i < n; i++)
+    {
+        ServerConn *k = events[i].data.ptr;
+        if (!k)
+            server_accept(s); // The listening socket
         else
-            arr[k++] = R[j++]; // Copy from right subarray
+        {
+            k->ready = 1;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                server_read(k);
+        }
     }
-
-    // Copy remaining elements from left subarray
-    while (i < n1)
-        arr[k++] = L[i++];
-    // Copy remaining elements from right subarray
-    while (j < n2)
-        arr[k++] = R[j++];
-
-    // Free temporary arrays
-    free(L);
-    free(R);
+    return n < 0 && errno != EINTR ? -1 : 0;
 }
+#endif
 
-// Implements merge sort on contacts array
-void merge_sort(Contact arr[], int left, int right, SortField field)
+// Same as server_epoll_round() with poll(), where epoll is unavailable: the descriptor set
+// is rebuilt from every client's wanted readiness each round
+static int server_poll_round(Server *s)
 {
-    if (left < right)
+    struct pollfd *fds = malloc((s->count + 1) * sizeof(struct pollfd));
+    if (!fds)
+        return -1;
+    fds[0].fd = s->accept_paused ? -1 : s->listen_fd; // poll() skips negative descriptors
+    fds[0].events = POLLIN;
+    for (size_t i = 0; i < s->count; i++)
+    {
+        fds[i + 1].fd = s->conns[i]->fd;
+        fds[i + 1].events = (short) ((s->conns[i]->events & SERVER_READ ? POLLIN : 0) |
+                                     (s->conns[i]->events & SERVER_WRITE ? POLLOUT : 0));
+    }
+    size_t count = s->count; // Clients accepted in this round are not in 'fds'
+    int n = poll(fds, (nfds_t) count + 1, s->accept_paused ? SERVER_ACCEPT_RETRY_MS : -1);
+    if (n == 0 && s->accept_paused)
+        s->accept_paused = 0; // Try again: descriptors may have been freed elsewhere
+    for (size_t i = 0; n > 0 && i < count; i++)
     {
-        int mid = left + (right - left) / 2; // Calculate middle index
+        ServerConn *k = s->conns[i];
+        k->ready = fds[i + 1].revents != 0;
+        if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))
+            server_read(k);
+    }
+    if (n > 0 && (fds[0].revents & POLLIN))
+        server_accept(s);
+    free(fds);
+    return n < 0 && errno != EINTR ? -1 : 0;
+}
 
-        merge_sort(arr, left, mid, field);      // Sort left half
-        merge_sort(arr, mid + 1, right, field); // Sort right half
-        merge(arr, left, mid, right, field);    // Merge sorted halves
+// Runs the event loop until SIGINT or SIGTERM. Each round reads every request that has
+// arrived and answers them (see server_answer_round()). Clients answered by reader threads
+// get their responses at once: they come from the copy published in the last round, whose
+// changes are already durable. The event loop's own responses wait until one journal sync
+// has made the round's changes durable. Each client gets one write.
+// Returns 0, or -1 on failure
+static int server_run(const char *address)
+{
+    Server s = {.listen_fd = server_listen(address), .epoll_fd = -1};
+    if (s.listen_fd < 0)
+        return -1;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = server_signal; // No SA_RESTART: a signal ends the wait
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN); // A client that hangs up is noticed by send()
+
+#ifdef __linux__
+    s.epoll_fd = epoll_create1(0);
+    if (s.epoll_fd >= 0)
+        server_listening(&s, 1);
+#endif
+    int readers = server_readers_start(worker_count() - 1);
+    printf("📡 Serving %zu contact(s) on %s (%s, %d reader thread(s)); stop with Ctrl+C.\n",
+           cur_store()->count, address, s.epoll_fd >= 0 ? "epoll" : "poll", readers);
+
+    int result = 0;
+    while (!server_stop && result == 0)
+    {
+#ifdef __linux__
+        result = s.epoll_fd >= 0 ? server_epoll_round(&s) : server_poll_round(&s);
+#else
+        result = server_poll_round(&s);
+#endif
+
+        server_answer_round(&s);
+        for (size_t i = s.count; i-- > 0;)
+        {
+            ServerConn *k = s.conns[i];
+            if (k->ready && k->reader) // Answered from the last, already durable, copy
+            {
+                k->ready = 0;
+                server_settle(&s, k); // May move the last client into slot i
+            }
+        }
+        if (journal_commit() != 0) // One sync covers every change made in this round
+            server_refuse_round(&s);
+        for (size_t i = s.count; i-- > 0;)
+        {
+            ServerConn *k = s.conns[i];
+            k->write_count = 0;
+            if (k->ready)
+            {
+                k->ready = 0;
+                server_settle(&s, k); // May move the last client into slot i
+            }
+        }
     }
+
+    server_readers_stop();
+    while (s.count)
+        server_close(&s, s.conns[s.count - 1]);
+    free(s.conns);
+    if (s.epoll_fd >= 0)
+        close(s.epoll_fd);
+    close(s.listen_fd);
+    if (strncmp(address, "unix:", 5) == 0)
+        unlink(address + 5);
+    printf(result ? "❌ Server stopped: waiting for connections failed.\n"
+                  : "ℹ️ Server stopped.\n");
+    return result;
 }
+#else
+static int server_run(const char *address)
+{
+    printf("❌ Cannot serve %s: server mode is not available on Windows.\n", address);
+    return -1;
+}
+#endif
 
-// Sorts contacts based on user-selected field
-void sort_contacts(void)
+// Prints the command-line usage
+static void cli_usage(void)
 {
-    if (contact_count == 0)
+    printf("Usage: contact-manager [VERB ARGS...]   (no arguments: interactive menu)\n"
+           "  add NAME PHONE EMAIL\n"
+           "  get NAME\n"
+           "  update NAME name|phone|email VALUE\n"
+           "  delete NAME\n"
+           "  delete-domain DOMAIN (every contact with an email in DOMAIN)\n"
+           "  search exact|partial|phone|email|fuzzy QUERY\n"
+           "  import FILE [skip|overwrite|newest|merge]\n"
+           "  export FILE\n"
+           "  sort KEYS           (up to 3 of name, phone, email, domain, country)\n"
+           "  batch FILE          (one operation per line: verb, arg, ...; - = stdin)\n"
+           "  serve ADDRESS       (unix:PATH or HOST:PORT; requests are batch lines)\n"
+           "  stats               (timings and counters; needs a -DCMS_STATS build)\n"
+           "A NAME may also be #ID, the contact ID printed after its fields.\n");
+}
+
+// Non-interactive entry point: runs one verb, or a batch file of them, against the store
+// without the menu or prompts. Results go to standard output as tab-separated lines (see
+// CliRun); messages go to standard error. A verb is journaled like a menu action. A batch
+// is one transaction: only if every operation succeeded is it journaled (one sync) and
+// then saved once; otherwise the files are left as they were. A failed save is reported
+// as one more error line, numbered after the last operation. Returns the process exit
+// code: 0, 1 if an operation or the save failed, 2 on a usage error.
+int cli_main(int argc, char *argv[])
+{
+    int batch = strcmp(argv[0], "batch") == 0;
+    int serve = strcmp(argv[0], "serve") == 0;
+    int help = strcmp(argv[0], "help") == 0 || strcmp(argv[0], "--help") == 0;
+    if (help || ((batch || serve) && argc != 2))
     {
-        printf("No contacts to sort.\n"); // Handle empty contact list
-        return;
+        cli_usage();
+        validator_registry_free();
+        return help ? 0 : 2;
     }
 
-    // Display sort options
-    printf("Sort by:\n");
-    printf("1. Name\n");
-    printf("2. Phone\n");
-    printf("3. Email\n");
+    // Results keep standard output; everything printed for people moves to standard error
+    fflush(stdout);
+#ifndef _WIN32
+    int fd = dup(fileno(stdout));
+    result_stream = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (result_stream)
+        dup2(fileno(stderr), fileno(stdout));
+#else
+    int fd = _dup(_fileno(stdout));
+    result_stream = fd >= 0 ? _fdopen(fd, "w") : NULL;
+    if (result_stream)
+        _dup2(_fileno(stderr), _fileno(stdout));
+#endif
+    if (!result_stream)
+        result_stream = stdout;
+    else
+        setvbuf(stdout, NULL, _IOLBF, 0); // Messages show up as they happen, as on a terminal
 
-    char choice_str[3]; // Buffer for sort choice
-    get_valid_input("Enter choice (1-3): ", choice_str, sizeof(choice_str),
-                    SORT_CHOICE_REGEX); // Get sort choice
+    load_contacts(); // Replays the journal as usual
+    if (batch)
+        journal_hold(); // Nothing is logged until the batch is known to succeed
 
-    int choice = choice_str[0] - '0'; // Convert char to int
+    CliRun r = {.op = 1};
+    outbuf_init(&r.out, result_stream, 0);
+    int status = serve   ? server_run(argv[1])
+                 : batch ? cli_batch(&r, argv[1])
+                         : cli_apply(&r, argc, argv);
 
-    SortField field;
-    switch (choice)
+    if (batch && (status != 0 || r.failed))
     {
-        case 1:
-            field = SORT_BY_NAME;
-            break; // Set sort by name
-        case 2:
-            field = SORT_BY_PHONE;
-            break; // Set sort by phone
-        case 3:
-            field = SORT_BY_EMAIL;
-            break; // Set sort by email
-        default:
-            printf("Invalid choice.\n"); // Handle invalid choice (shouldn't occur due to regex)
-            return;
+        journal_release(0);
+        printf("❌ Batch not applied: %zu operation(s) failed; nothing was saved.\n", r.failed);
     }
-
-    merge_sort(contacts, 0, contact_count - 1, field); // Sort contacts
-    printf("Contacts sorted successfully!\n");         // Confirm sort
+    else if (batch && r.changed)
+    {
+        // The whole batch is journaled and synced first, so a failed save loses nothing:
+        // the next start replays it and the next save writes it
+        int logged = journal_release(1) == 0;
+        if (save_contacts() != 0)
+            cli_error(&r, logged ? "save failed; the batch is kept in " JOURNAL_PATH
+                                 : "save failed; the batch was not saved",
+                      NULL);
+    }
+    else if (batch)
+        journal_release(0); // Nothing changed
+    else if (serve && save_contacts() != 0) // A server saves on exit
+        status = -1;
+    else if (!serve && journal_commit() != 0 && save_contacts() != 0)
+    { // A single verb is one journaled action; if that fails, a save must keep it
+        r.op++; // Reported like a failed batch save, after the verb's own results
+        cli_error(&r, "not durable: could not sync " JOURNAL_PATH, NULL);
+    }
+    if (outbuf_finish(&r.out) != 0)
+        status = -1;
+    journal_close();
+    store_free();
+    stats_dump_at_exit();
+    validator_registry_free();
+    if (result_stream != stdout)
+        fclose(result_stream);
+    return status != 0 || r.failed ? 1 : 0;
 }
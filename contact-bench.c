@@ -0,0 +1,691 @@
+/*
+ * Project: Contact Management System - benchmark suite
+ *
+ * Description:
+ * Times the contact engine on synthetic directories so changes can be compared between
+ * releases. The engine is compiled into this program (advanced-contact-manager.c with
+ * CMS_NO_MAIN), so every benchmark calls the same functions the program does.
+ *
+ * - Synthetic directories:
+ *   • 10K to 10M contacts (--sizes), generated from a fixed seed (--seed).
+ *   • Names: a common first name (skewed, so some are far more frequent) and a unique
+ *     surname built from syllables, 10-25 characters; some with hyphens or apostrophes.
+ *   • Phones: Indian mobile numbers with and without +91, North American, UK, German,
+ *     French, Australian and Japanese E.164 numbers.
+ *   • Emails: first.last, first_last or firstlast, sometimes with digits, at a few large
+ *     providers and a long tail of company domains.
+ *   • Written as contacts.txt in a scratch directory (--dir, default a new one in /tmp).
+ *
+ * - Benchmarks (each size runs in its own process, so peak RSS is per size):
+ *   • load_csv, save, load_snapshot      → load_contacts() / save_contacts()
+ *   • export_vcf, import_vcf, import_vcf_duplicates → export_to_vcf() / import_from_vcf()
+ *   • sort_name ... sort_country         → store_sort() (merge_sort()) for every SortField
+ *   • search_exact, search_partial       → the lookups behind search_contact(), per query
+ *   • partial_index_build, columns_build → the trigram index and field columns built by the
+ *                                          first partial search
+ *   • search_partial_short               → 1-2 letter partial queries (name column scans)
+ *   • validate_regex_*, validate_fast_*  → validate_with_regex() and the load-path validators
+ *
+ * - Output:
+ *   • One result per benchmark: samples, min / p50 / p90 / p99 / max / mean seconds, and
+ *     items per second at the median (contacts, values or queries).
+ *   • JSON on standard output (or --json FILE); progress and a summary on standard error.
+ *
+ * Build: gcc -O2 -o contact-bench contact-bench.c -Wall -std=c11 -pthread
+ * Run:   ./contact-bench [--sizes 10000,100000,1000000] [--reps 3] [--queries 1000]
+ *                        [--seed 1] [--json FILE] [--dir DIR]
+ *        ./contact-bench [--seed 1] --generate N   (only writes an N-contact contacts.txt)
+ */
+
+#define CMS_NO_MAIN // Leaves out the program's main(); everything else is used as is
+#include "advanced-contact-manager.c"
+
+#ifdef _WIN32
+#error "contact-bench needs POSIX processes and resource usage (fork, getrusage)"
+#endif
+
+#include <sys/resource.h> // Provides getrusage() for the peak resident set size
+#include <sys/wait.h>     // Provides waitpid() for the per-size processes
+#include <time.h>         // Provides clock_gettime() for timing
+
+#define BENCH_MAX_SIZES 16         // Directory sizes in one run
+#define BENCH_VALIDATE_SAMPLE 100000 // Values per field timed by the validator benchmarks
+#define BENCH_VCF_PATH "bench.vcf" // Export written and imported again by the benchmarks
+
+// Settings of one run, from the command line
+typedef struct
+{
+    size_t sizes[BENCH_MAX_SIZES]; // Directory sizes, in contacts
+    int size_count;                // Sizes in use
+    int reps;                      // Samples per whole-store benchmark
+    size_t queries;                // Samples per search benchmark
+    uint64_t seed;                 // Generator seed
+    const char *json_path;         // JSON destination (NULL = standard output)
+    const char *dir;               // Scratch directory (NULL = a new one in /tmp)
+} BenchOptions;
+
+static FILE *bench_json; // JSON fragment of the size being measured
+
+// ----------------- Timing and statistics -----------------
+
+// Monotonic time in seconds
+static double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile 'p' (0-100) of 'n' sorted samples
+static double bench_percentile(const double *sorted, size_t n, double p)
+{
+    size_t rank = (size_t) (p / 100.0 * (double) n + 0.999999);
+    return sorted[rank ? (rank > n ? n : rank) - 1 : 0];
+}
+
+// Formats a duration with a unit that keeps it short ("12.3 us", "45.6 ms", "7.89 s")
+static const char *bench_duration(char *out, size_t size, double seconds)
+{
+    if (seconds < 1e-3)
+        snprintf(out, size, "%.1f us", seconds * 1e6);
+    else if (seconds < 1.0)
+        snprintf(out, size, "%.1f ms", seconds * 1e3);
+    else
+        snprintf(out, size, "%.2f s", seconds);
+    return out;
+}
+
+// Writes one result to the JSON fragment and the summary. 'samples' (sorted in place) are
+// the seconds each sample took; each processed 'items' items.
+static void bench_report(const char *name, size_t items, double *samples, size_t n)
+{
+    static int first = 1; // Results are comma-separated
+    if (n == 0)
+        return;
+    qsort(samples, n, sizeof(double), compare_doubles);
+    double total = 0.0;
+    for (size_t i = 0; i < n; i++)
+        total += samples[i];
+    double p50 = bench_percentile(samples, n, 50);
+    double rate = p50 > 0.0 ? (double) items / p50 : 0.0;
+
+    fprintf(bench_json,
+            "%s\n        {\"name\": \"%s\", \"items\": %zu, \"samples\": %zu, \"min_s\": %.9f, "
+            "\"p50_s\": %.9f, \"p90_s\": %.9f, \"p99_s\": %.9f, \"max_s\": %.9f, "
+            "\"mean_s\": %.9f, \"items_per_s\": %.1f}",
+            first ? "" : ",", name, items, n, samples[0], p50, bench_percentile(samples, n, 90),
+            bench_percentile(samples, n, 99), samples[n - 1], total / (double) n, rate);
+    first = 0;
+    char a[32], b[32];
+    fprintf(stderr, "   %-24s p50 %10s  p99 %10s  %14.0f items/s\n", name,
+            bench_duration(a, sizeof(a), p50),
+            bench_duration(b, sizeof(b), bench_percentile(samples, n, 99)), rate);
+}
+
+// ----------------- Synthetic directories -----------------
+
+// splitmix64: small, fast and good enough for test data
+static uint64_t bench_random(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15u);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9u;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBu;
+    return z ^ (z >> 31);
+}
+
+// Uniform index below 'n'
+static size_t bench_pick(uint64_t *state, size_t n)
+{
+    return (size_t) (bench_random(state) % n);
+}
+
+// Index below 'n' skewed towards the front, so the first entries are the most common
+static size_t bench_pick_skewed(uint64_t *state, size_t n)
+{
+    double u = (double) (bench_random(state) >> 11) / 9007199254740992.0; // [0, 1)
+    return (size_t) (u * u * (double) n);
+}
+
+static const char *const first_names[] = {
+    "James", "Mary",   "Aarav",  "Priya",   "John",   "Patricia", "Rahul",  "Ananya",
+    "Robert", "Jennifer", "Vivaan", "Diya",  "Michael", "Linda",  "Arjun",  "Saanvi",
+    "William", "Elizabeth", "Rohan", "Isha", "David",  "Barbara",  "Kabir",  "Meera",
+    "Mohammed", "Fatima", "Wei",    "Mei",     "Hiroshi", "Yuki",   "Lukas",  "Sofia",
+    "Mary-Jane", "Jean-Luc", "D'Arcy", "Noah",  "Olivia", "Liam",   "Emma",   "Mateo",
+    "Lucia",  "Omar",   "Aisha",  "Chen",    "Hana",   "Ivan",   "Olga",   "Pierre",
+};
+
+static const char *const syllables[32] = {
+    "ba", "ren", "ko", "li", "mar", "to", "sen", "da", "vi", "lo", "ne", "ra", "son", "ki",
+    "mo", "tan", "el", "an", "or", "is", "ul", "be", "ga", "hu", "jo", "pe", "ri", "sa",
+    "te", "wi", "ya", "zo",
+};
+
+// Email providers, most common first (picked with bench_pick_skewed())
+static const char *const domains[] = {
+    "gmail.com",     "yahoo.com",     "outlook.com",  "hotmail.com",  "icloud.com",
+    "rediffmail.com", "proton.me",    "acme-corp.com", "globex.io",   "initech.co.in",
+    "umbrella.de",   "example.org",   "wayne-ent.com", "stark.io",    "hooli.xyz",
+    "piedpiper.net", "cyberdyne.ai",  "tyrell.co.uk", "wonka.fr",     "soylent.com.au",
+};
+
+// Phone formats: prefix, then 'digits' random digits whose first is in [first_min, 9]
+typedef struct
+{
+    const char *prefix; // Country prefix (or "" for bare Indian mobile numbers)
+    int digits;         // Random digits after the prefix
+    char first_min;     // Smallest first digit
+    int weight;         // Relative frequency
+} PhoneFormat;
+
+static const PhoneFormat phone_formats[] = {
+    {"", 10, '6', 25},  {"+91", 10, '6', 15}, {"+1", 10, '2', 25}, {"+447", 9, '0', 8},
+    {"+4915", 9, '0', 8}, {"+336", 8, '0', 7}, {"+614", 8, '0', 6}, {"+8190", 8, '0', 6},
+};
+
+// Syllables per surname: enough for 32^k >= n, so every contact gets a unique name
+static int bench_surname_syllables(size_t n)
+{
+    int k = 3;
+    while (k < 6 && ((uint64_t) 1 << (5 * k)) < n)
+        k++;
+    return k;
+}
+
+// Writes contact 'i' of a directory as "name, phone, email, id"; returns its length
+static size_t bench_contact(char *out, size_t i, int syllable_count, uint64_t *state)
+{
+    // Unique surname: 'i' scrambled by an odd multiplier (a bijection modulo 2^(5k)), then
+    // read as base-32 syllables
+    uint64_t mask = ((uint64_t) 1 << (5 * syllable_count)) - 1;
+    uint64_t code = ((uint64_t) i * 0x9E3779B1u) & mask;
+    char surname[32];
+    size_t s = 0;
+    for (int k = 0; k < syllable_count; k++, code >>= 5)
+    {
+        const char *syl = syllables[code & 31u];
+        size_t len = strlen(syl);
+        memcpy(surname + s, syl, len);
+        s += len;
+    }
+    surname[s] = '\0';
+
+    const char *first = first_names[bench_pick_skewed(state, sizeof(first_names) /
+                                                                 sizeof(first_names[0]))];
+    char name[MAX_NAME_LENGTH];
+    snprintf(name, sizeof(name), "%s %c%s", first, toupper((unsigned char) surname[0]),
+             surname + 1);
+
+    // Phone
+    int total = 0;
+    for (size_t f = 0; f < sizeof(phone_formats) / sizeof(phone_formats[0]); f++)
+        total += phone_formats[f].weight;
+    int roll = (int) bench_pick(state, (size_t) total);
+    const PhoneFormat *pf = phone_formats;
+    while (roll >= pf->weight)
+        roll -= (pf++)->weight;
+    char phone[MAX_PHONE_LENGTH];
+    size_t p = strlen(pf->prefix);
+    memcpy(phone, pf->prefix, p);
+    for (int d = 0; d < pf->digits; d++)
+    {
+        char lo = d == 0 ? pf->first_min : '0';
+        phone[p++] = (char) (lo + (int) bench_pick(state, (size_t) ('9' - lo + 1)));
+    }
+    phone[p] = '\0';
+
+    // Email: the name's letters, lowercased, in one of a few common shapes
+    char local[64];
+    size_t l = 0;
+    static const char separators[] = "._"; // Or none
+    char sep = separators[bench_pick(state, 3)];
+    for (const char *c = first; *c && l < 20; c++)
+        if (isalpha((unsigned char) *c))
+            local[l++] = (char) tolower((unsigned char) *c);
+    if (sep)
+        local[l++] = sep;
+    memcpy(local + l, surname, s);
+    l += s;
+    if (bench_pick(state, 4) == 0)
+        l += (size_t) snprintf(local + l, sizeof(local) - l, "%u",
+                               (unsigned) bench_pick(state, 100));
+    local[l] = '\0';
+    const char *domain = domains[bench_pick_skewed(state, sizeof(domains) / sizeof(domains[0]))];
+
+    return (size_t) sprintf(out, "%s, %s, %s@%s, %zu\n", name, phone, local, domain, i + 1);
+}
+
+// Writes an 'n'-contact contacts.txt; returns 0, or -1 if the file cannot be written
+static int bench_generate(size_t n, uint64_t seed)
+{
+    FILE *file = fopen(CONTACTS_PATH, "w");
+    if (!file)
+        return -1;
+    uint64_t state = seed;
+    int syllable_count = bench_surname_syllables(n);
+    char line[512];
+    for (size_t i = 0; i < n; i++)
+        fwrite(line, 1, bench_contact(line, i, syllable_count, &state), file);
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+// ----------------- Benchmarks -----------------
+
+// Empties the store and stops journaling, so the next benchmark starts from nothing
+static void bench_reset(void)
+{
+    journal_close();
+    store_free();
+    cur_store()->dirty = 0;
+}
+
+// Times load_contacts() from the CSV and from the snapshot, and save_contacts()
+static void bench_files(const BenchOptions *o, size_t n, double *samples)
+{
+    for (int r = 0; r < o->reps; r++)
+    {
+        remove(SNAPSHOT_PATH);
+        remove(JOURNAL_PATH);
+        bench_reset();
+        double t = bench_now();
+        load_contacts();
+        samples[r] = bench_now() - t;
+    }
+    bench_report("load_csv", n, samples, (size_t) o->reps);
+
+    for (int r = 0; r < o->reps; r++)
+    {
+        cur_store()->dirty = 1; // A save with no changes returns at once
+        double t = bench_now();
+        save_contacts();
+        samples[r] = bench_now() - t;
+    }
+    bench_report("save", n, samples, (size_t) o->reps);
+
+    for (int r = 0; r < o->reps; r++)
+    {
+        bench_reset();
+        double t = bench_now();
+        load_contacts(); // The save above left a matching snapshot
+        samples[r] = bench_now() - t;
+    }
+    bench_report("load_snapshot", n, samples, (size_t) o->reps);
+}
+
+// Times export_to_vcf() of the loaded store, then import_from_vcf() of that file into an
+// empty store and again on top of the result (every card a duplicate)
+static void bench_vcf(const BenchOptions *o, size_t n, double *samples)
+{
+    for (int r = 0; r < o->reps; r++)
+    {
+        double t = bench_now();
+        export_to_vcf(BENCH_VCF_PATH);
+        samples[r] = bench_now() - t;
+    }
+    bench_report("export_vcf", n, samples, (size_t) o->reps);
+
+    for (int r = 0; r < o->reps; r++)
+    {
+        bench_reset();
+        double t = bench_now();
+        import_from_vcf(BENCH_VCF_PATH, IMPORT_SKIP);
+        samples[r] = bench_now() - t;
+    }
+    bench_report("import_vcf", n, samples, (size_t) o->reps);
+
+    for (int r = 0; r < o->reps; r++)
+    {
+        double t = bench_now();
+        import_from_vcf(BENCH_VCF_PATH, IMPORT_SKIP);
+        samples[r] = bench_now() - t;
+    }
+    bench_report("import_vcf_duplicates", n, samples, (size_t) o->reps);
+    remove(BENCH_VCF_PATH);
+}
+
+// Times store_sort() by each SortField, every sample starting from the same file order
+static void bench_sorts(const BenchOptions *o, size_t n, double *samples)
+{
+    static const char *const names[SORT_FIELD_COUNT] = {
+        "sort_name", "sort_phone", "sort_email", "sort_domain", "sort_country"};
+    ContactStore original;
+    if (store_duplicate(&store_primary, &original) != 0)
+    {
+        fprintf(stderr, "❌ Out of memory: cannot copy the store for the sort benchmarks.\n");
+        return;
+    }
+    for (int f = 0; f < SORT_FIELD_COUNT; f++)
+    {
+        SortSpec spec = {{(uint8_t) f}, 1};
+        int r = 0;
+        for (; r < o->reps; r++)
+        {
+            store_release(cur_store());
+            if (store_duplicate(&original, cur_store()) != 0)
+                break;
+            double t = bench_now();
+            store_sort(&spec);
+            samples[r] = bench_now() - t;
+        }
+        bench_report(names[f], n, samples, (size_t) r);
+    }
+    store_release(&original);
+}
+
+// Times exact and partial name searches, one sample per query. Exact queries are existing
+// names, one in ten with a letter changed so it misses; partial queries are 3-6 letter
+// pieces of names.
+static void bench_searches(const BenchOptions *o, uint64_t seed, double *samples)
+{
+    uint64_t state = seed ^ 0x5EA2C4u;
+    char query[MAX_NAME_LENGTH];
+    for (size_t q = 0; q < o->queries; q++)
+    {
+        const Contact *c = &cur_store()->items[bench_pick(&state, cur_store()->count)];
+        memcpy(query, contact_name(c), c->len[FIELD_NAME] + 1u);
+        if (q % 10 == 9)
+            query[c->len[FIELD_NAME] - 1] = query[c->len[FIELD_NAME] - 1] == 'q' ? 'z' : 'q';
+        uint32_t *matches = NULL;
+        double t = bench_now();
+        long found = collect_index_matches(&cur_store()->index[FIELD_NAME], query, &matches);
+        samples[q] = bench_now() - t;
+        if (found >= 0)
+            free(matches);
+    }
+    bench_report("search_exact", 1, samples, o->queries);
+
+    double t = bench_now();
+    store_trigrams();
+    samples[0] = bench_now() - t;
+    bench_report("partial_index_build", cur_store()->count, samples, 1);
+
+    t = bench_now();
+    store_columns();
+    samples[0] = bench_now() - t;
+    bench_report("columns_build", cur_store()->count, samples, 1);
+
+    for (size_t q = 0; q < o->queries; q++)
+    {
+        const Contact *c = &cur_store()->items[bench_pick(&state, cur_store()->count)];
+        size_t len = 3 + bench_pick(&state, 4);
+        if (len > c->len[FIELD_NAME])
+            len = c->len[FIELD_NAME];
+        size_t from = bench_pick(&state, c->len[FIELD_NAME] - len + 1);
+        for (size_t k = 0; k < len; k++)
+            query[k] = (char) tolower((unsigned char) contact_name(c)[from + k]);
+        query[len] = '\0';
+        uint32_t *matches = NULL;
+        t = bench_now();
+        long found = collect_partial_matches(query, &matches);
+        samples[q] = bench_now() - t;
+        if (found >= 0)
+            free(matches);
+    }
+    bench_report("search_partial", 1, samples, o->queries);
+
+    // Too short for a trigram: every name is scanned. Each query is a full pass, so fewer
+    // samples are taken.
+    size_t short_queries = o->queries < 50 ? o->queries : 50;
+    for (size_t q = 0; q < short_queries; q++)
+    {
+        const Contact *c = &cur_store()->items[bench_pick(&state, cur_store()->count)];
+        size_t len = 1 + bench_pick(&state, 2);
+        size_t from = bench_pick(&state, c->len[FIELD_NAME] - len + 1);
+        for (size_t k = 0; k < len; k++)
+            query[k] = (char) tolower((unsigned char) contact_name(c)[from + k]);
+        query[len] = '\0';
+        uint32_t *matches = NULL;
+        t = bench_now();
+        long found = collect_partial_matches(query, &matches);
+        samples[q] = bench_now() - t;
+        if (found >= 0)
+            free(matches);
+    }
+    bench_report("search_partial_short", 1, samples, short_queries);
+}
+
+// Times validate_with_regex() and the hand-written validators over every field of up to
+// BENCH_VALIDATE_SAMPLE contacts
+static void bench_validators(const BenchOptions *o, double *samples)
+{
+    static const char *const patterns[FIELD_COUNT] = {NAME_REGEX, PHONE_REGEX, EMAIL_REGEX};
+    static const char *const regex_names[FIELD_COUNT] = {
+        "validate_regex_name", "validate_regex_phone", "validate_regex_email"};
+    static const char *const fast_names[FIELD_COUNT] = {
+        "validate_fast_name", "validate_fast_phone", "validate_fast_email"};
+    size_t count = cur_store()->count;
+    size_t n = count < BENCH_VALIDATE_SAMPLE ? count : BENCH_VALIDATE_SAMPLE;
+    volatile size_t valid = 0; // Keeps the calls from being optimized away
+
+    for (int f = 0; f < FIELD_COUNT; f++)
+    {
+        for (int r = 0; r < o->reps; r++)
+        {
+            double t = bench_now();
+            for (size_t i = 0; i < n; i++)
+                valid += (size_t) validate_with_regex(patterns[f],
+                                                      contact_field(&cur_store()->items[i],
+                                                                    (ContactField) f));
+            samples[r] = bench_now() - t;
+        }
+        bench_report(regex_names[f], n, samples, (size_t) o->reps);
+
+        for (int r = 0; r < o->reps; r++)
+        {
+            double t = bench_now();
+            for (size_t i = 0; i < n; i++)
+            {
+                const Contact *c = &cur_store()->items[i];
+                valid += (size_t) validate_field((ContactField) f,
+                                                 contact_field(c, (ContactField) f), c->len[f]);
+            }
+            samples[r] = bench_now() - t;
+        }
+        bench_report(fast_names[f], n, samples, (size_t) o->reps);
+    }
+}
+
+// Runs every benchmark on an 'n'-contact directory, writing the results as one JSON object
+// to 'out'. Runs in a child process; returns its exit code.
+static int bench_size(const BenchOptions *o, size_t n, FILE *out)
+{
+    if (!freopen("/dev/null", "w", stdout))
+        return 1; // The engine's messages would mix with the results
+    bench_json = out;
+    uint64_t seed = o->seed + n;
+    fprintf(stderr, "📊 %zu contacts\n", n);
+    double t = bench_now();
+    if (bench_generate(n, seed) != 0)
+    {
+        fprintf(stderr, "❌ Cannot write %s.\n", CONTACTS_PATH);
+        return 1;
+    }
+    fprintf(stderr, "   generated in %.2f s\n", bench_now() - t);
+
+    size_t most = o->queries > (size_t) o->reps ? o->queries : (size_t) o->reps;
+    double *samples = malloc(most * sizeof(double));
+    if (!samples)
+    {
+        fprintf(stderr, "❌ Out of memory: cannot allocate benchmark samples.\n");
+        return 1;
+    }
+
+    validator_registry_init();
+    fprintf(out, "    {\"contacts\": %zu, \"seed\": %llu, \"results\": [", n,
+            (unsigned long long) seed);
+    bench_files(o, n, samples);
+    bench_vcf(o, n, samples);
+    bench_sorts(o, n, samples);
+    bench_reset();
+    load_contacts(); // Back to the saved order, from the snapshot
+    bench_searches(o, seed, samples);
+    bench_validators(o, samples);
+    bench_reset();
+    validator_registry_free();
+    free(samples);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(out, "\n    ], \"peak_rss_kb\": %ld}", usage.ru_maxrss); // Kilobytes on Linux
+    fprintf(stderr, "   peak RSS %.1f MB\n", (double) usage.ru_maxrss / 1024.0);
+    return fclose(out) == 0 ? 0 : 1;
+}
+
+// Runs one size in a child process and appends its JSON object to 'json'
+// Returns 0, or -1 if the child failed (an error object is appended instead)
+static int bench_run_size(const BenchOptions *o, size_t n, FILE *json)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return -1;
+    fflush(NULL); // Nothing buffered may be written twice
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        FILE *out = fdopen(fds[1], "w");
+        _exit(out ? bench_size(o, n, out) : 1);
+    }
+    close(fds[1]);
+
+    TextBuffer text = {0}; // JSON object written by the child
+    char buf[4096];
+    ssize_t got;
+    while (pid > 0 && (got = read(fds[0], buf, sizeof(buf))) > 0)
+        text_printf(&text, "%.*s", (int) got, buf);
+    close(fds[0]);
+    int status = 0;
+    int ok = pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+             WEXITSTATUS(status) == 0;
+    if (ok)
+        fputs(text.data, json);
+    else
+        fprintf(json, "    {\"contacts\": %zu, \"error\": \"%s\"}", n,
+                pid <= 0                ? "fork failed"
+                : WIFSIGNALED(status) ? "killed by a signal (out of memory?)"
+                                        : "benchmark failed");
+    free(text.data);
+    return ok ? 0 : -1;
+}
+
+// Parses "10000,100000,1e6" style lists of sizes; returns 0, or -1 if malformed
+static int bench_parse_sizes(const char *text, BenchOptions *o)
+{
+    o->size_count = 0;
+    while (*text)
+    {
+        char *end;
+        double v = strtod(text, &end);
+        if (end == text || v < 1 || v > UINT32_MAX / 2 || o->size_count == BENCH_MAX_SIZES)
+            return -1;
+        o->sizes[o->size_count++] = (size_t) v;
+        text = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',')
+            return -1;
+    }
+    return o->size_count ? 0 : -1;
+}
+
+static void bench_usage(void)
+{
+    fprintf(stderr,
+            "Usage: contact-bench [--sizes N,N,...] [--reps N] [--queries N] [--seed N]\n"
+            "                     [--json FILE] [--dir DIR]\n"
+            "  --sizes    directory sizes in contacts (default 10000,100000,1000000; 1e7 works)\n"
+            "  --reps     samples per whole-store benchmark (default 3)\n"
+            "  --queries  samples per search benchmark (default 1000)\n"
+            "  --seed     generator seed (default 1)\n"
+            "  --json     write the JSON results to FILE instead of standard output\n"
+            "  --dir      scratch directory for the generated files (default: new in /tmp)\n"
+            "  --generate N  only write an N-contact contacts.txt to the current directory\n"
+            "CMS_THREADS sets the worker threads, as for the program.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions o = {{10000, 100000, 1000000}, 3, 3, 1000, 1, NULL, NULL};
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i], *value = i + 1 < argc ? argv[i + 1] : NULL;
+        int ok = value != NULL;
+        if (ok && strcmp(arg, "--sizes") == 0)
+            ok = bench_parse_sizes(value, &o) == 0;
+        else if (ok && strcmp(arg, "--reps") == 0)
+            ok = (o.reps = atoi(value)) > 0;
+        else if (ok && strcmp(arg, "--queries") == 0)
+            ok = (o.queries = (size_t) strtoul(value, NULL, 10)) > 0;
+        else if (ok && strcmp(arg, "--seed") == 0)
+            o.seed = strtoull(value, NULL, 10);
+        else if (ok && strcmp(arg, "--json") == 0)
+            o.json_path = value;
+        else if (ok && strcmp(arg, "--dir") == 0)
+            o.dir = value;
+        else if (ok && strcmp(arg, "--generate") == 0)
+        {
+            size_t n = (size_t) strtod(value, NULL);
+            if (n == 0 || bench_generate(n, o.seed + n) != 0)
+            {
+                fprintf(stderr, "❌ Cannot write %s.\n", CONTACTS_PATH);
+                return 1;
+            }
+            return 0;
+        }
+        else
+            ok = 0;
+        if (!ok)
+        {
+            bench_usage();
+            return 2;
+        }
+        i++;
+    }
+
+    FILE *json = o.json_path ? fopen(o.json_path, "w") : stdout;
+    if (!json)
+    {
+        fprintf(stderr, "❌ Cannot open %s.\n", o.json_path);
+        return 1;
+    }
+
+    // Every file the engine writes is relative to the working directory
+    char scratch[] = "/tmp/contact-bench-XXXXXX";
+    const char *dir = o.dir ? o.dir : mkdtemp(scratch);
+    if (!dir || chdir(dir) != 0)
+    {
+        fprintf(stderr, "❌ Cannot use the scratch directory %s.\n", dir ? dir : scratch);
+        return 1;
+    }
+    fprintf(stderr, "📁 Working in %s with %d worker thread(s)\n", dir, worker_count());
+
+    fprintf(json,
+            "{\n  \"suite\": \"contact-bench\",\n  \"format\": 1,\n  \"threads\": %d,\n"
+            "  \"record_bytes\": %zu,\n  \"reps\": %d,\n  \"queries\": %zu,\n  \"runs\": [\n",
+            worker_count(), sizeof(Contact), o.reps, o.queries);
+    int failed = 0;
+    for (int s = 0; s < o.size_count; s++)
+    {
+        if (s)
+            fputs(",\n", json);
+        if (bench_run_size(&o, o.sizes[s], json) != 0)
+        {
+            fprintf(stderr, "❌ The %zu-contact run failed.\n", o.sizes[s]);
+            failed = 1;
+        }
+    }
+    fputs("\n  ]\n}\n", json);
+
+    static const char *const files[] = {CONTACTS_PATH, SNAPSHOT_PATH, JOURNAL_PATH};
+    for (size_t f = 0; f < sizeof(files) / sizeof(files[0]); f++)
+        remove(files[f]);
+    if (!o.dir)
+        rmdir(dir);
+    if (json != stdout && fclose(json) != 0)
+        failed = 1;
+    return failed;
+}
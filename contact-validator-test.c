@@ -0,0 +1,306 @@
+/*
+ * Project: Contact Management System - validator differential test
+ *
+ * Description:
+ * Checks that the hand-written validators used on bulk paths (validate_field()) accept
+ * exactly the values NAME_REGEX, PHONE_REGEX and EMAIL_REGEX accept (validate_with_regex()).
+ * The engine is compiled into this program (advanced-contact-manager.c with CMS_NO_MAIN),
+ * so both sides are the functions the program calls.
+ *
+ * - Inputs, for each of the three grammars:
+ *   • Boundary cases: every length around the field limits, each character class at the
+ *     start, middle and end of a value, and hand-picked near misses.
+ *   • Seeded random strings over an alphabet weighted towards the grammar's characters,
+ *     plus random edits (replace, insert, delete) of valid values.
+ *
+ * - Output:
+ *   • Each disagreement (up to 20), with the value escaped, on standard error.
+ *   • A count of values checked per grammar; exit status 1 if any disagreed.
+ *
+ * Build: gcc -O2 -o contact-validator-test contact-validator-test.c -Wall -std=c11 -pthread
+ * Run:   ./contact-validator-test [--seed 1] [--count 200000]
+ */
+
+#define CMS_NO_MAIN // Leaves out the program's main(); everything else is used as is
+#include "advanced-contact-manager.c"
+
+#define CHECK_MAX_LENGTH 300       // Longest value generated (beyond every field limit)
+#define CHECK_MAX_REPORTS 20       // Disagreements printed before only counting the rest
+#define CHECK_DEFAULT_COUNT 200000 // Random values per grammar
+
+// Grammar under test: the field validate_field() takes and the regex it must agree with
+typedef struct
+{
+    ContactField field;       // Field passed to validate_field()
+    const char *name;         // Name in the report
+    const char *pattern;      // Regex the field is defined by
+    const char *alphabet;     // Characters random values are mostly made of
+    const char *const *valid; // Valid values the random edits start from
+    size_t valid_count;       // Entries in 'valid'
+    size_t max_length;        // Longest random value, a few past the field limit
+} CheckGrammar;
+
+static size_t check_count;      // Values compared so far
+static size_t check_mismatches; // Values the two validators disagreed on
+
+// splitmix64, as in contact-bench.c
+static uint64_t check_random(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15u);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9u;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBu;
+    return z ^ (z >> 31);
+}
+
+// Prints 'value' with control and non-ASCII bytes as \xHH
+static void check_print_value(const char *value)
+{
+    for (const unsigned char *p = (const unsigned char *) value; *p; p++)
+    {
+        if (*p < 0x20 || *p >= 0x7f || *p == '\\')
+            fprintf(stderr, "\\x%02x", *p);
+        else
+            fputc(*p, stderr);
+    }
+}
+
+// Compares both validators on one NUL-terminated value
+static void check_value(const CheckGrammar *g, const char *value)
+{
+    int fast = validate_field(g->field, value, strlen(value));
+    int regex = validate_with_regex(g->pattern, value);
+    check_count++;
+    if (fast == regex)
+        return;
+    if (check_mismatches++ < CHECK_MAX_REPORTS)
+    {
+        fprintf(stderr, "❌ %s: validate_field() says %s, the regex says %s: \"", g->name,
+                fast ? "valid" : "invalid", regex ? "valid" : "invalid");
+        check_print_value(value);
+        fprintf(stderr, "\"\n");
+    }
+}
+
+// Checks 'len' copies of 'fill' between an optional prefix and suffix
+static void check_run(const CheckGrammar *g, const char *prefix, char fill, size_t len,
+                      const char *suffix)
+{
+    char value[CHECK_MAX_LENGTH + 64];
+    size_t n = strlen(prefix);
+    if (n + len + strlen(suffix) >= sizeof(value))
+        return;
+    memcpy(value, prefix, n);
+    memset(value + n, fill, len);
+    strcpy(value + n + len, suffix);
+    check_value(g, value);
+}
+
+// Every byte except NUL (values are C strings) in every position of each valid value
+static void check_every_byte(const CheckGrammar *g)
+{
+    char value[CHECK_MAX_LENGTH + 2];
+    for (size_t v = 0; v < g->valid_count; v++)
+    {
+        size_t len = strlen(g->valid[v]);
+        for (size_t at = 0; at <= len; at++)
+            for (int byte = 1; byte < 256; byte++)
+            {
+                strcpy(value, g->valid[v]);
+                if (at < len)
+                    value[at] = (char) byte; // Replaced
+                else
+                {
+                    value[len] = (char) byte; // Appended
+                    value[len + 1] = '\0';
+                }
+                check_value(g, value);
+            }
+    }
+}
+
+// NAME_REGEX: 2-50 characters, letters at both ends, letters, spaces, '-' and '\'' between
+static void check_name_boundaries(const CheckGrammar *g)
+{
+    static const char *const cases[] = {
+        "", "A", "Ab", "ab", "A b", "A-b", "A'b", "A  b", "A--b", "A''b", " Ab", "Ab ", "-Ab",
+        "Ab-", "'Ab", "Ab'", "A1b", "A_b", "A.b", "A\tb", "Jane Doe", "O'Neil", "Mary-Ann", "Zz",
+        "A@b", "AB", "a\xc3\xa9" "b", "\xc3\x89" "ab", "A b-c'd e"};
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        check_value(g, cases[i]);
+    for (size_t len = 0; len <= MAX_NAME_LENGTH + 4; len++)
+    {
+        check_run(g, "", 'a', len, "");
+        check_run(g, "A", ' ', len, "b");
+        check_run(g, "A", '-', len, "z");
+        check_run(g, "Z", '\'', len, "a");
+        check_run(g, "", 'Q', len, " ");
+    }
+}
+
+// PHONE_REGEX: 10 digits starting with 6-9, or '+', a non-zero digit and 6-14 more digits
+static void check_phone_boundaries(const CheckGrammar *g)
+{
+    static const char *const cases[] = {
+        "", "+", "++1234567", "+0123456", "+1234567", "+123456", "9876543210", "5876543210",
+        "0876543210", "987654321", "98765432101", "+919876543210", "+915876543210", "+91987654321",
+        "+9198765432101", "+1 4155552671", "+1-415-555-2671", "(415)5552671", "+14155552671 ",
+        " 9876543210", "+1415555267a", "9876543a10", "+44 20 7946 0958", "+123456789012345",
+        "+1234567890123456"};
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        check_value(g, cases[i]);
+    static const char *const leads[] = {"+0", "+1", "+9", "+91", "+916", "+915", "+91+",
+                                        "+",  "",   "0",  "1",   "5",    "6",    "9"};
+    for (size_t l = 0; l < sizeof(leads) / sizeof(leads[0]); l++)
+        for (size_t len = 0; len <= MAX_PHONE_LENGTH + 2; len++)
+        {
+            check_run(g, leads[l], '0', len, "");
+            check_run(g, leads[l], '7', len, "");
+            check_run(g, leads[l], '9', len, "x");
+        }
+}
+
+// EMAIL_REGEX: lowercase local part, one '@', a domain and a 2+ letter top-level domain
+static void check_email_boundaries(const CheckGrammar *g)
+{
+    static const char *const cases[] = {
+        "", "@", "a@b.co", "A@b.co", "a@b.c", "a@b.c1", "a@.co", "a@b..co", "a@b.co.", "@b.co",
+        "a@@b.co", "a@b@c.co", "a@b-.co", "a@-b.co", "a.b@c.d.ef", "a@b.CO", "a@B.co", "a..b@c.de",
+        ".a@b.co", "a.@b.co", "a%b+c_d-e@x.io", "a@b.c-o", "a@b.co ", " a@b.co", "a@b_c.co",
+        "a@b.co\n", "a@bc", "a@b.", "a@.", "a@b.\xc3\xa9t", "\xc3\xa9@b.co", "a@b.cc.d", "a@1.23",
+        "a@1.2a", "1@2.ab", "a@b.co.uk"};
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        check_value(g, cases[i]);
+    for (size_t len = 0; len <= MAX_EMAIL_LENGTH + 4; len++)
+    {
+        check_run(g, "", 'a', len, "@b.co");
+        check_run(g, "a@", 'b', len, ".co");
+        check_run(g, "a@b.", 'c', len, "");
+        check_run(g, "a@b", '.', len, "co");
+        check_run(g, "", '.', len, "@b.co");
+    }
+}
+
+// Random values: mostly the grammar's alphabet, sometimes any byte, of any length up to
+// g->max_length; every other value is a valid one with a few random edits
+static void check_random_values(const CheckGrammar *g, uint64_t seed, size_t count)
+{
+    uint64_t state = seed ^ (0x5851F42D4C957F2Du * (uint64_t) (g->field + 1));
+    size_t alphabet_len = strlen(g->alphabet);
+    char value[CHECK_MAX_LENGTH + 1];
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t r = check_random(&state);
+        size_t len;
+        if (i % 2 == 0)
+        {
+            len = (size_t) (r % (g->max_length + 1));
+            for (size_t k = 0; k < len; k++)
+            {
+                uint64_t c = check_random(&state);
+                value[k] = c % 16 == 0 ? (char) (1 + c / 16 % 255) // Any byte but NUL
+                                       : g->alphabet[c / 16 % alphabet_len];
+            }
+        }
+        else
+        {
+            const char *base = g->valid[r % g->valid_count];
+            len = strlen(base);
+            memcpy(value, base, len);
+            for (int edits = 1 + (int) (r >> 32) % 3; edits > 0; edits--)
+            {
+                uint64_t e = check_random(&state);
+                char c = e % 16 == 0 ? (char) (1 + e / 16 % 255)
+                                     : g->alphabet[e / 16 % alphabet_len];
+                size_t at = len ? (size_t) (e >> 40) % (len + 1) : 0;
+                switch (e / 4096 % 3)
+                {
+                    case 0: // Replace
+                        if (at < len)
+                            value[at] = c;
+                        break;
+                    case 1: // Insert
+                        if (len < CHECK_MAX_LENGTH)
+                        {
+                            memmove(value + at + 1, value + at, len - at);
+                            value[at] = c;
+                            len++;
+                        }
+                        break;
+                    default: // Delete
+                        if (at < len)
+                        {
+                            memmove(value + at, value + at + 1, len - at - 1);
+                            len--;
+                        }
+                        break;
+                }
+            }
+        }
+        value[len] = '\0';
+        check_value(g, value);
+    }
+}
+
+static void check_usage(void)
+{
+    fprintf(stderr, "Usage: contact-validator-test [--seed N] [--count N]\n"
+                    "  --seed   generator seed (default 1)\n"
+                    "  --count  random values per grammar (default 200000)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t seed = 1;
+    size_t count = CHECK_DEFAULT_COUNT;
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i], *value = i + 1 < argc ? argv[i + 1] : NULL;
+        int ok = value != NULL;
+        if (ok && strcmp(arg, "--seed") == 0)
+            seed = strtoull(value, NULL, 10);
+        else if (ok && strcmp(arg, "--count") == 0)
+            count = (size_t) strtod(value, NULL);
+        else
+            ok = 0;
+        if (!ok)
+        {
+            check_usage();
+            return 2;
+        }
+        i++;
+    }
+    if (validator_registry_init() != 0)
+        return 1;
+
+    static const char *const names[] = {"Jane Doe", "O'Neil", "Mary-Ann Smith", "Ab",
+                                        "Alexandria Konstantinopoulou-Vanderbilt Jr"};
+    static const char *const phones[] = {"+919876543210", "9876543210", "+14155552671",
+                                         "+1234567", "+123456789012345", "6000000000"};
+    static const char *const emails[] = {"jane@example.com", "a@b.co",
+                                         "first.last+tag@mail.co.uk",
+                                         "x_y%z-1@sub-domain.example.org", "u0@zz.io"};
+    const CheckGrammar grammars[FIELD_COUNT] = {
+        {FIELD_NAME, "name", NAME_REGEX, "abcxyzABCXYZ '-'- 1.", names,
+         sizeof(names) / sizeof(names[0]), MAX_NAME_LENGTH + 4},
+        {FIELD_PHONE, "phone", PHONE_REGEX, "+0123456789+6789 -a", phones,
+         sizeof(phones) / sizeof(phones[0]), MAX_PHONE_LENGTH + 3},
+        {FIELD_EMAIL, "email", EMAIL_REGEX, "abcxyz019._%+-@@..ABZ-_ ", emails,
+         sizeof(emails) / sizeof(emails[0]), 80},
+    };
+    void (*const boundaries[FIELD_COUNT])(const CheckGrammar *) = {
+        check_name_boundaries, check_phone_boundaries, check_email_boundaries};
+
+    for (int f = 0; f < FIELD_COUNT; f++)
+    {
+        const CheckGrammar *g = &grammars[f];
+        size_t before = check_count, mismatches = check_mismatches;
+        boundaries[f](g);
+        check_every_byte(g);
+        check_random_values(g, seed, count);
+        fprintf(stderr, "%s %-5s %zu values, %zu disagreement(s)\n",
+                check_mismatches == mismatches ? "✅" : "❌", g->name, check_count - before,
+                check_mismatches - mismatches);
+    }
+    validator_registry_free();
+    return check_mismatches != 0;
+}